@@ -0,0 +1,43 @@
+-- parses a large generated save file every frame. run it headless to
+-- benchmark spry.json_read on its own:
+--
+--   spry --headless --frames 60 examples/json_bench
+
+local ENTITIES = 50000
+
+local function make_save()
+  local entities = {}
+  for i = 1, ENTITIES do
+    local inventory = {}
+    for j = 1, i % 4 do
+      inventory[j] = { item = "potion", count = j }
+    end
+
+    entities[i] = {
+      id = i,
+      name = "entity_" .. i,
+      x = math.random() * 1000,
+      y = math.random() * 1000,
+      health = math.random(0, 100),
+      alive = i % 2 == 0,
+      inventory = inventory,
+      stats = { str = 1, dex = 2, int = 3, luck = 4 },
+    }
+  end
+
+  return { version = 1, entities = entities }
+end
+
+function spry.start()
+  font = spry.default_font()
+  save = assert(spry.json_write(make_save()))
+end
+
+function spry.frame(dt)
+  local begin = spry.elapsed()
+  local data = assert(spry.json_read(save))
+  local ms = (spry.elapsed() - begin) * 1000
+
+  font:draw(("%d entities, %.1f MB"):format(#data.entities, #save / 1e6))
+  font:draw(("json_read: %.2f ms"):format(ms), 0, 20)
+end
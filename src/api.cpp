@@ -115,7 +115,10 @@ static int mt_channel_send(lua_State *L) {
   LuaChannel *chan = check_channel_udata(L, 1);
 
   LuaVariant v = {};
-  v.make(L, 2);
+  if (!v.make(L, 2)) {
+    v.trash();
+    return luaL_error(L, "table has cycles or is nested too deeply");
+  }
   chan->send(v);
 
   return 0;
@@ -146,11 +149,67 @@ static int mt_channel_try_recv(lua_State *L) {
   return 2;
 }
 
+static int mt_channel_send_many(lua_State *L) {
+  PROFILE_FUNC();
+
+  LuaChannel *chan = check_channel_udata(L, 1);
+  luaL_checktype(L, 2, LUA_TTABLE);
+
+  lua_Integer len = luax_len(L, 2);
+
+  // every item is copied before any are sent, so a bad one sends nothing
+  Array<LuaVariant> items = {};
+  items.reserve(len);
+  for (lua_Integer i = 1; i <= len; i++) {
+    lua_rawgeti(L, 2, i);
+    LuaVariant v = {};
+    bool ok = v.make(L, -1);
+    items.push(v);
+    lua_pop(L, 1);
+
+    if (!ok) {
+      for (LuaVariant &item : items) {
+        item.trash();
+      }
+      items.trash();
+      return luaL_error(L, "item %d has cycles or is nested too deeply",
+                        (i32)i);
+    }
+  }
+
+  chan->send_many(Slice(items));
+  items.trash();
+  return 0;
+}
+
+static int mt_channel_recv_many(lua_State *L) {
+  PROFILE_FUNC();
+
+  LuaChannel *chan = check_channel_udata(L, 1);
+  lua_Integer n = luaL_checkinteger(L, 2);
+
+  Array<LuaVariant> items = {};
+  defer(items.trash());
+
+  chan->recv_many(n > 0 ? n : 0, &items);
+
+  lua_createtable(L, (i32)items.len, 0);
+  for (u64 i = 0; i < items.len; i++) {
+    items[i].push(L);
+    items[i].trash();
+    lua_rawseti(L, -2, i + 1);
+  }
+
+  return 1;
+}
+
 static int open_mt_channel(lua_State *L) {
   luaL_Reg reg[] = {
       {"send", mt_channel_send},
       {"recv", mt_channel_recv},
       {"try_recv", mt_channel_try_recv},
+      {"send_many", mt_channel_send_many},
+      {"recv_many", mt_channel_recv_many},
       {nullptr, nullptr},
   };
 
@@ -158,25 +217,443 @@ static int open_mt_channel(lua_State *L) {
   return 0;
 }
 
+// mt_asset_load
+
+static AssetLoadJob *check_asset_load_udata(lua_State *L, i32 arg) {
+  return *(AssetLoadJob **)luaL_checkudata(L, arg, "mt_asset_load");
+}
+
+static int mt_asset_load_gc(lua_State *L) {
+  AssetLoadJob *job = check_asset_load_udata(L, 1);
+  asset_load_release(job);
+  return 0;
+}
+
+static int mt_asset_load_done(lua_State *L) {
+  AssetLoadJob *job = check_asset_load_udata(L, 1);
+  i32 state = job->state.load();
+  lua_pushboolean(L, state == AssetLoadState_Done ||
+                         state == AssetLoadState_Failed);
+  return 1;
+}
+
+static int mt_asset_load_result(lua_State *L) {
+  AssetLoadJob *job = check_asset_load_udata(L, 1);
+  if (job->state.load() != AssetLoadState_Done) {
+    return 0;
+  }
+
+  Asset asset = job->asset;
+  switch (asset.kind) {
+  case AssetKind_Image: luax_new_userdata(L, asset.handle, "mt_image"); break;
+  case AssetKind_Sprite: {
+    Sprite spr = {};
+    spr.sprite = asset.handle;
+    luax_new_userdata(L, spr, "mt_sprite");
+    break;
+  }
+  case AssetKind_Tilemap:
+    luax_new_userdata(L, asset.handle, "mt_tilemap");
+    break;
+  default: return 0;
+  }
+
+  return 1;
+}
+
+static int mt_asset_load_decode_time(lua_State *L) {
+  AssetLoadJob *job = check_asset_load_udata(L, 1);
+  if (job->state.load() == AssetLoadState_Decoding) {
+    return 0;
+  }
+
+  lua_pushnumber(L, stm_sec(job->decode_ticks));
+  return 1;
+}
+
+static int open_mt_asset_load(lua_State *L) {
+  luaL_Reg reg[] = {
+      {"__gc", mt_asset_load_gc},
+      {"done", mt_asset_load_done},
+      {"result", mt_asset_load_result},
+      {"decode_time", mt_asset_load_decode_time},
+      {nullptr, nullptr},
+  };
+
+  luax_new_class(L, "mt_asset_load", reg);
+  return 0;
+}
+
+// mt_path_batch
+
+static TilePathBatch *check_path_batch_udata(lua_State *L, i32 arg) {
+  return *(TilePathBatch **)luaL_checkudata(L, arg, "mt_path_batch");
+}
+
+static int mt_path_batch_gc(lua_State *L) {
+  TilePathBatch *batch = check_path_batch_udata(L, 1);
+  tile_path_batch_release(batch);
+  return 0;
+}
+
+static int mt_path_batch_done(lua_State *L) {
+  TilePathBatch *batch = check_path_batch_udata(L, 1);
+  lua_pushboolean(L, batch->done());
+  return 1;
+}
+
+static int mt_path_batch_result(lua_State *L) {
+  PROFILE_FUNC();
+
+  TilePathBatch *batch = check_path_batch_udata(L, 1);
+  if (!batch->done()) {
+    return 0;
+  }
+
+  lua_createtable(L, (i32)batch->queries.len, 0);
+
+  for (u64 i = 0; i < batch->queries.len; i++) {
+    TilePathQuery q = batch->queries[i];
+    lua_createtable(L, q.len * 2, 0);
+
+    if (q.len > 0) {
+      TilePoint *points = &batch->chunks[q.chunk].points[q.first];
+      for (u32 j = 0; j < q.len; j++) {
+        lua_pushnumber(L, points[j].x);
+        lua_rawseti(L, -2, j * 2 + 1);
+        lua_pushnumber(L, points[j].y);
+        lua_rawseti(L, -2, j * 2 + 2);
+      }
+    }
+
+    lua_rawseti(L, -2, i + 1);
+  }
+
+  return 1;
+}
+
+static int open_mt_path_batch(lua_State *L) {
+  luaL_Reg reg[] = {
+      {"__gc", mt_path_batch_gc},
+      {"done", mt_path_batch_done},
+      {"result", mt_path_batch_result},
+      {nullptr, nullptr},
+  };
+
+  luax_new_class(L, "mt_path_batch", reg);
+  return 0;
+}
+
+// mt_flow_field
+
+static TileFlowField *check_flow_field_udata(lua_State *L, i32 arg) {
+  return *(TileFlowField **)luaL_checkudata(L, arg, "mt_flow_field");
+}
+
+static i32 flow_field_index(lua_State *L, TileFlowField *ff) {
+  TilePoint p = {};
+  p.x = (float)luaL_checknumber(L, 2);
+  p.y = (float)luaL_checknumber(L, 3);
+  return ff->graph->index(p);
+}
+
+static int mt_flow_field_gc(lua_State *L) {
+  TileFlowField *ff = check_flow_field_udata(L, 1);
+  ff->trash();
+  mem_free(ff);
+  return 0;
+}
+
+static int mt_flow_field_cost(lua_State *L) {
+  TileFlowField *ff = check_flow_field_udata(L, 1);
+  i32 i = flow_field_index(L, ff);
+  if (i == -1 || ff->costs[i] == INFINITY) {
+    return 0;
+  }
+
+  lua_pushnumber(L, ff->costs[i]);
+  return 1;
+}
+
+static int mt_flow_field_next(lua_State *L) {
+  TileFlowField *ff = check_flow_field_udata(L, 1);
+  i32 i = flow_field_index(L, ff);
+  if (i == -1 || ff->next[i] == -1) {
+    return 0;
+  }
+
+  TilePoint p = ff->graph->point(ff->next[i]);
+  lua_pushnumber(L, p.x);
+  lua_pushnumber(L, p.y);
+  return 2;
+}
+
+static int mt_flow_field_direction(lua_State *L) {
+  TileFlowField *ff = check_flow_field_udata(L, 1);
+  i32 i = flow_field_index(L, ff);
+  if (i == -1 || ff->costs[i] == INFINITY) {
+    return 0;
+  }
+
+  float dx = 0;
+  float dy = 0;
+
+  i32 next = ff->next[i];
+  if (next != -1) {
+    i32 width = ff->graph->width;
+    dx = (float)(next % width - i % width);
+    dy = (float)(next / width - i / width);
+
+    float len = sqrtf(dx * dx + dy * dy);
+    dx /= len;
+    dy /= len;
+  }
+
+  lua_pushnumber(L, dx);
+  lua_pushnumber(L, dy);
+  return 2;
+}
+
+static int mt_flow_field_update(lua_State *L) {
+  PROFILE_FUNC();
+
+  TileFlowField *ff = check_flow_field_udata(L, 1);
+  Tilemap *tm = &check_asset_mt(L, 2, "mt_tilemap")->tilemap;
+  if (tm->graph == nullptr) {
+    return luaL_error(L, "tilemap has no graph, call make_graph first");
+  }
+
+  Array<TilePoint> changed = {};
+  defer(changed.trash());
+
+  if (lua_istable(L, 3)) {
+    lua_Integer n = luax_len(L, 3);
+    changed.reserve(n / 2);
+
+    for (i32 i = 0; i + 1 < n; i += 2) {
+      lua_rawgeti(L, 3, i + 1);
+      lua_rawgeti(L, 3, i + 2);
+
+      TilePoint p = {};
+      p.x = (float)lua_tonumber(L, -2);
+      p.y = (float)lua_tonumber(L, -1);
+      changed.push(p);
+
+      lua_pop(L, 2);
+    }
+  }
+
+  ff->update(tm->graph, Slice(changed));
+  return 0;
+}
+
+static int open_mt_flow_field(lua_State *L) {
+  luaL_Reg reg[] = {
+      {"__gc", mt_flow_field_gc},
+      {"cost", mt_flow_field_cost},
+      {"next", mt_flow_field_next},
+      {"direction", mt_flow_field_direction},
+      {"update", mt_flow_field_update},
+      {nullptr, nullptr},
+  };
+
+  luax_new_class(L, "mt_flow_field", reg);
+  return 0;
+}
+
+// mt_json_reader
+
+static JSONReader *check_json_reader_udata(lua_State *L, i32 arg) {
+  return *(JSONReader **)luaL_checkudata(L, arg, "mt_json_reader");
+}
+
+// event name, then the key or value if it has one
+static i32 push_json_event(lua_State *L, JSONReader *r) {
+  switch (r->event) {
+  case JSONEvent_More: lua_pushliteral(L, "more"); return 1;
+  case JSONEvent_ObjectBegin: lua_pushliteral(L, "object_begin"); return 1;
+  case JSONEvent_ObjectEnd: lua_pushliteral(L, "object_end"); return 1;
+  case JSONEvent_ArrayBegin: lua_pushliteral(L, "array_begin"); return 1;
+  case JSONEvent_ArrayEnd: lua_pushliteral(L, "array_end"); return 1;
+  case JSONEvent_Key:
+    lua_pushliteral(L, "key");
+    lua_pushlstring(L, r->string.data, r->string.len);
+    return 2;
+  case JSONEvent_String:
+    lua_pushliteral(L, "string");
+    lua_pushlstring(L, r->string.data, r->string.len);
+    return 2;
+  case JSONEvent_Number:
+    lua_pushliteral(L, "number");
+    lua_pushnumber(L, r->number);
+    return 2;
+  case JSONEvent_Boolean:
+    lua_pushliteral(L, "boolean");
+    lua_pushboolean(L, r->boolean);
+    return 2;
+  case JSONEvent_Null: lua_pushliteral(L, "null"); return 1;
+  case JSONEvent_End: lua_pushliteral(L, "end"); return 1;
+  case JSONEvent_Error:
+    lua_pushliteral(L, "error");
+    lua_pushlstring(L, r->error.data, r->error.len);
+    return 2;
+  default: return 0;
+  }
+}
+
+static int mt_json_reader_gc(lua_State *L) {
+  JSONReader *r = check_json_reader_udata(L, 1);
+  r->trash();
+  mem_free(r);
+  return 0;
+}
+
+static int mt_json_reader_feed(lua_State *L) {
+  JSONReader *r = check_json_reader_udata(L, 1);
+  String chunk = luax_check_string(L, 2);
+
+  if (r->finished) {
+    return luaL_error(L, "json reader is already finished");
+  }
+
+  r->feed(chunk);
+  return 0;
+}
+
+static int mt_json_reader_finish(lua_State *L) {
+  JSONReader *r = check_json_reader_udata(L, 1);
+  r->finish();
+  return 0;
+}
+
+static int mt_json_reader_next(lua_State *L) {
+  JSONReader *r = check_json_reader_udata(L, 1);
+  r->next();
+  return push_json_event(L, r);
+}
+
+static int mt_json_reader_skip(lua_State *L) {
+  JSONReader *r = check_json_reader_udata(L, 1);
+  r->skip();
+  return push_json_event(L, r);
+}
+
+static int mt_json_reader_value(lua_State *L) {
+  PROFILE_FUNC();
+
+  JSONReader *r = check_json_reader_udata(L, 1);
+  if (json_read_lua(L, r)) {
+    return 1;
+  }
+
+  lua_pushnil(L);
+  return 1 + push_json_event(L, r);
+}
+
+static int mt_json_reader_depth(lua_State *L) {
+  JSONReader *r = check_json_reader_udata(L, 1);
+  lua_pushinteger(L, (lua_Integer)r->depth());
+  return 1;
+}
+
+static int open_mt_json_reader(lua_State *L) {
+  luaL_Reg reg[] = {
+      {"__gc", mt_json_reader_gc},
+      {"feed", mt_json_reader_feed},
+      {"finish", mt_json_reader_finish},
+      {"next", mt_json_reader_next},
+      {"skip", mt_json_reader_skip},
+      {"value", mt_json_reader_value},
+      {"depth", mt_json_reader_depth},
+      {nullptr, nullptr},
+  };
+
+  luax_new_class(L, "mt_json_reader", reg);
+  return 0;
+}
+
+// mt_json_job
+
+static JSONJob *check_json_job_udata(lua_State *L, i32 arg) {
+  return *(JSONJob **)luaL_checkudata(L, arg, "mt_json_job");
+}
+
+static int mt_json_job_gc(lua_State *L) {
+  JSONJob *job = check_json_job_udata(L, 1);
+  json_job_release(job);
+  return 0;
+}
+
+static int mt_json_job_done(lua_State *L) {
+  JSONJob *job = check_json_job_udata(L, 1);
+  lua_pushboolean(L, job->done.load(std::memory_order_acquire));
+  return 1;
+}
+
+static int mt_json_job_result(lua_State *L) {
+  PROFILE_FUNC();
+
+  JSONJob *job = check_json_job_udata(L, 1);
+  if (!job->done.load(std::memory_order_acquire)) {
+    return 0;
+  }
+
+  if (job->error.len != 0) {
+    lua_pushnil(L);
+    lua_pushlstring(L, job->error.data, job->error.len);
+    return 2;
+  }
+
+  switch (job->kind) {
+  case JSONJobKind_Read: {
+    if (!json_to_lua(L, &job->doc.root)) {
+      lua_pushnil(L);
+      lua_pushliteral(L, "json is nested too deeply");
+      return 2;
+    }
+    return 1;
+  }
+  case JSONJobKind_Write: {
+    Array<char> buf = job->writer.buf;
+    lua_pushlstring(L, buf.data, buf.len);
+    return 1;
+  }
+  }
+
+  return 0;
+}
+
+static int open_mt_json_job(lua_State *L) {
+  luaL_Reg reg[] = {
+      {"__gc", mt_json_job_gc},
+      {"done", mt_json_job_done},
+      {"result", mt_json_job_result},
+      {nullptr, nullptr},
+  };
+
+  luax_new_class(L, "mt_json_job", reg);
+  return 0;
+}
+
 // mt_image
 
 static int mt_image_draw(lua_State *L) {
-  Image img = check_asset_mt(L, 1, "mt_image").image;
+  Image *img = &check_asset_mt(L, 1, "mt_image")->image;
 
   DrawDescription dd = draw_description_args(L, 2);
-  draw_image(&img, &dd);
+  draw_image(img, &dd);
   return 0;
 }
 
 static int mt_image_width(lua_State *L) {
-  Image img = check_asset_mt(L, 1, "mt_image").image;
-  lua_pushnumber(L, img.width);
+  Image *img = &check_asset_mt(L, 1, "mt_image")->image;
+  lua_pushnumber(L, img->width);
   return 1;
 }
 
 static int mt_image_height(lua_State *L) {
-  Image img = check_asset_mt(L, 1, "mt_image").image;
-  lua_pushnumber(L, img.height);
+  Image *img = &check_asset_mt(L, 1, "mt_image")->image;
+  lua_pushnumber(L, img->height);
   return 1;
 }
 
@@ -475,17 +952,17 @@ static int mt_sprite_draw(lua_State *L) {
 
 static int mt_sprite_width(lua_State *L) {
   Sprite *spr = check_sprite_udata(L, 1);
-  SpriteData data = check_asset(L, spr->sprite).sprite;
+  SpriteData *data = &check_asset(L, spr->sprite)->sprite;
 
-  lua_pushnumber(L, (lua_Number)data.width);
+  lua_pushnumber(L, (lua_Number)data->width);
   return 1;
 }
 
 static int mt_sprite_height(lua_State *L) {
   Sprite *spr = check_sprite_udata(L, 1);
-  SpriteData data = check_asset(L, spr->sprite).sprite;
+  SpriteData *data = &check_asset(L, spr->sprite)->sprite;
 
-  lua_pushnumber(L, (lua_Number)data.height);
+  lua_pushnumber(L, (lua_Number)data->height);
   return 1;
 }
 
@@ -499,9 +976,9 @@ static int mt_sprite_set_frame(lua_State *L) {
 
 static int mt_sprite_total_frames(lua_State *L) {
   Sprite *spr = check_sprite_udata(L, 1);
-  SpriteData data = check_asset(L, spr->sprite).sprite;
+  SpriteData *data = &check_asset(L, spr->sprite)->sprite;
 
-  lua_pushinteger(L, data.frames.len);
+  lua_pushinteger(L, data->frames.len);
   return 1;
 }
 
@@ -601,16 +1078,43 @@ static int open_mt_atlas(lua_State *L) {
 // mt_tilemap
 
 static int mt_tilemap_draw(lua_State *L) {
-  Tilemap tm = check_asset_mt(L, 1, "mt_tilemap").tilemap;
-  draw_tilemap(&tm);
+  Tilemap *tm = &check_asset_mt(L, 1, "mt_tilemap")->tilemap;
+
+  Vector4 view = {};
+  if (lua_isnoneornil(L, 2)) {
+    view = renderer_view_rect();
+  } else {
+    lua_Number x = luaL_checknumber(L, 2);
+    lua_Number y = luaL_checknumber(L, 3);
+    lua_Number w = luaL_checknumber(L, 4);
+    lua_Number h = luaL_checknumber(L, 5);
+    view = vec4((float)x, (float)y, (float)(x + w), (float)(y + h));
+  }
+
+  draw_tilemap(tm, view);
   return 0;
 }
 
+static void push_level_entities(lua_State *L, TilemapLevel *level, i32 *i) {
+  for (TilemapLayer &layer : level->layers) {
+    for (TilemapEntity &entity : layer.entities) {
+      lua_createtable(L, 0, 3);
+
+      luax_set_string_field(L, "id", entity.identifier.data);
+      luax_set_number_field(L, "x", entity.x + level->world_x);
+      luax_set_number_field(L, "y", entity.y + level->world_y);
+
+      lua_rawseti(L, -2, *i);
+      (*i)++;
+    }
+  }
+}
+
 static int mt_tilemap_entities(lua_State *L) {
-  Tilemap tm = check_asset_mt(L, 1, "mt_tilemap").tilemap;
+  Tilemap *tm = &check_asset_mt(L, 1, "mt_tilemap")->tilemap;
 
   u64 entities = 0;
-  for (TilemapLevel &level : tm.levels) {
+  for (TilemapLevel &level : tm->levels) {
     for (TilemapLayer &layer : level.layers) {
       entities += layer.entities.len;
     }
@@ -619,26 +1123,65 @@ static int mt_tilemap_entities(lua_State *L) {
   lua_createtable(L, (i32)entities, 0);
 
   i32 i = 1;
-  for (TilemapLevel &level : tm.levels) {
-    for (TilemapLayer &layer : level.layers) {
-      for (TilemapEntity &entity : layer.entities) {
-        lua_createtable(L, 0, 3);
+  for (TilemapLevel &level : tm->levels) {
+    push_level_entities(L, &level, &i);
+  }
 
-        luax_set_string_field(L, "id", entity.identifier.data);
-        luax_set_number_field(L, "x", entity.x + level.world_x);
-        luax_set_number_field(L, "y", entity.y + level.world_y);
+  return 1;
+}
+
+static int mt_tilemap_stream(lua_State *L) {
+  PROFILE_FUNC();
+
+  Tilemap *tm = &check_asset_mt(L, 1, "mt_tilemap")->tilemap;
+  lua_Number x = luaL_checknumber(L, 2);
+  lua_Number y = luaL_checknumber(L, 3);
+  lua_Number radius = luaL_checknumber(L, 4);
+
+  Array<TilemapStreamEvent> events = {};
+  defer(events.trash());
+
+  tm->update_stream((float)x, (float)y, (float)radius, &events);
+
+  // levels and the stream are shared between asset versions, so tm stays
+  // usable while the callbacks run
+  lua_pushcfunction(L, luax_msgh);
+  i32 msgh = lua_gettop(L);
+
+  for (TilemapStreamEvent e : events) {
+    i32 callback = e.loaded ? 5 : 6;
+    if (lua_isnoneornil(L, callback)) {
+      continue;
+    }
+
+    TilemapLevel *level = &tm->levels[e.level];
 
-        lua_rawseti(L, -2, i);
-        i++;
+    lua_pushvalue(L, callback);
+    lua_pushlstring(L, level->identifier.data, level->identifier.len);
+    if (e.loaded) {
+      u64 entities = 0;
+      for (TilemapLayer &layer : level->layers) {
+        entities += layer.entities.len;
       }
+
+      lua_createtable(L, (i32)entities, 0);
+      i32 i = 1;
+      push_level_entities(L, level, &i);
+    }
+
+    if (lua_pcall(L, e.loaded ? 2 : 1, 0, msgh) != LUA_OK) {
+      lua_pop(L, 1);
     }
   }
+  lua_pop(L, 1);
 
+  i32 loading = tm->stream != nullptr ? tm->stream->loading : 0;
+  lua_pushinteger(L, loading);
   return 1;
 }
 
 static int mt_tilemap_make_collision(lua_State *L) {
-  Asset asset = check_asset_mt(L, 1, "mt_tilemap");
+  Asset asset = *check_asset_mt(L, 1, "mt_tilemap");
 
   Physics *physics = (Physics *)luaL_checkudata(L, 2, "mt_b2_world");
   String name = luax_check_string(L, 3);
@@ -647,35 +1190,81 @@ static int mt_tilemap_make_collision(lua_State *L) {
   defer(walls.trash());
 
   walls.reserve(luax_len(L, 4));
-  for (lua_pushnil(L); lua_next(L, -2); lua_pop(L, 1)) {
+  for (lua_pushnil(L); lua_next(L, 4); lua_pop(L, 1)) {
     lua_Number tile = luaL_checknumber(L, -1);
     walls.push((TilemapInt)tile);
   }
 
+  String mode_name = luax_opt_string(L, 5, "boxes");
+  TileCollision mode = TileCollision_Boxes;
+  if (mode_name == "rects") {
+    mode = TileCollision_Rects;
+  } else if (mode_name == "chains") {
+    mode = TileCollision_Chains;
+  } else if (mode_name != "boxes") {
+    return luaL_error(L, "invalid collision mode: %s", mode_name.data);
+  }
+
+  Array<TileCollisionCount> counts = {};
+  defer(counts.trash());
+
   asset.tilemap.make_collision(physics->world, physics->meter, name,
-                               Slice(walls));
+                               Slice(walls), mode, &counts);
   asset_write(asset);
-  return 0;
+
+  lua_createtable(L, 0, (i32)counts.len);
+  for (TileCollisionCount count : counts) {
+    lua_pushlstring(L, count.level.data, count.level.len);
+    lua_createtable(L, 0, 2);
+    luax_set_int_field(L, "fixtures", count.fixtures);
+    luax_set_int_field(L, "proxies", count.proxies);
+    lua_rawset(L, -3);
+  }
+  return 1;
+}
+
+static int mt_tilemap_set_int(lua_State *L) {
+  PROFILE_FUNC();
+
+  Asset asset = *check_asset_mt(L, 1, "mt_tilemap");
+  String level = luax_check_string(L, 2);
+  String layer = luax_check_string(L, 3);
+  i32 x = (i32)luaL_checknumber(L, 4);
+  i32 y = (i32)luaL_checknumber(L, 5);
+  TilemapInt value = (TilemapInt)luaL_checknumber(L, 6);
+
+  TileGraph *graph = asset.tilemap.graph;
+  bool ok = asset.tilemap.set_int(level, layer, x, y, value);
+
+  // fixtures and the grid change in place, but the graph is replaced by a
+  // copy if path jobs were using it
+  if (asset.tilemap.graph != graph) {
+    asset_write(asset);
+  }
+
+  lua_pushboolean(L, ok);
+  return 1;
 }
 
 static int mt_tilemap_draw_fixtures(lua_State *L) {
-  Tilemap tm = check_asset_mt(L, 1, "mt_tilemap").tilemap;
+  Tilemap *tm = &check_asset_mt(L, 1, "mt_tilemap")->tilemap;
   Physics *physics = (Physics *)luaL_checkudata(L, 2, "mt_b2_world");
   String name = luax_check_string(L, 3);
 
-  b2Body **body = tm.bodies.get(fnv1a(name));
+  TileCollisionBody *body = tm->bodies.get(fnv1a(name));
   if (body != nullptr) {
-    draw_fixtures_for_body(*body, physics->meter);
+    draw_fixtures_for_body(body->body, physics->meter);
   }
 
   return 0;
 }
 
 static int mt_tilemap_make_graph(lua_State *L) {
-  Asset asset = check_asset_mt(L, 1, "mt_tilemap");
+  Asset asset = *check_asset_mt(L, 1, "mt_tilemap");
 
   String name = luax_check_string(L, 2);
   i32 bloom = (i32)luaL_optnumber(L, 4, 1);
+  i32 cluster_size = (i32)luaL_optnumber(L, 5, 0);
 
   Array<TileCost> costs = {};
   defer(costs.trash());
@@ -694,7 +1283,7 @@ static int mt_tilemap_make_graph(lua_State *L) {
   }
   lua_pop(L, 1);
 
-  asset.tilemap.make_graph(bloom, name, Slice(costs));
+  asset.tilemap.make_graph(bloom, name, Slice(costs), cluster_size);
   asset_write(asset);
   return 0;
 }
@@ -702,8 +1291,7 @@ static int mt_tilemap_make_graph(lua_State *L) {
 static int mt_tilemap_astar(lua_State *L) {
   PROFILE_FUNC();
 
-  Asset asset = check_asset_mt(L, 1, "mt_tilemap");
-  defer(asset_write(asset));
+  Tilemap *tm = &check_asset_mt(L, 1, "mt_tilemap")->tilemap;
 
   lua_Number sx = luaL_checknumber(L, 2);
   lua_Number sy = luaL_checknumber(L, 3);
@@ -718,19 +1306,27 @@ static int mt_tilemap_astar(lua_State *L) {
   goal.x = (i32)ex;
   goal.y = (i32)ey;
 
-  TileNode *end = asset.tilemap.astar(goal, start);
+  lua_newtable(L);
+
+  TileGraph *graph = tm->graph;
+  if (graph == nullptr) {
+    return 1;
+  }
+
+  TileSearch *search = tile_search();
+  graph->path(start, goal, search);
 
   {
     PROFILE_BLOCK("construct path");
 
-    lua_newtable(L);
-
     i32 i = 1;
-    for (TileNode *n = end; n != nullptr; n = n->prev) {
+    for (i32 n : search->path) {
+      TilePoint p = graph->point(n);
+
       lua_createtable(L, 0, 2);
 
-      luax_set_number_field(L, "x", n->x * asset.tilemap.graph_grid_size);
-      luax_set_number_field(L, "y", n->y * asset.tilemap.graph_grid_size);
+      luax_set_number_field(L, "x", p.x);
+      luax_set_number_field(L, "y", p.y);
 
       lua_rawseti(L, -2, i);
       i++;
@@ -740,14 +1336,77 @@ static int mt_tilemap_astar(lua_State *L) {
   return 1;
 }
 
+static int mt_tilemap_astar_batch(lua_State *L) {
+  PROFILE_FUNC();
+
+  Tilemap *tm = &check_asset_mt(L, 1, "mt_tilemap")->tilemap;
+  luaL_checktype(L, 2, LUA_TTABLE);
+
+  lua_Integer n = luax_len(L, 2);
+
+  Array<TilePathQuery> queries = {};
+  queries.reserve(n);
+
+  for (i32 i = 0; i < n; i++) {
+    luax_geti(L, 2, i + 1);
+    if (!lua_istable(L, -1)) {
+      queries.trash();
+      return luaL_error(L, "expected a table of {sx, sy, ex, ey} queries");
+    }
+
+    lua_Number nums[4] = {};
+    for (i32 j = 0; j < 4; j++) {
+      lua_rawgeti(L, -1, j + 1);
+      nums[j] = lua_tonumber(L, -1);
+      lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+
+    TilePathQuery q = {};
+    q.start = {(float)(i32)nums[0], (float)(i32)nums[1]};
+    q.goal = {(float)(i32)nums[2], (float)(i32)nums[3]};
+    queries.push(q);
+  }
+
+  TilePathBatch *batch = tile_path_batch_make(tm->graph, queries);
+  luax_ptr_userdata(L, batch, "mt_path_batch");
+  return 1;
+}
+
+static int mt_tilemap_flow_field(lua_State *L) {
+  PROFILE_FUNC();
+
+  Tilemap *tm = &check_asset_mt(L, 1, "mt_tilemap")->tilemap;
+
+  TilePoint goal = {};
+  goal.x = (i32)luaL_checknumber(L, 2);
+  goal.y = (i32)luaL_checknumber(L, 3);
+  lua_Number max_cost = luaL_optnumber(L, 4, INFINITY);
+
+  if (tm->graph == nullptr) {
+    return 0;
+  }
+
+  TileFlowField *ff = (TileFlowField *)mem_alloc(sizeof(TileFlowField));
+  *ff = {};
+  ff->make(tm->graph, goal, (float)max_cost);
+
+  luax_ptr_userdata(L, ff, "mt_flow_field");
+  return 1;
+}
+
 static int open_mt_tilemap(lua_State *L) {
   luaL_Reg reg[] = {
       {"draw", mt_tilemap_draw},
       {"entities", mt_tilemap_entities},
+      {"stream", mt_tilemap_stream},
       {"make_collision", mt_tilemap_make_collision},
       {"draw_fixtures", mt_tilemap_draw_fixtures},
+      {"set_int", mt_tilemap_set_int},
       {"make_graph", mt_tilemap_make_graph},
       {"astar", mt_tilemap_astar},
+      {"astar_batch", mt_tilemap_astar_batch},
+      {"flow_field", mt_tilemap_flow_field},
       {nullptr, nullptr},
   };
 
@@ -1990,7 +2649,11 @@ static int spry_set_console_window(lua_State *L) {
 
 static int spry_quit(lua_State *L) {
   (void)L;
-  sapp_request_quit();
+  if (g_app->headless) {
+    g_app->headless_quit.store(true);
+  } else {
+    sapp_request_quit();
+  }
   return 0;
 }
 
@@ -2016,24 +2679,51 @@ static int spry_dt(lua_State *L) {
   return 1;
 }
 
+static int spry_frame_allocations(lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)g_app->frame_allocs);
+  return 1;
+}
+
+static int spry_profile_start(lua_State *L) {
+  lua_Integer frames = luaL_optinteger(L, 1, 0);
+  if (frames > 0) {
+    profile_capture_frames((i32)frames);
+  } else {
+    profile_start();
+  }
+  return 0;
+}
+
+static int spry_profile_stop(lua_State *L) {
+  profile_stop();
+  return 0;
+}
+
+static int spry_profile_active(lua_State *L) {
+  lua_pushboolean(L, profile_active());
+  return 1;
+}
+
 static int spry_fullscreen(lua_State *L) {
   lua_pushboolean(L, sapp_is_fullscreen());
   return 1;
 }
 
 static int spry_toggle_fullscreen(lua_State *L) {
-  sapp_toggle_fullscreen();
+  if (!g_app->headless) {
+    sapp_toggle_fullscreen();
+  }
   return 0;
 }
 
 static int spry_window_width(lua_State *L) {
-  float width = sapp_widthf();
+  float width = app_width();
   lua_pushnumber(L, width);
   return 1;
 }
 
 static int spry_window_height(lua_State *L) {
-  float height = sapp_heightf();
+  float height = app_height();
   lua_pushnumber(L, height);
   return 1;
 }
@@ -2061,6 +2751,8 @@ static int spry_json_read(lua_State *L) {
 
   String str = luax_check_string(L, 1);
 
+  // the document knows how many entries each table needs, so this is
+  // faster than reading straight into lua with a JSONReader
   JSONDocument doc = {};
   doc.parse(str);
   defer(doc.trash());
@@ -2071,10 +2763,25 @@ static int spry_json_read(lua_State *L) {
     return 2;
   }
 
-  {
-    PROFILE_BLOCK("json to lua");
-    json_to_lua(L, &doc.root);
+  if (!json_to_lua(L, &doc.root)) {
+    lua_pushnil(L);
+    lua_pushliteral(L, "json is nested too deeply");
+    return 2;
   }
+
+  return 1;
+}
+
+static int spry_json_reader(lua_State *L) {
+  JSONReader *r = (JSONReader *)mem_alloc(sizeof(JSONReader));
+  *r = {};
+
+  if (!lua_isnoneornil(L, 1)) {
+    r->feed(luax_check_string(L, 1));
+    r->finish();
+  }
+
+  luax_ptr_userdata(L, r, "mt_json_reader");
   return 1;
 }
 
@@ -2083,16 +2790,87 @@ static int spry_json_write(lua_State *L) {
 
   lua_Integer width = luaL_optinteger(L, 2, 0);
 
-  String contents = {};
-  String err = lua_to_json_string(L, 1, &contents, width);
+  JSONWriter *w = json_writer();
+  w->buf.len = 0;
+  w->width = (i32)width;
+
+  String err = w->write_lua(L, 1);
   if (err.len != 0) {
     lua_pushnil(L);
     lua_pushlstring(L, err.data, err.len);
     return 2;
   }
 
-  lua_pushlstring(L, contents.data, contents.len);
-  mem_free(contents.data);
+  lua_pushlstring(L, w->buf.data, w->buf.len);
+  return 1;
+}
+
+static int spry_json_write_file(lua_State *L) {
+  PROFILE_FUNC();
+
+  String path = luax_check_string(L, 1);
+  lua_Integer width = luaL_optinteger(L, 3, 0);
+
+  FILE *file = vfs_open_write(path);
+  if (file == nullptr) {
+    lua_pushnil(L);
+    lua_pushliteral(L, "can't open file for writing");
+    return 2;
+  }
+
+  JSONWriter *w = json_writer();
+  w->buf.len = 0;
+  w->width = (i32)width;
+  w->file = file;
+  w->failed = false;
+
+  String err = w->write_lua(L, 2);
+  bool written = vfs_close_write(file, path, err.len == 0 && !w->failed);
+  w->file = nullptr;
+  w->buf.len = 0;
+
+  if (err.len != 0) {
+    lua_pushnil(L);
+    lua_pushlstring(L, err.data, err.len);
+    return 2;
+  }
+
+  if (!written) {
+    lua_pushnil(L);
+    lua_pushliteral(L, "failed to write file");
+    return 2;
+  }
+
+  lua_pushboolean(L, true);
+  return 1;
+}
+
+static int spry_json_read_async(lua_State *L) {
+  String str = luax_check_string(L, 1);
+
+  // json text starts with an object or array. anything else is a path
+  u64 i = 0;
+  while (i < str.len && is_whitespace(str.data[i])) {
+    i++;
+  }
+  bool text = i < str.len && (str.data[i] == '{' || str.data[i] == '[');
+
+  JSONJob *job = nullptr;
+  if (text) {
+    job = json_read_async(to_cstr(str), {});
+  } else {
+    job = json_read_async({}, to_cstr(str));
+  }
+
+  luax_ptr_userdata(L, job, "mt_json_job");
+  return 1;
+}
+
+static int spry_json_write_async(lua_State *L) {
+  lua_Integer width = luaL_optinteger(L, 2, 0);
+
+  JSONJob *job = json_write_async(L, 1, (i32)width);
+  luax_ptr_userdata(L, job, "mt_json_job");
   return 1;
 }
 
@@ -2295,7 +3073,9 @@ static int spry_mouse_delta(lua_State *L) {
 
 static int spry_show_mouse(lua_State *L) {
   bool show = lua_toboolean(L, 1);
-  sapp_show_mouse(show);
+  if (!g_app->headless) {
+    sapp_show_mouse(show);
+  }
   return 0;
 }
 
@@ -2510,9 +3290,10 @@ static int spry_joystick_add_mappings(lua_State *L) {
 static int spry_scissor_rect(lua_State *L) {
   lua_Number x = luaL_optnumber(L, 1, 0);
   lua_Number y = luaL_optnumber(L, 2, 0);
-  lua_Number w = luaL_optnumber(L, 3, sapp_widthf());
-  lua_Number h = luaL_optnumber(L, 4, sapp_heightf());
+  lua_Number w = luaL_optnumber(L, 3, app_width());
+  lua_Number h = luaL_optnumber(L, 4, app_height());
 
+  renderer_flush();
   sgl_scissor_rectf(x, y, w, h, true);
   return 0;
 }
@@ -2600,6 +3381,15 @@ static int spry_default_font(lua_State *L) {
   return 1;
 }
 
+static int spry_draw_stats(lua_State *L) {
+  RendererStats stats = renderer_stats();
+
+  lua_createtable(L, 0, 2);
+  luax_set_int_field(L, "batches", (lua_Integer)stats.batches);
+  luax_set_int_field(L, "vertices", (lua_Integer)stats.vertices);
+  return 1;
+}
+
 static int spry_draw_filled_rect(lua_State *L) {
   RectDescription rd = rect_description_args(L, 1);
   draw_filled_rect(&rd);
@@ -2649,9 +3439,23 @@ static int spry_get_channel(lua_State *L) {
   return 1;
 }
 
-static int spry_select(lua_State *L) {
+// channels, then an optional timeout in seconds
+// channels are arguments 1 to len
+static int push_select(lua_State *L, i32 len, double timeout) {
+  // checked before allocating, since luaL_error skips defer
+  for (i32 i = 1; i <= len; i++) {
+    check_channel_udata(L, i);
+  }
+
+  Array<LuaChannel *> chans = {};
+  defer(chans.trash());
+  chans.reserve(len);
+  for (i32 i = 1; i <= len; i++) {
+    chans.push(check_channel_udata(L, i));
+  }
+
   LuaVariant v = {};
-  LuaChannel *chan = lua_channels_select(L, &v);
+  LuaChannel *chan = lua_channels_select(Slice(chans), &v, timeout);
   if (chan == nullptr) {
     return 0;
   }
@@ -2662,6 +3466,24 @@ static int spry_select(lua_State *L) {
   return 2;
 }
 
+static int spry_select(lua_State *L) {
+  i32 len = lua_gettop(L);
+  double timeout = -1;
+  if (len > 0 && lua_type(L, len) == LUA_TNUMBER) {
+    timeout = lua_tonumber(L, len);
+    if (isnan(timeout)) {
+      return luaL_error(L, "timeout is NaN");
+    }
+    len--;
+  }
+
+  return push_select(L, len, timeout);
+}
+
+static int spry_try_select(lua_State *L) {
+  return push_select(L, lua_gettop(L), 0);
+}
+
 static int spry_thread_id(lua_State *L) {
   lua_pushinteger(L, this_thread_id());
   return 1;
@@ -2811,7 +3633,49 @@ static int spry_image_load(lua_State *L) {
     return 0;
   }
 
-  luax_new_userdata(L, asset.hash, "mt_image");
+  luax_new_userdata(L, asset.handle, "mt_image");
+  return 1;
+}
+
+static int push_asset_load(lua_State *L, AssetLoadData desc) {
+  String str = luax_check_string(L, 1);
+
+  AssetLoadJob *job = asset_load_async(desc, str);
+  luax_ptr_userdata(L, job, "mt_asset_load");
+  return 1;
+}
+
+static int spry_image_load_async(lua_State *L) {
+  AssetLoadData desc = {};
+  desc.kind = AssetKind_Image;
+  desc.generate_mips = lua_toboolean(L, 2);
+  return push_asset_load(L, desc);
+}
+
+static int spry_sprite_load_async(lua_State *L) {
+  AssetLoadData desc = {};
+  desc.kind = AssetKind_Sprite;
+  return push_asset_load(L, desc);
+}
+
+static int spry_tilemap_load_async(lua_State *L) {
+  AssetLoadData desc = {};
+  desc.kind = AssetKind_Tilemap;
+  desc.stream_levels = lua_toboolean(L, 2);
+  return push_asset_load(L, desc);
+}
+
+static int spry_asset_load_stats(lua_State *L) {
+  AssetLoadStats stats = asset_load_stats();
+
+  lua_createtable(L, 0, 6);
+  luax_set_int_field(L, "decoding", (lua_Integer)stats.decoding);
+  luax_set_int_field(L, "uploading", (lua_Integer)stats.uploading);
+  luax_set_int_field(L, "loaded", (lua_Integer)stats.loaded);
+  luax_set_int_field(L, "failed", (lua_Integer)stats.failed);
+  luax_set_number_field(L, "decode_time", stm_sec(stats.decode_ticks));
+  luax_set_number_field(L, "last_decode_time",
+                        stm_sec(stats.last_decode_ticks));
   return 1;
 }
 
@@ -2851,7 +3715,7 @@ static int spry_sprite_load(lua_State *L) {
   }
 
   Sprite spr = {};
-  spr.sprite = asset.hash;
+  spr.sprite = asset.handle;
 
   luax_new_userdata(L, spr, "mt_sprite");
   return 1;
@@ -2873,14 +3737,19 @@ static int spry_atlas_load(lua_State *L) {
 
 static int spry_tilemap_load(lua_State *L) {
   String str = luax_check_string(L, 1);
+  bool stream_levels = lua_toboolean(L, 2);
+
+  AssetLoadData desc = {};
+  desc.kind = AssetKind_Tilemap;
+  desc.stream_levels = stream_levels;
 
   Asset asset = {};
-  bool ok = asset_load_kind(AssetKind_Tilemap, str, &asset);
+  bool ok = asset_load(desc, str, &asset);
   if (!ok) {
     return 0;
   }
 
-  luax_new_userdata(L, asset.hash, "mt_tilemap");
+  luax_new_userdata(L, asset.handle, "mt_tilemap");
   return 1;
 }
 
@@ -2909,6 +3778,10 @@ static int open_spry(lua_State *L) {
       {"fatal_error", spry_fatal_error},
       {"platform", spry_platform},
       {"dt", spry_dt},
+      {"frame_allocations", spry_frame_allocations},
+      {"profile_start", spry_profile_start},
+      {"profile_stop", spry_profile_stop},
+      {"profile_active", spry_profile_active},
       {"fullscreen", spry_fullscreen},
       {"toggle_fullscreen", spry_toggle_fullscreen},
       {"window_width", spry_window_width},
@@ -2918,6 +3791,10 @@ static int open_spry(lua_State *L) {
       {"elapsed", spry_elapsed},
       {"json_read", spry_json_read},
       {"json_write", spry_json_write},
+      {"json_write_file", spry_json_write_file},
+      {"json_read_async", spry_json_read_async},
+      {"json_write_async", spry_json_write_async},
+      {"json_reader", spry_json_reader},
 
       // input
       {"key_down", spry_key_down},
@@ -2961,6 +3838,7 @@ static int open_spry(lua_State *L) {
       {"pop_color", spry_pop_color},
       {"default_font", spry_default_font},
       {"default_sampler", spry_default_sampler},
+      {"draw_stats", spry_draw_stats},
       {"draw_filled_rect", spry_draw_filled_rect},
       {"draw_line_rect", spry_draw_line_rect},
       {"draw_line_circle", spry_draw_line_circle},
@@ -2972,6 +3850,7 @@ static int open_spry(lua_State *L) {
       // concurrency
       {"get_channel", spry_get_channel},
       {"select", spry_select},
+      {"try_select", spry_try_select},
       {"thread_id", spry_thread_id},
       {"thread_sleep", spry_thread_sleep},
 
@@ -2992,6 +3871,10 @@ static int open_spry(lua_State *L) {
       {"sprite_load", spry_sprite_load},
       {"atlas_load", spry_atlas_load},
       {"tilemap_load", spry_tilemap_load},
+      {"image_load_async", spry_image_load_async},
+      {"sprite_load_async", spry_sprite_load_async},
+      {"tilemap_load_async", spry_tilemap_load_async},
+      {"asset_load_stats", spry_asset_load_stats},
       {"b2_world", spry_b2_world},
       {nullptr, nullptr},
   };
@@ -3007,7 +3890,8 @@ void open_spry_api(lua_State *L) {
       open_mt_sprite,   open_mt_atlas_image,  open_mt_atlas,
       open_mt_tilemap,  open_mt_b2_fixture,   open_mt_b2_body,
       open_mt_b2_world, open_mt_mu_container, open_mt_mu_style,
-      open_mt_mu_ref,
+      open_mt_mu_ref,   open_mt_asset_load,   open_mt_path_batch,
+      open_mt_flow_field, open_mt_json_reader, open_mt_json_job,
   };
 
   for (u32 i = 0; i < array_size(mt_funcs); i++) {
@@ -2,6 +2,7 @@
 
 #include "array.h"
 #include "deps/luaalloc.h"
+#include "deps/sokol_app.h"
 #include "deps/sokol_gfx.h"
 #include "deps/sokol_gl.h"
 #include "font.h"
@@ -62,10 +63,27 @@ struct App {
   void *miniaudio_vfs;
   ma_engine audio_engine;
   Array<Sound *> garbage_sounds;
+
+  u64 frame_allocs; // heap allocations during the previous frame
+
+  // set by --headless. no window is opened and frames use a fixed dt
+  bool headless;
+  double headless_dt;
+  float headless_width;
+  float headless_height;
+  std::atomic<bool> headless_quit; // spry.quit() ends the run early
 };
 
 extern App *g_app;
 
+inline float app_width() {
+  return g_app->headless ? g_app->headless_width : sapp_widthf();
+}
+
+inline float app_height() {
+  return g_app->headless ? g_app->headless_height : sapp_heightf();
+}
+
 inline void fatal_error(String str) {
   if (!g_app->error_mode.load()) {
     LockGuard lock{&g_app->error_mtx};
@@ -24,6 +24,7 @@ static ArenaNode *arena_block_make(u64 capacity) {
   ArenaNode *a = (ArenaNode *)mem_alloc(offsetof(ArenaNode, buf) + capacity);
   a->next = nullptr;
   a->allocd = 0;
+  a->prev = 0;
   a->capacity = capacity;
   return a;
 }
@@ -35,6 +36,29 @@ void Arena::trash() {
     a = a->next;
     mem_free(rm);
   }
+  head = nullptr;
+}
+
+void Arena::reset() {
+  if (head == nullptr) {
+    return;
+  }
+
+  if (head->next == nullptr) {
+    head->allocd = 0;
+    head->prev = 0;
+    return;
+  }
+
+  // grew past one block, replace them with a single block that fits
+  // everything so the next reset doesn't have to do this again
+  u64 capacity = 0;
+  for (ArenaNode *a = head; a != nullptr; a = a->next) {
+    capacity += a->capacity;
+  }
+
+  trash();
+  head = arena_block_make(capacity);
 }
 
 void *Arena::bump(u64 size) {
@@ -82,6 +106,41 @@ void *Arena::rebump(void *ptr, u64 old, u64 size) {
   return new_ptr;
 }
 
+ArenaMark Arena::mark() {
+  ArenaMark m = {};
+  m.head = head;
+  if (head != nullptr) {
+    m.allocd = head->allocd;
+    m.prev = head->prev;
+  }
+  return m;
+}
+
+void Arena::pop(ArenaMark m) {
+  while (head != m.head) {
+    ArenaNode *rm = head;
+    head = head->next;
+    mem_free(rm);
+  }
+
+  if (head != nullptr) {
+    head->allocd = m.allocd;
+    head->prev = m.prev;
+  }
+}
+
+static thread_local Arena t_frame_arena = {};
+
+Arena *frame_arena() {
+  if (t_frame_arena.head == nullptr) {
+    t_frame_arena.head = arena_block_make(0);
+  }
+  return &t_frame_arena;
+}
+
+void frame_arena_reset() { t_frame_arena.reset(); }
+void frame_arena_trash() { t_frame_arena.trash(); }
+
 String Arena::bump_string(String s) {
   if (s.len > 0) {
     char *cstr = (char *)bump(s.len + 1);
@@ -3,11 +3,42 @@
 #include "prelude.h"
 
 struct ArenaNode;
+
+struct ArenaMark {
+  ArenaNode *head;
+  u64 allocd;
+  u64 prev;
+};
+
 struct Arena {
   ArenaNode *head;
 
   void trash();
+  void reset();
   void *bump(u64 size);
   void *rebump(void *ptr, u64 old, u64 size);
   String bump_string(String s);
+  ArenaMark mark();
+  void pop(ArenaMark m);
+};
+
+// per thread arena for short lived allocations. the main thread resets
+// its arena at the end of each frame, job workers after each job.
+Arena *frame_arena();
+void frame_arena_reset();
+void frame_arena_trash();
+
+// rewinds the thread's frame arena when it goes out of scope. use this
+// for temporaries on threads that don't reset their arena on their own.
+struct ScratchArena {
+  Arena *arena;
+  ArenaMark m;
+
+  ScratchArena() : arena(frame_arena()), m(arena->mark()) {}
+  ~ScratchArena() { arena->pop(m); }
+  ScratchArena(ScratchArena &&) = delete;
+  ScratchArena &operator=(ScratchArena &&) = delete;
+
+  void *bump(u64 size) { return arena->bump(size); }
+  String bump_string(String s) { return arena->bump_string(s); }
 };
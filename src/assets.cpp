@@ -1,17 +1,46 @@
 #include "assets.h"
 #include "app.h"
+#include "deps/sokol_time.h"
+#include "jobs.h"
 #include "luax.h"
 #include "os.h"
 #include "profile.h"
+#include "strings.h"
 #include "sync.h"
+#include <new>
+
+#ifdef IS_LINUX
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 struct FileChange {
-  u64 key;
+  u64 handle;
   u64 modtime;
 };
 
+#define ASSET_PAGE_SIZE 256
+#define ASSET_MAX_PAGES 256
+
+struct AssetSlot {
+  std::atomic<Asset *> asset;
+  std::atomic<u32> generation;
+};
+
 struct Assets {
-  HashMap<Asset> table;
+  // pages never move once allocated, and writes swap in a new Asset
+  // instead of changing one in place, so the main thread can read slots
+  // without taking rw_lock. replaced versions are kept in retired until
+  // the end of the frame.
+  std::atomic<AssetSlot *> pages[ASSET_MAX_PAGES];
+  u32 slot_count;
+  HashMap<u64> handles; // key: asset hash, value: handle
+  Array<Asset *> retired;
+  std::atomic<bool> has_retired;
   RWLock rw_lock;
 
   Mutex shutdown_mtx;
@@ -23,27 +52,93 @@ struct Assets {
   Mutex changes_mtx;
   Array<FileChange> changes;
   Array<FileChange> tmp_changes;
+
+  Mutex loads_mtx;
+  HashMap<AssetLoadJob *> loading; // key: asset hash
+  Array<AssetLoadJob *> uploads;
+  AssetLoadStats load_stats;
 };
 
 static Assets g_assets = {};
 
-static void hot_reload_thread(void *) {
+static AssetSlot *asset_slot(u64 handle) {
+  if (handle == 0) {
+    return nullptr;
+  }
+
+  u32 index = (u32)handle - 1;
+  u32 page = index / ASSET_PAGE_SIZE;
+  if (page >= ASSET_MAX_PAGES) {
+    return nullptr;
+  }
+
+  AssetSlot *slots = g_assets.pages[page].load(std::memory_order_acquire);
+  if (slots == nullptr) {
+    return nullptr;
+  }
+
+  AssetSlot *slot = &slots[index % ASSET_PAGE_SIZE];
+  if (slot->generation.load(std::memory_order_acquire) != (u32)(handle >> 32)) {
+    return nullptr;
+  }
+
+  return slot;
+}
+
+static Asset *asset_version(u64 handle) {
+  AssetSlot *slot = asset_slot(handle);
+  if (slot == nullptr) {
+    return nullptr;
+  }
+
+  return slot->asset.load(std::memory_order_acquire);
+}
+
+static bool asset_find(u64 key, Asset *out) {
+  g_assets.rw_lock.shared_lock();
+  defer(g_assets.rw_lock.shared_unlock());
+
+  u64 *handle = g_assets.handles.get(key);
+  if (handle == nullptr) {
+    return false;
+  }
+
+  *out = *asset_version(*handle);
+  return true;
+}
+
+static bool hot_reload_should_stop(u32 wait_ms) {
+  LockGuard lock{&g_assets.shutdown_mtx};
+  if (g_assets.shutdown) {
+    return true;
+  }
+
+  if (wait_ms == 0) {
+    return false;
+  }
+
+  bool signaled =
+      g_assets.shutdown_notify.timed_wait(&g_assets.shutdown_mtx, wait_ms);
+  return signaled;
+}
+
+static void hot_reload_push_changes() {
+  if (g_assets.tmp_changes.len > 0) {
+    LockGuard lock{&g_assets.changes_mtx};
+    for (FileChange change : g_assets.tmp_changes) {
+      g_assets.changes.push(change);
+    }
+  }
+}
+
+static void hot_reload_poll() {
   u32 reload_interval = g_app->reload_interval.load();
 
   while (true) {
     PROFILE_BLOCK("hot reload");
 
-    {
-      LockGuard lock{&g_assets.shutdown_mtx};
-      if (g_assets.shutdown) {
-        return;
-      }
-
-      bool signaled = g_assets.shutdown_notify.timed_wait(
-          &g_assets.shutdown_mtx, reload_interval);
-      if (signaled) {
-        return;
-      }
+    if (hot_reload_should_stop(reload_interval)) {
+      return;
     }
 
     {
@@ -54,13 +149,14 @@ static void hot_reload_thread(void *) {
 
       g_assets.tmp_changes.len = 0;
 
-      for (auto [k, v] : g_assets.table) {
+      for (auto [k, v] : g_assets.handles) {
         PROFILE_BLOCK("read modtime");
 
-        u64 modtime = os_file_modtime(v->name.data);
-        if (modtime > v->modtime) {
+        Asset *asset = asset_version(*v);
+        u64 modtime = os_file_modtime(asset->name.data);
+        if (modtime > asset->modtime) {
           FileChange change = {};
-          change.key = v->hash;
+          change.handle = *v;
           change.modtime = modtime;
 
           g_assets.tmp_changes.push(change);
@@ -68,13 +164,202 @@ static void hot_reload_thread(void *) {
       }
     }
 
-    if (g_assets.tmp_changes.len > 0) {
-      LockGuard lock{&g_assets.changes_mtx};
-      for (FileChange change : g_assets.tmp_changes) {
-        g_assets.changes.push(change);
+    hot_reload_push_changes();
+  }
+}
+
+#ifdef IS_LINUX
+
+struct DirectoryWatcher {
+  i32 fd;
+  HashMap<String> dirs; // key: watch descriptor, value: "" or "path/"
+};
+
+// false if dir or one of its subdirectories couldn't be watched, for
+// example when fs.inotify.max_user_watches has been reached
+static bool watch_directory(DirectoryWatcher *w, String dir) {
+  const char *path = dir.len == 0 ? "." : dir.data;
+
+  i32 wd = inotify_add_watch(w->fd, path,
+                             IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+  if (wd < 0) {
+    fprintf(stderr, "hot reload: can't watch %s: %s\n", path,
+            strerror(errno));
+    mem_free(dir.data);
+    return false;
+  }
+
+  String *existing = w->dirs.get((u64)wd);
+  if (existing != nullptr) {
+    mem_free(existing->data);
+  }
+  w->dirs[(u64)wd] = dir;
+
+  DIR *d = opendir(path);
+  if (d == nullptr) {
+    return true;
+  }
+  defer(closedir(d));
+
+  for (dirent *e = readdir(d); e != nullptr; e = readdir(d)) {
+    // also skips '.', '..', and things like .git
+    if (e->d_name[0] == '.') {
+      continue;
+    }
+
+    String sub = str_fmt("%s%s/", dir.data, e->d_name);
+
+    bool is_dir = e->d_type == DT_DIR;
+    if (e->d_type == DT_UNKNOWN) {
+      struct stat st = {};
+      is_dir = stat(sub.data, &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    if (is_dir) {
+      if (!watch_directory(w, sub)) {
+        return false;
+      }
+    } else {
+      mem_free(sub.data);
+    }
+  }
+
+  return true;
+}
+
+static bool hot_reload_inotify() {
+  DirectoryWatcher w = {};
+  w.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (w.fd < 0) {
+    return false;
+  }
+  defer({
+    close(w.fd);
+    for (auto [k, v] : w.dirs) {
+      mem_free(v->data);
+    }
+    w.dirs.trash();
+  });
+
+  // files under a directory without a watch would never reload, so poll
+  // modtimes instead
+  if (!watch_directory(&w, to_cstr(""))) {
+    return false;
+  }
+
+  // editors often write a file several times in a row, so wait until a
+  // file has been quiet for reload_interval before reloading it
+  u32 quiet = g_app->reload_interval.load();
+
+  HashMap<u64> pending = {}; // key: asset hash, value: last event time
+  defer(pending.trash());
+
+  Array<u64> ready = {};
+  defer(ready.trash());
+
+  alignas(inotify_event) char buf[4096];
+
+  while (true) {
+    if (hot_reload_should_stop(0)) {
+      return true;
+    }
+
+    pollfd pfd = {};
+    pfd.fd = w.fd;
+    pfd.events = POLLIN;
+    i32 n = poll(&pfd, 1, quiet);
+
+    PROFILE_BLOCK("hot reload");
+
+    if (n > 0) {
+      while (true) {
+        ssize_t len = read(w.fd, buf, sizeof(buf));
+        if (len <= 0) {
+          break;
+        }
+
+        for (char *p = buf; p < buf + len;) {
+          inotify_event *e = (inotify_event *)p;
+          p += sizeof(inotify_event) + e->len;
+
+          String *dir = w.dirs.get((u64)e->wd);
+          if (dir == nullptr || e->len == 0) {
+            continue;
+          }
+
+          String path = str_fmt("%s%s", dir->data, e->name);
+          if (e->mask & IN_ISDIR) {
+            bool ok = true;
+            if (e->mask & IN_CREATE) {
+              ok = watch_directory(&w, str_fmt("%s/", path.data));
+            }
+            mem_free(path.data);
+            if (!ok) {
+              return false;
+            }
+            continue;
+          }
+
+          pending[fnv1a(path)] = stm_now();
+          mem_free(path.data);
+        }
+      }
+    }
+
+    if (pending.load == 0) {
+      continue;
+    }
+
+    u64 now = stm_now();
+    ready.len = 0;
+    g_assets.tmp_changes.len = 0;
+
+    {
+      g_assets.rw_lock.shared_lock();
+      defer(g_assets.rw_lock.shared_unlock());
+
+      for (auto [k, v] : pending) {
+        if (stm_ms(now - *v) < quiet) {
+          continue;
+        }
+        ready.push(k);
+
+        // most events are for files that aren't assets
+        u64 *handle = g_assets.handles.get(k);
+        if (handle == nullptr) {
+          continue;
+        }
+
+        Asset *asset = asset_version(*handle);
+
+        FileChange change = {};
+        change.handle = *handle;
+        change.modtime = os_file_modtime(asset->name.data);
+        if (change.modtime != 0) {
+          g_assets.tmp_changes.push(change);
+        }
       }
     }
+
+    for (u64 key : ready) {
+      pending.unset(key);
+    }
+
+    hot_reload_push_changes();
+  }
+}
+
+#endif // IS_LINUX
+
+static void hot_reload_thread(void *) {
+#ifdef IS_LINUX
+  // polls if inotify is missing or can't watch every directory
+  if (hot_reload_inotify()) {
+    return;
   }
+#endif
+
+  hot_reload_poll();
 }
 
 void assets_perform_hot_reload_changes() {
@@ -88,7 +373,7 @@ void assets_perform_hot_reload_changes() {
 
   for (FileChange change : g_assets.changes) {
     Asset a = {};
-    bool exists = asset_read(change.key, &a);
+    bool exists = asset_read(change.handle, &a);
     assert(exists);
 
     a.modtime = change.modtime;
@@ -113,8 +398,13 @@ void assets_perform_hot_reload_changes() {
       break;
     }
     case AssetKind_Tilemap: {
-      a.tilemap.trash();
-      ok = a.tilemap.load(a.name);
+      Tilemap prev = a.tilemap;
+      a.tilemap = {};
+      ok = a.tilemap.load(a.name, prev.stream != nullptr);
+      if (ok) {
+        a.tilemap.keep_stream_state(&prev);
+      }
+      prev.trash();
       break;
     }
     default: continue; break;
@@ -132,7 +422,177 @@ void assets_perform_hot_reload_changes() {
   g_assets.changes.len = 0;
 }
 
+static void asset_decode_job(void *udata) {
+  AssetLoadJob *job = (AssetLoadJob *)udata;
+  Asset *a = &job->asset;
+
+  u64 start = stm_now();
+  a->modtime = os_file_modtime(a->name.data);
+
+  bool ok = false;
+  switch (a->kind) {
+  case AssetKind_Image:
+    ok = job->pixels.load(a->name, job->generate_mips);
+    break;
+  case AssetKind_Sprite: ok = a->sprite.decode(a->name, &job->pixels); break;
+  case AssetKind_Tilemap:
+    ok = a->tilemap.decode(a->name, job->stream_levels,
+                           &job->tileset_pixels);
+    break;
+  default: break;
+  }
+
+  job->decode_ticks = stm_since(start);
+  job->state.store(ok ? AssetLoadState_Uploading : AssetLoadState_Failed);
+
+  LockGuard lock{&g_assets.loads_mtx};
+  g_assets.uploads.push(job);
+  g_assets.load_stats.decoding--;
+  g_assets.load_stats.uploading++;
+}
+
+static void asset_load_job_finish(AssetLoadJob *job, bool upload) {
+  Asset *a = &job->asset;
+
+  bool ok = job->state.load() == AssetLoadState_Uploading;
+  if (ok && upload) {
+    Asset existing = {};
+    if (asset_find(a->hash, &existing)) {
+      // loaded synchronously while this job was decoding
+      switch (a->kind) {
+      case AssetKind_Sprite: a->sprite.trash(); break;
+      case AssetKind_Tilemap: a->tilemap.trash(); break;
+      default: break;
+      }
+      mem_free(a->name.data);
+      *a = existing;
+    } else {
+      switch (a->kind) {
+      case AssetKind_Image: a->image.upload(&job->pixels); break;
+      case AssetKind_Sprite: a->sprite.upload(&job->pixels); break;
+      case AssetKind_Tilemap: a->tilemap.upload(&job->tileset_pixels); break;
+      default: break;
+      }
+      a->handle = asset_write(*a);
+    }
+  } else {
+    if (ok) {
+      switch (a->kind) {
+      case AssetKind_Sprite: a->sprite.trash(); break;
+      case AssetKind_Tilemap: a->tilemap.trash(); break;
+      default: break;
+      }
+    }
+    mem_free(a->name.data);
+    ok = false;
+  }
+
+  job->pixels.trash();
+  for (auto [k, v] : job->tileset_pixels) {
+    v->trash();
+  }
+  job->tileset_pixels.trash();
+
+  job->state.store(ok ? AssetLoadState_Done : AssetLoadState_Failed);
+  asset_load_release(job);
+}
+
+void assets_perform_async_uploads() {
+  Array<AssetLoadJob *> uploads = {};
+  {
+    LockGuard lock{&g_assets.loads_mtx};
+    if (g_assets.uploads.len == 0) {
+      return;
+    }
+
+    uploads = g_assets.uploads;
+    g_assets.uploads = {};
+  }
+  defer(uploads.trash());
+
+  PROFILE_BLOCK("async uploads");
+
+  for (AssetLoadJob *job : uploads) {
+    {
+      LockGuard lock{&g_assets.loads_mtx};
+      g_assets.loading.unset(job->asset.hash);
+      g_assets.load_stats.uploading--;
+      if (job->state.load() == AssetLoadState_Uploading) {
+        g_assets.load_stats.loaded++;
+      } else {
+        g_assets.load_stats.failed++;
+      }
+      g_assets.load_stats.decode_ticks += job->decode_ticks;
+      g_assets.load_stats.last_decode_ticks = job->decode_ticks;
+    }
+
+    asset_load_job_finish(job, true);
+  }
+}
+
+AssetLoadJob *asset_load_async(AssetLoadData desc, String filepath) {
+  PROFILE_FUNC();
+
+  u64 key = fnv1a(filepath);
+
+  AssetLoadJob *job = (AssetLoadJob *)mem_alloc(sizeof(AssetLoadJob));
+  memset(job, 0, sizeof(AssetLoadJob));
+  new (&job->refs) std::atomic<i32>();
+  new (&job->state) std::atomic<i32>();
+
+  {
+    Asset asset = {};
+    if (asset_find(key, &asset)) {
+      job->refs.store(1);
+      job->state.store(AssetLoadState_Done);
+      job->asset = asset;
+      return job;
+    }
+  }
+
+  LockGuard lock{&g_assets.loads_mtx};
+
+  AssetLoadJob **pending = g_assets.loading.get(key);
+  if (pending != nullptr) {
+    mem_free(job);
+    (*pending)->refs++;
+    return *pending;
+  }
+
+  // one reference for the caller, one until the main thread finishes it
+  job->refs.store(2);
+  job->state.store(AssetLoadState_Decoding);
+  job->generate_mips = desc.generate_mips;
+  job->stream_levels = desc.stream_levels;
+  job->asset.name = to_cstr(filepath);
+  job->asset.hash = key;
+  job->asset.kind = desc.kind;
+
+  g_assets.loading[key] = job;
+  g_assets.load_stats.decoding++;
+
+  jobs_push(asset_decode_job, job);
+  return job;
+}
+
+void asset_load_release(AssetLoadJob *job) {
+  if (job->refs.fetch_sub(1) == 1) {
+    mem_free(job);
+  }
+}
+
+AssetLoadStats asset_load_stats() {
+  LockGuard lock{&g_assets.loads_mtx};
+  return g_assets.load_stats;
+}
+
 void assets_shutdown() {
+  for (AssetLoadJob *job : g_assets.uploads) {
+    asset_load_job_finish(job, false);
+  }
+  g_assets.uploads.trash();
+  g_assets.loading.trash();
+
   if (g_app->hot_reload_enabled.load()) {
     {
       LockGuard lock{&g_assets.shutdown_mtx};
@@ -145,7 +605,13 @@ void assets_shutdown() {
     g_assets.tmp_changes.trash();
   }
 
-  for (auto [k, v] : g_assets.table) {
+  for (u32 i = 0; i < g_assets.slot_count; i++) {
+    AssetSlot *slots = g_assets.pages[i / ASSET_PAGE_SIZE].load();
+    Asset *v = slots[i % ASSET_PAGE_SIZE].asset.load();
+    if (v == nullptr) {
+      continue;
+    }
+
     mem_free(v->name.data);
 
     switch (v->kind) {
@@ -154,10 +620,23 @@ void assets_shutdown() {
     case AssetKind_Tilemap: v->tilemap.trash(); break;
     default: break;
     }
+
+    mem_free(v);
   }
-  g_assets.table.trash();
+
+  for (u32 i = 0; i < ASSET_MAX_PAGES; i++) {
+    AssetSlot *slots = g_assets.pages[i].exchange(nullptr);
+    if (slots != nullptr) {
+      mem_free(slots);
+    }
+  }
+
+  assets_collect_garbage();
+  g_assets.retired.trash();
+  g_assets.handles.trash();
 
   g_assets.shutdown_notify.trash();
+  g_assets.loads_mtx.trash();
   g_assets.changes_mtx.trash();
   g_assets.shutdown_mtx.trash();
   g_assets.rw_lock.trash();
@@ -165,6 +644,7 @@ void assets_shutdown() {
 
 void assets_start_hot_reload() {
   g_assets.shutdown_notify.make();
+  g_assets.loads_mtx.make();
   g_assets.changes_mtx.make();
   g_assets.shutdown_mtx.make();
   g_assets.rw_lock.make();
@@ -188,7 +668,7 @@ bool asset_load(AssetLoadData desc, String filepath, Asset *out) {
 
   {
     Asset asset = {};
-    if (asset_read(key, &asset)) {
+    if (asset_find(key, &asset)) {
       if (out != nullptr) {
         *out = asset;
       }
@@ -212,7 +692,7 @@ bool asset_load(AssetLoadData desc, String filepath, Asset *out) {
     switch (desc.kind) {
     case AssetKind_LuaRef: {
       asset.lua_ref = LUA_REFNIL;
-      asset_write(asset);
+      asset.handle = asset_write(asset);
       asset.lua_ref = luax_require_script(g_app->L, filepath);
       ok = true;
       break;
@@ -221,7 +701,9 @@ bool asset_load(AssetLoadData desc, String filepath, Asset *out) {
       ok = asset.image.load(filepath, desc.generate_mips);
       break;
     case AssetKind_Sprite: ok = asset.sprite.load(filepath); break;
-    case AssetKind_Tilemap: ok = asset.tilemap.load(filepath); break;
+    case AssetKind_Tilemap:
+      ok = asset.tilemap.load(filepath, desc.stream_levels);
+      break;
     default: break;
     }
 
@@ -230,7 +712,7 @@ bool asset_load(AssetLoadData desc, String filepath, Asset *out) {
       return false;
     }
 
-    asset_write(asset);
+    asset.handle = asset_write(asset);
 
     if (out != nullptr) {
       *out = asset;
@@ -239,11 +721,26 @@ bool asset_load(AssetLoadData desc, String filepath, Asset *out) {
   }
 }
 
-bool asset_read(u64 key, Asset *out) {
+Asset *asset_get(u64 handle) {
+  if (this_thread_id() == g_app->main_thread_id.load()) {
+    return asset_version(handle);
+  }
+
   g_assets.rw_lock.shared_lock();
   defer(g_assets.rw_lock.shared_unlock());
 
-  const Asset *asset = g_assets.table.get(key);
+  Asset *asset = asset_version(handle);
+  if (asset == nullptr) {
+    return nullptr;
+  }
+
+  static thread_local Asset t_copy = {};
+  t_copy = *asset;
+  return &t_copy;
+}
+
+bool asset_read(u64 handle, Asset *out) {
+  Asset *asset = asset_get(handle);
   if (asset == nullptr) {
     return false;
   }
@@ -252,30 +749,82 @@ bool asset_read(u64 key, Asset *out) {
   return true;
 }
 
-void asset_write(Asset asset) {
+u64 asset_write(Asset asset) {
+  Asset *version = (Asset *)mem_alloc(sizeof(Asset));
+
   g_assets.rw_lock.unique_lock();
   defer(g_assets.rw_lock.unique_unlock());
 
-  g_assets.table[asset.hash] = asset;
-}
+  AssetSlot *slot = asset_slot(asset.handle);
+  if (slot == nullptr) {
+    u64 *existing = g_assets.handles.get(asset.hash);
+    if (existing != nullptr) {
+      asset.handle = *existing;
+      slot = asset_slot(asset.handle);
+    }
+  }
 
-Asset check_asset(lua_State *L, u64 key) {
-  Asset asset = {};
-  if (!asset_read(key, &asset)) {
-    luaL_error(L, "cannot read asset");
+  if (slot == nullptr) {
+    u32 index = g_assets.slot_count;
+    u32 page = index / ASSET_PAGE_SIZE;
+    if (page >= ASSET_MAX_PAGES) {
+      mem_free(version);
+      fatal_error("too many assets");
+      return 0;
+    }
+
+    AssetSlot *slots = g_assets.pages[page].load();
+    if (slots == nullptr) {
+      slots = (AssetSlot *)mem_alloc(sizeof(AssetSlot) * ASSET_PAGE_SIZE);
+      memset(slots, 0, sizeof(AssetSlot) * ASSET_PAGE_SIZE);
+      g_assets.pages[page].store(slots, std::memory_order_release);
+    }
+    g_assets.slot_count++;
+
+    slot = &slots[index % ASSET_PAGE_SIZE];
+    u32 generation = slot->generation.load() + 1;
+    asset.handle = ((u64)generation << 32) | (index + 1);
+
+    memcpy(version, &asset, sizeof(Asset));
+    slot->asset.store(version, std::memory_order_release);
+    slot->generation.store(generation, std::memory_order_release);
+
+    g_assets.handles[asset.hash] = asset.handle;
+    return asset.handle;
   }
 
-  return asset;
+  memcpy(version, &asset, sizeof(Asset));
+  Asset *old = slot->asset.exchange(version, std::memory_order_acq_rel);
+  g_assets.retired.push(old);
+  g_assets.has_retired.store(true);
+  return asset.handle;
 }
 
-Asset check_asset_mt(lua_State *L, i32 arg, const char *mt) {
-  u64 *udata = (u64 *)luaL_checkudata(L, arg, mt);
+void assets_collect_garbage() {
+  if (!g_assets.has_retired.load()) {
+    return;
+  }
 
-  Asset asset = {};
-  bool ok = asset_read(*udata, &asset);
-  if (!ok) {
+  g_assets.rw_lock.unique_lock();
+  defer(g_assets.rw_lock.unique_unlock());
+
+  for (Asset *asset : g_assets.retired) {
+    mem_free(asset);
+  }
+  g_assets.retired.len = 0;
+  g_assets.has_retired.store(false);
+}
+
+Asset *check_asset(lua_State *L, u64 handle) {
+  Asset *asset = asset_get(handle);
+  if (asset == nullptr) {
     luaL_error(L, "cannot read asset");
   }
 
   return asset;
 }
+
+Asset *check_asset_mt(lua_State *L, i32 arg, const char *mt) {
+  u64 *udata = (u64 *)luaL_checkudata(L, arg, mt);
+  return check_asset(L, *udata);
+}
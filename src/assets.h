@@ -1,6 +1,7 @@
 #pragma once
 
 #include "image.h"
+#include <atomic>
 #include "sprite.h"
 #include "tilemap.h"
 
@@ -15,11 +16,13 @@ enum AssetKind : i32 {
 struct AssetLoadData {
   AssetKind kind;
   bool generate_mips;
+  bool stream_levels;
 };
 
 struct Asset {
   String name;
   u64 hash;
+  u64 handle; // generation << 32 | slot index + 1
   u64 modtime;
   AssetKind kind;
   union {
@@ -30,16 +33,54 @@ struct Asset {
   };
 };
 
+enum AssetLoadState : i32 {
+  AssetLoadState_Decoding,
+  AssetLoadState_Uploading,
+  AssetLoadState_Done,
+  AssetLoadState_Failed,
+};
+
+struct AssetLoadJob {
+  std::atomic<i32> refs;
+  std::atomic<i32> state;
+  bool generate_mips;
+  bool stream_levels;
+  Asset asset;
+
+  // decoded on a worker, uploaded on the main thread
+  ImagePixels pixels;
+  HashMap<ImagePixels> tileset_pixels;
+  u64 decode_ticks;
+};
+
+struct AssetLoadStats {
+  u64 decoding;
+  u64 uploading;
+  u64 loaded;
+  u64 failed;
+  u64 decode_ticks;
+  u64 last_decode_ticks;
+};
+
 void assets_shutdown();
 void assets_start_hot_reload();
 void assets_perform_hot_reload_changes();
+void assets_perform_async_uploads();
 
 bool asset_load_kind(AssetKind kind, String filepath, Asset *out);
 bool asset_load(AssetLoadData desc, String filepath, Asset *out);
 
-bool asset_read(u64 key, Asset *out);
-void asset_write(Asset asset);
+AssetLoadJob *asset_load_async(AssetLoadData desc, String filepath);
+void asset_load_release(AssetLoadJob *job);
+AssetLoadStats asset_load_stats();
+
+// lock-free on the main thread, where the pointer stays valid until
+// assets_collect_garbage. other threads get a thread local copy.
+Asset *asset_get(u64 handle);
+bool asset_read(u64 handle, Asset *out);
+u64 asset_write(Asset asset);
+void assets_collect_garbage();
 
 struct lua_State;
-Asset check_asset(lua_State *L, u64 key);
-Asset check_asset_mt(lua_State *L, i32 arg, const char *mt);
+Asset *check_asset(lua_State *L, u64 handle);
+Asset *check_asset_mt(lua_State *L, i32 arg, const char *mt);
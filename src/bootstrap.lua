@@ -649,6 +649,14 @@ function sleep(secs)
   return spry.dt()
 end
 
+function await(handle)
+  while not handle:done() do
+    coroutine.yield()
+  end
+
+  return handle:result()
+end
+
 unsafe_require = require
 
 function require(name)
@@ -1,12 +1,17 @@
 #include "concurrency.h"
 #include "api.h"
+#include "arena.h"
 #include "deps/luaalloc.h"
+#include "deps/sokol_time.h"
 #include "hash_map.h"
 #include "http.h"
+#include "json.h"
 #include "luax.h"
+#include "os.h"
 #include "prelude.h"
 #include "profile.h"
 #include "sync.h"
+#include <math.h>
 #include <new>
 
 extern "C" {
@@ -16,9 +21,13 @@ extern "C" {
 }
 
 static void lua_thread_proc(void *udata) {
+  defer(profile_thread_trash()); // after PROFILE_FUNC records its event
   PROFILE_FUNC();
 
   LuaThread *lt = (LuaThread *)udata;
+  defer(frame_arena_trash());
+  defer(json_writer_trash());
+  defer(lua_channels_select_trash());
 
   LuaAlloc *LA = luaalloc_create(nullptr, nullptr);
   defer(luaalloc_delete(LA));
@@ -99,63 +108,102 @@ void LuaThread::join() {
 
 //
 
-void LuaVariant::make(lua_State *L, i32 arg) {
-  type = lua_type(L, arg);
-
-  switch (type) {
-  case LUA_TBOOLEAN: boolean = lua_toboolean(L, arg); break;
-  case LUA_TNUMBER: number = luaL_checknumber(L, arg); break;
+// deeper tables aren't copied, so make doesn't run out of C stack
+#define LUA_VARIANT_MAX_DEPTH 1000
+
+static bool lua_variant_make(LuaVariant *v, lua_State *L, i32 arg,
+                             Array<const void *> *tables) {
+  arg = lua_absindex(L, arg);
+  v->type = lua_type(L, arg);
+
+  switch (v->type) {
+  case LUA_TBOOLEAN: v->boolean = lua_toboolean(L, arg); break;
+  case LUA_TNUMBER: {
+    v->is_integer = lua_isinteger(L, arg);
+    if (v->is_integer) {
+      v->integer = lua_tointeger(L, arg);
+    } else {
+      v->number = lua_tonumber(L, arg);
+    }
+    break;
+  }
   case LUA_TSTRING: {
     String s = luax_check_string(L, arg);
-    string = to_cstr(s);
+    v->string = to_cstr(s);
     break;
   }
   case LUA_TTABLE: {
+    const void *ptr = lua_topointer(L, arg);
+    for (const void *t : *tables) {
+      if (t == ptr) {
+        v->type = LUA_TNIL;
+        return false;
+      }
+    }
+
+    if (tables->len == LUA_VARIANT_MAX_DEPTH || !lua_checkstack(L, 3)) {
+      v->type = LUA_TNIL;
+      return false;
+    }
+
+    tables->push(ptr);
+
     Array<LuaTableEntry> entries = {};
-    entries.resize(luax_len(L, arg));
+    entries.reserve(lua_rawlen(L, arg));
 
-    lua_pushvalue(L, arg);
-    for (lua_pushnil(L); lua_next(L, -2); lua_pop(L, 1)) {
+    bool ok = true;
+    for (lua_pushnil(L); lua_next(L, arg); lua_pop(L, 1)) {
       LuaVariant key = {};
-      key.make(L, -2);
-
       LuaVariant value = {};
-      value.make(L, -1);
+      ok = lua_variant_make(&key, L, -2, tables) &&
+           lua_variant_make(&value, L, -1, tables);
 
       entries.push({key, value});
+      if (!ok) {
+        lua_pop(L, 2);
+        break;
+      }
     }
-    lua_pop(L, 1);
 
-    table = Slice(entries);
-    break;
+    tables->len--;
+    v->table = Slice(entries);
+    return ok;
   }
   case LUA_TUSERDATA: {
     i32 kind = lua_getiuservalue(L, arg, LUAX_UD_TNAME);
     defer(lua_pop(L, 1));
     if (kind != LUA_TSTRING) {
-      return;
+      return true;
     }
 
     kind = lua_getiuservalue(L, arg, LUAX_UD_PTR_SIZE);
     defer(lua_pop(L, 1));
     if (kind != LUA_TNUMBER) {
-      return;
+      return true;
     }
 
     String tname = luax_check_string(L, -2);
     u64 size = luaL_checkinteger(L, -1);
 
     if (size != sizeof(void *)) {
-      return;
+      return true;
     }
 
-    udata.ptr = *(void **)lua_touserdata(L, arg);
-    udata.tname = to_cstr(tname);
+    v->udata.ptr = *(void **)lua_touserdata(L, arg);
+    v->udata.tname = to_cstr(tname);
 
     break;
   }
   default: break;
   }
+
+  return true;
+}
+
+bool LuaVariant::make(lua_State *L, i32 arg) {
+  Array<const void *> tables = {};
+  defer(tables.trash());
+  return lua_variant_make(this, L, arg, &tables);
 }
 
 void LuaVariant::trash() {
@@ -170,9 +218,11 @@ void LuaVariant::trash() {
       e.value.trash();
     }
     mem_free(table.data);
+    break;
   }
   case LUA_TUSERDATA: {
     mem_free(udata.tname.data);
+    break;
   }
   default: break;
   }
@@ -181,14 +231,25 @@ void LuaVariant::trash() {
 void LuaVariant::push(lua_State *L) {
   switch (type) {
   case LUA_TBOOLEAN: lua_pushboolean(L, boolean); break;
-  case LUA_TNUMBER: lua_pushnumber(L, number); break;
+  case LUA_TNUMBER: {
+    if (is_integer) {
+      lua_pushinteger(L, integer);
+    } else {
+      lua_pushnumber(L, number);
+    }
+    break;
+  }
   case LUA_TSTRING: lua_pushlstring(L, string.data, string.len); break;
   case LUA_TTABLE: {
     lua_newtable(L);
     for (LuaTableEntry e : table) {
       e.key.push(L);
       e.value.push(L);
-      lua_rawset(L, -3);
+      if (lua_isnil(L, -2) || lua_isnil(L, -1)) {
+        lua_pop(L, 2); // not copied, see lua_variant_make
+      } else {
+        lua_rawset(L, -3);
+      }
     }
     break;
   }
@@ -196,7 +257,7 @@ void LuaVariant::push(lua_State *L) {
     luax_ptr_userdata(L, udata.ptr, udata.tname.data);
     break;
   }
-  default: break;
+  default: lua_pushnil(L); break;
   }
 }
 
@@ -204,7 +265,6 @@ void LuaVariant::push(lua_State *L) {
 
 struct LuaChannels {
   Mutex mtx;
-  Cond select;
   HashMap<LuaChannel *> by_name;
 };
 
@@ -212,84 +272,282 @@ static LuaChannels g_channels = {};
 
 void LuaChannel::make(String n, u64 buf) {
   mtx.make();
-  sent.make();
-  received.make();
-  items.data = (LuaVariant *)mem_alloc(sizeof(LuaVariant) * (buf + 1));
-  items.len = (buf + 1);
-  front = 0;
-  back = 0;
-  len = 0;
+  not_empty.make();
+  not_full.make();
+  new (&head) std::atomic<u64>(0);
+  new (&tail) std::atomic<u64>(0);
+  new (&waiting_recv) std::atomic<i32>(0);
+  new (&waiting_send) std::atomic<i32>(0);
+
+  // an unbuffered channel holds one item while the sender waits
+  unbuffered = buf == 0;
+  u64 len = unbuffered ? 1 : buf;
+
+  slots.data = (LuaChannelSlot *)mem_alloc(sizeof(LuaChannelSlot) * len);
+  slots.len = len;
+  for (u64 i = 0; i < len; i++) {
+    new (&slots[i].stamp) std::atomic<u64>(i);
+  }
+
+  one_lap = 1;
+  while (one_lap <= len) {
+    one_lap *= 2;
+  }
 
   name.store(to_cstr(n).data);
 }
 
-void LuaChannel::trash() {
-  for (i32 i = 0; i < len; i++) {
-    items[front].trash();
-    front = (front + 1) % items.len;
+// a slot's stamp is the position it can be written at, or the position
+// plus one once it has an item to read. positions wrap to the next lap at
+// the end of the ring, so a full ring and an empty one look different
+static bool lua_channel_push(LuaChannel *ch, LuaVariant item, u64 *pos) {
+  u64 tail = ch->tail.load(std::memory_order_relaxed);
+  while (true) {
+    u64 index = tail & (ch->one_lap - 1);
+    u64 lap = tail & ~(ch->one_lap - 1);
+    LuaChannelSlot *slot = &ch->slots[index];
+    u64 stamp = slot->stamp.load(std::memory_order_acquire);
+
+    if (tail == stamp) {
+      u64 next = index + 1 < ch->slots.len ? tail + 1 : lap + ch->one_lap;
+      if (ch->tail.compare_exchange_weak(tail, next)) {
+        slot->item = item;
+        slot->stamp.store(tail + 1, std::memory_order_release);
+        *pos = tail;
+        return true;
+      }
+    } else if (stamp + ch->one_lap == tail + 1) {
+      // the slot still has last lap's item. full if head hasn't moved
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      u64 head = ch->head.load(std::memory_order_relaxed);
+      if (head + ch->one_lap == tail) {
+        return false;
+      }
+      tail = ch->tail.load(std::memory_order_relaxed);
+    } else {
+      tail = ch->tail.load(std::memory_order_relaxed);
+    }
   }
+}
 
-  mem_free(items.data);
-  mem_free(name.exchange(nullptr));
-  mtx.trash();
-  sent.trash();
-  received.trash();
+static bool lua_channel_pop(LuaChannel *ch, LuaVariant *out) {
+  u64 head = ch->head.load(std::memory_order_relaxed);
+  while (true) {
+    u64 index = head & (ch->one_lap - 1);
+    u64 lap = head & ~(ch->one_lap - 1);
+    LuaChannelSlot *slot = &ch->slots[index];
+    u64 stamp = slot->stamp.load(std::memory_order_acquire);
+
+    if (head + 1 == stamp) {
+      u64 next = index + 1 < ch->slots.len ? head + 1 : lap + ch->one_lap;
+      if (ch->head.compare_exchange_weak(head, next)) {
+        *out = slot->item;
+        slot->stamp.store(head + ch->one_lap, std::memory_order_release);
+        return true;
+      }
+    } else if (stamp == head) {
+      // nothing written here yet. empty if tail hasn't moved
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      u64 tail = ch->tail.load(std::memory_order_relaxed);
+      if (tail == head) {
+        return false;
+      }
+      head = ch->head.load(std::memory_order_relaxed);
+    } else {
+      head = ch->head.load(std::memory_order_relaxed);
+    }
+  }
 }
 
-void LuaChannel::send(LuaVariant item) {
-  LockGuard lock{&mtx};
+// sleepers bump the waiting count, then check the ring again while holding
+// the lock. wakers change the ring, then check the count. the fences make
+// sure at least one side sees the other
+static void lua_channel_wake_receivers(LuaChannel *ch, bool all) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (ch->waiting_recv.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+
+  LockGuard lock{&ch->mtx};
+  if (all) {
+    ch->not_empty.broadcast();
+  } else {
+    ch->not_empty.signal();
+  }
+
+  // only threads selecting on this channel
+  for (LuaChannelSelect *sel : ch->selects) {
+    LockGuard lock{&sel->mtx};
+    sel->ready = true;
+    sel->cv.signal();
+  }
+}
 
-  while (len == items.len) {
-    received.wait(&mtx);
+static void lua_channel_wake_senders(LuaChannel *ch) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (ch->waiting_send.load(std::memory_order_relaxed) == 0) {
+    return;
   }
 
-  items[back] = item;
-  back = (back + 1) % items.len;
-  len++;
+  // full senders and unbuffered senders share the condition
+  LockGuard lock{&ch->mtx};
+  ch->not_full.broadcast();
+}
+
+// times a thread gives up its time slice before going to sleep, since the
+// other side is often about to make room
+#define LUA_CHANNEL_SPINS 8
 
-  g_channels.select.broadcast();
-  sent.signal();
-  sent_total++;
+// longest single sleep in lua_channels_select, about 11 days
+#define LUA_SELECT_MAX_WAIT_MS 1000000000u
 
-  while (sent_total >= received_total + items.len) {
-    received.wait(&mtx);
+static u64 lua_channel_push_wait(LuaChannel *ch, LuaVariant item) {
+  u64 pos = 0;
+  if (lua_channel_push(ch, item, &pos)) {
+    return pos;
   }
+
+  // items from send_many might not have woken anyone yet
+  lua_channel_wake_receivers(ch, true);
+
+  for (i32 i = 0; i < LUA_CHANNEL_SPINS; i++) {
+    os_yield();
+    if (lua_channel_push(ch, item, &pos)) {
+      return pos;
+    }
+  }
+
+  ch->waiting_send.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  {
+    LockGuard lock{&ch->mtx};
+    while (!lua_channel_push(ch, item, &pos)) {
+      ch->not_full.wait(&ch->mtx);
+    }
+  }
+  ch->waiting_send.fetch_sub(1);
+
+  return pos;
 }
 
-static LuaVariant lua_channel_dequeue(LuaChannel *ch) {
-  LuaVariant item = ch->items[ch->front];
-  ch->front = (ch->front + 1) % ch->items.len;
-  ch->len--;
+static LuaVariant lua_channel_pop_wait(LuaChannel *ch) {
+  LuaVariant item = {};
+  if (lua_channel_pop(ch, &item)) {
+    return item;
+  }
 
-  ch->received.broadcast();
-  ch->received_total++;
+  for (i32 i = 0; i < LUA_CHANNEL_SPINS; i++) {
+    os_yield();
+    if (lua_channel_pop(ch, &item)) {
+      return item;
+    }
+  }
+
+  ch->waiting_recv.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  {
+    LockGuard lock{&ch->mtx};
+    while (!lua_channel_pop(ch, &item)) {
+      ch->not_empty.wait(&ch->mtx);
+    }
+  }
+  ch->waiting_recv.fetch_sub(1);
 
   return item;
 }
 
-LuaVariant LuaChannel::recv() {
-  LockGuard lock{&mtx};
+static void lua_channel_wait_received(LuaChannel *ch, u64 pos) {
+  LuaChannelSlot *slot = &ch->slots[pos & (ch->one_lap - 1)];
+  for (i32 i = 0; i <= LUA_CHANNEL_SPINS; i++) {
+    if (slot->stamp.load(std::memory_order_acquire) != pos + 1) {
+      return;
+    }
+    os_yield();
+  }
 
-  while (len == 0) {
-    sent.wait(&mtx);
+  ch->waiting_send.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  {
+    LockGuard lock{&ch->mtx};
+    while (slot->stamp.load(std::memory_order_acquire) == pos + 1) {
+      ch->not_full.wait(&ch->mtx);
+    }
   }
+  ch->waiting_send.fetch_sub(1);
+}
 
-  return lua_channel_dequeue(this);
+void LuaChannel::trash() {
+  LuaVariant item = {};
+  while (lua_channel_pop(this, &item)) {
+    item.trash();
+  }
+
+  mem_free(slots.data);
+  selects.trash();
+  mem_free(name.exchange(nullptr));
+  mtx.trash();
+  not_empty.trash();
+  not_full.trash();
 }
 
-bool LuaChannel::try_recv(LuaVariant *v) {
-  LockGuard lock{&mtx};
+void LuaChannel::send(LuaVariant item) {
+  u64 pos = lua_channel_push_wait(this, item);
+  lua_channel_wake_receivers(this, false);
 
-  if (len == 0) {
+  if (unbuffered) {
+    lua_channel_wait_received(this, pos);
+  }
+}
+
+void LuaChannel::send_many(Slice<LuaVariant> items) {
+  if (items.len == 0) {
+    return;
+  }
+
+  u64 pos = 0;
+  for (LuaVariant item : items) {
+    pos = lua_channel_push_wait(this, item);
+  }
+  lua_channel_wake_receivers(this, items.len > 1);
+
+  if (unbuffered) {
+    lua_channel_wait_received(this, pos);
+  }
+}
+
+LuaVariant LuaChannel::recv() {
+  LuaVariant item = lua_channel_pop_wait(this);
+  lua_channel_wake_senders(this);
+  return item;
+}
+
+bool LuaChannel::try_recv(LuaVariant *v) {
+  if (!lua_channel_pop(this, v)) {
     return false;
   }
 
-  *v = lua_channel_dequeue(this);
+  lua_channel_wake_senders(this);
   return true;
 }
 
+void LuaChannel::recv_many(u64 n, Array<LuaVariant> *out) {
+  if (n == 0) {
+    return;
+  }
+
+  out->push(lua_channel_pop_wait(this));
+
+  LuaVariant item = {};
+  while (out->len < n && lua_channel_pop(this, &item)) {
+    out->push(item);
+  }
+
+  lua_channel_wake_senders(this);
+}
+
 LuaChannel *lua_channel_make(String name, u64 buf) {
   LuaChannel *chan = (LuaChannel *)mem_alloc(sizeof(LuaChannel));
+  memset(chan, 0, sizeof(LuaChannel));
   new (&chan->name) std::atomic<char *>();
   chan->make(name, buf);
 
@@ -310,39 +568,122 @@ LuaChannel *lua_channel_get(String name) {
   return *chan;
 }
 
-LuaChannel *lua_channels_select(lua_State *L, LuaVariant *v) {
-  i32 len = lua_gettop(L);
-  if (len == 0) {
+// made the first time a thread has to wait in select
+static thread_local LuaChannelSelect t_channel_select;
+static thread_local bool t_channel_select_made;
+static thread_local u64 t_channel_select_start;
+
+static LuaChannel *lua_channels_try_select(Slice<LuaChannel *> chans,
+                                           u64 start, LuaVariant *v) {
+  for (u64 i = 0; i < chans.len; i++) {
+    LuaChannel *ch = chans[(start + i) % chans.len];
+    if (ch->try_recv(v)) {
+      return ch;
+    }
+  }
+
+  return nullptr;
+}
+
+LuaChannel *lua_channels_select(Slice<LuaChannel *> chans, LuaVariant *v,
+                                double timeout) {
+  PROFILE_FUNC();
+
+  if (chans.len == 0) {
     return nullptr;
   }
 
-  LuaChannel *buf[16] = {};
-  for (i32 i = 0; i < len; i++) {
-    buf[i] = *(LuaChannel **)luaL_checkudata(L, i + 1, "mt_channel");
+  // start somewhere else each time, so the first channel can't starve the
+  // others
+  u64 start = t_channel_select_start++;
+
+  LuaChannel *found = lua_channels_try_select(chans, start, v);
+  if (found != nullptr || timeout == 0) {
+    return found;
   }
 
-  Mutex mtx = {};
-  mtx.make();
-  LockGuard lock{&mtx};
+  for (i32 i = 0; i < LUA_CHANNEL_SPINS; i++) {
+    os_yield();
+    found = lua_channels_try_select(chans, start, v);
+    if (found != nullptr) {
+      return found;
+    }
+  }
 
+  LuaChannelSelect *sel = &t_channel_select;
+  if (!t_channel_select_made) {
+    sel->mtx.make();
+    sel->cv.make();
+    t_channel_select_made = true;
+  }
+
+  // counted as a receiver, so sends on these channels wake this thread
+  for (LuaChannel *ch : chans) {
+    LockGuard lock{&ch->mtx};
+    ch->selects.push(sel);
+    ch->waiting_recv.fetch_add(1);
+  }
+
+  u64 begin = stm_now();
   while (true) {
-    for (i32 i = 0; i < len; i++) {
-      LockGuard lock{&buf[i]->mtx};
-      if (buf[i]->len > 0) {
-        *v = lua_channel_dequeue(buf[i]);
-        return buf[i];
+    {
+      LockGuard lock{&sel->mtx};
+      sel->ready = false;
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    found = lua_channels_try_select(chans, start, v);
+    if (found != nullptr) {
+      break;
+    }
+
+    LockGuard lock{&sel->mtx};
+    if (sel->ready) {
+      continue;
+    }
+
+    if (timeout < 0) {
+      sel->cv.wait(&sel->mtx);
+    } else {
+      double left = timeout - stm_sec(stm_since(begin));
+      if (left <= 0) {
+        break;
       }
+
+      // huge timeouts (or math.huge) wait in steps, since the cast would
+      // overflow
+      double ms = ceil(left * 1000);
+      sel->cv.timed_wait(&sel->mtx, ms < LUA_SELECT_MAX_WAIT_MS
+                                        ? (u32)ms
+                                        : LUA_SELECT_MAX_WAIT_MS);
     }
+  }
 
-    g_channels.select.wait(&mtx);
+  for (LuaChannel *ch : chans) {
+    LockGuard lock{&ch->mtx};
+    for (u64 i = 0; i < ch->selects.len; i++) {
+      if (ch->selects[i] == sel) {
+        ch->selects[i] = ch->selects[ch->selects.len - 1];
+        ch->selects.len--;
+        break;
+      }
+    }
+    ch->waiting_recv.fetch_sub(1);
   }
+
+  return found;
 }
 
-void lua_channels_setup() {
-  g_channels.select.make();
-  g_channels.mtx.make();
+void lua_channels_select_trash() {
+  if (t_channel_select_made) {
+    t_channel_select.mtx.trash();
+    t_channel_select.cv.trash();
+    t_channel_select_made = false;
+  }
 }
 
+void lua_channels_setup() { g_channels.mtx.make(); }
+
 void lua_channels_shutdown() {
   for (auto [k, v] : g_channels.by_name) {
     LuaChannel *chan = *v;
@@ -350,6 +691,5 @@ void lua_channels_shutdown() {
     mem_free(chan);
   }
   g_channels.by_name.trash();
-  g_channels.select.trash();
   g_channels.mtx.trash();
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "array.h"
 #include "prelude.h"
 #include "slice.h"
 #include <atomic>
@@ -18,9 +19,11 @@ struct lua_State;
 struct LuaTableEntry;
 struct LuaVariant {
   i32 type;
+  bool is_integer; // numbers keep lua's integer subtype, so they stay exact
   union {
     bool boolean;
     double number;
+    i64 integer;
     String string;
     Slice<LuaTableEntry> table;
     struct {
@@ -29,7 +32,9 @@ struct LuaVariant {
     } udata;
   };
 
-  void make(lua_State *L, i32 arg);
+  // false if a table has cycles or is nested too deeply. the parts that
+  // were copied still need to be trashed
+  bool make(lua_State *L, i32 arg);
   void trash();
   void push(lua_State *L);
 };
@@ -39,30 +44,62 @@ struct LuaTableEntry {
   LuaVariant value;
 };
 
+// a thread waiting in lua_channels_select. registered on every channel it
+// waits on, so only sends on those channels wake it
+struct LuaChannelSelect {
+  Mutex mtx;
+  Cond cv;
+  bool ready; // a channel got an item since the last check
+};
+
+struct LuaChannelSlot {
+  std::atomic<u64> stamp;
+  LuaVariant item;
+};
+
+// bounded lock-free ring, safe for any number of senders and receivers.
+// head and tail are an index into slots plus a lap count, see
+// lua_channel_push. threads only lock mtx to sleep when the ring is empty
+// or full
 struct LuaChannel {
   std::atomic<char *> name;
 
-  Mutex mtx;
-  Cond received;
-  Cond sent;
+  Slice<LuaChannelSlot> slots;
+  u64 one_lap;     // power of two above slots.len
+  bool unbuffered; // send waits until its item is received
 
-  u64 received_total;
-  u64 sent_total;
+  char pad0[64];
+  std::atomic<u64> head;
+  char pad1[64];
+  std::atomic<u64> tail;
+  char pad2[64];
 
-  Slice<LuaVariant> items;
-  u64 front;
-  u64 back;
-  u64 len;
+  Mutex mtx;
+  Cond not_empty;
+  Cond not_full; // also signaled when an unbuffered item is received
+  std::atomic<i32> waiting_recv; // includes threads in select
+  std::atomic<i32> waiting_send;
+  Array<LuaChannelSelect *> selects;
 
   void make(String n, u64 buf);
   void trash();
   void send(LuaVariant item);
   LuaVariant recv();
   bool try_recv(LuaVariant *v);
+
+  // wakes receivers once for the whole batch
+  void send_many(Slice<LuaVariant> items);
+
+  // waits for at least one item, then takes up to n without waiting
+  void recv_many(u64 n, Array<LuaVariant> *out);
 };
 
 LuaChannel *lua_channel_make(String name, u64 buf);
 LuaChannel *lua_channel_get(String name);
-LuaChannel *lua_channels_select(lua_State *L, LuaVariant *v);
+// takes an item from whichever of chans has one. timeout is in seconds.
+// 0 doesn't wait, and negative waits forever. nullptr if nothing arrived
+LuaChannel *lua_channels_select(Slice<LuaChannel *> chans, LuaVariant *v,
+                                double timeout);
+void lua_channels_select_trash();
 void lua_channels_setup();
 void lua_channels_shutdown();
@@ -34,6 +34,13 @@ extern "C" {
 #define SOKOL_GLES3
 #endif
 #include "deps/sokol_app.h"
+#ifdef SOKOL_USE_DUMMY
+// sokol_app keeps its real backend, but the window is never opened
+#undef SOKOL_GLCORE33
+#undef SOKOL_GLES3
+#undef SOKOL_D3D11
+#define SOKOL_DUMMY_BACKEND
+#endif
 #include "deps/sokol_gfx.h"
 #include "deps/sokol_gl.h"
 #include "deps/sokol_glue.h"
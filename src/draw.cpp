@@ -1,5 +1,6 @@
 #include "draw.h"
 #include "algebra.h"
+#include "array.h"
 #include "deps/sokol_gfx.h"
 #include "deps/sokol_gl.h"
 #include "font.h"
@@ -13,6 +14,21 @@ extern "C" {
 #include <lauxlib.h>
 }
 
+struct BatchUniforms {
+  Matrix4 mvp;
+  float tint[4];
+};
+
+struct BatchCommand {
+  u32 image;
+  u32 sampler;
+  u32 vertex_buffer; // 0 for the stream buffer
+  u32 uniforms;
+  i32 layer;
+  u32 first; // first index
+  u32 count; // number of indices
+};
+
 struct Renderer2D {
   Matrix4 matrices[32];
   u64 matrices_len;
@@ -22,10 +38,370 @@ struct Renderer2D {
   u64 draw_colors_len;
 
   u32 sampler;
+  u32 texture;
+
+  sg_shader shader;
+  sg_pipeline pipeline;
+  sg_buffer vertex_buffer;
+  sg_buffer index_buffer;
+  u64 buffer_quads;
+  sg_image white_image;
+  sg_sampler default_sampler;
+
+  float width;
+  float height;
+  Matrix4 projection;
+  Array<BatchVertex> vertices;
+  Array<BatchCommand> commands;
+  Array<BatchUniforms> uniforms;
+  u64 static_quads;
+  i32 layer;
+
+  RendererStats stats;
 };
 
 static Renderer2D g_renderer;
 
+static const char *batch_vs_glsl330 = R"(#version 330
+uniform vec4 vs_params[5];
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 texcoord0;
+layout(location = 2) in vec4 color0;
+out vec2 uv;
+out vec4 color;
+void main() {
+  mat4 mvp = mat4(vs_params[0], vs_params[1], vs_params[2], vs_params[3]);
+  gl_Position = mvp * vec4(position, 0.0, 1.0);
+  uv = texcoord0;
+  color = color0 * vs_params[4];
+}
+)";
+
+static const char *batch_fs_glsl330 = R"(#version 330
+uniform sampler2D tex_smp;
+in vec2 uv;
+in vec4 color;
+layout(location = 0) out vec4 frag_color;
+void main() {
+  frag_color = texture(tex_smp, uv) * color;
+}
+)";
+
+static const char *batch_vs_glsl300es = R"(#version 300 es
+uniform vec4 vs_params[5];
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 texcoord0;
+layout(location = 2) in vec4 color0;
+out vec2 uv;
+out vec4 color;
+void main() {
+  mat4 mvp = mat4(vs_params[0], vs_params[1], vs_params[2], vs_params[3]);
+  gl_Position = mvp * vec4(position, 0.0, 1.0);
+  uv = texcoord0;
+  color = color0 * vs_params[4];
+}
+)";
+
+static const char *batch_fs_glsl300es = R"(#version 300 es
+precision mediump float;
+uniform highp sampler2D tex_smp;
+in highp vec2 uv;
+in highp vec4 color;
+layout(location = 0) out highp vec4 frag_color;
+void main() {
+  frag_color = texture(tex_smp, uv) * color;
+}
+)";
+
+static const char *batch_vs_hlsl = R"(
+cbuffer vs_params : register(b0) {
+  float4x4 mvp;
+  float4 tint;
+};
+struct vs_in {
+  float2 position : TEXCOORD0;
+  float2 texcoord0 : TEXCOORD1;
+  float4 color0 : TEXCOORD2;
+};
+struct vs_out {
+  float2 uv : TEXCOORD0;
+  float4 color : TEXCOORD1;
+  float4 pos : SV_Position;
+};
+vs_out main(vs_in inp) {
+  vs_out outp;
+  outp.pos = mul(mvp, float4(inp.position, 0.0f, 1.0f));
+  outp.uv = inp.texcoord0;
+  outp.color = inp.color0 * tint;
+  return outp;
+}
+)";
+
+static const char *batch_fs_hlsl = R"(
+Texture2D<float4> tex : register(t0);
+SamplerState smp : register(s0);
+float4 main(float2 uv : TEXCOORD0, float4 color : TEXCOORD1) : SV_Target0 {
+  return tex.Sample(smp, uv) * color;
+}
+)";
+
+static void renderer_make_buffers(u64 quads) {
+  if (g_renderer.vertex_buffer.id != SG_INVALID_ID) {
+    sg_destroy_buffer(g_renderer.vertex_buffer);
+  }
+  if (g_renderer.index_buffer.id != SG_INVALID_ID) {
+    sg_destroy_buffer(g_renderer.index_buffer);
+  }
+
+  sg_buffer_desc vb = {};
+  vb.size = quads * 4 * sizeof(BatchVertex);
+  vb.usage = SG_USAGE_STREAM;
+  vb.label = "batch-vertices";
+  g_renderer.vertex_buffer = sg_make_buffer(vb);
+
+  u32 *indices = (u32 *)mem_alloc(quads * 6 * sizeof(u32));
+  defer(mem_free(indices));
+
+  for (u32 i = 0; i < quads; i++) {
+    indices[i * 6 + 0] = i * 4 + 0;
+    indices[i * 6 + 1] = i * 4 + 1;
+    indices[i * 6 + 2] = i * 4 + 2;
+    indices[i * 6 + 3] = i * 4 + 0;
+    indices[i * 6 + 4] = i * 4 + 2;
+    indices[i * 6 + 5] = i * 4 + 3;
+  }
+
+  sg_buffer_desc ib = {};
+  ib.type = SG_BUFFERTYPE_INDEXBUFFER;
+  ib.data = {indices, quads * 6 * sizeof(u32)};
+  ib.label = "batch-indices";
+  g_renderer.index_buffer = sg_make_buffer(ib);
+
+  g_renderer.buffer_quads = quads;
+}
+
+void renderer_setup() {
+  PROFILE_FUNC();
+
+  sg_shader_desc shd = {};
+  shd.attrs[0].name = "position";
+  shd.attrs[1].name = "texcoord0";
+  shd.attrs[2].name = "color0";
+  shd.attrs[0].sem_name = "TEXCOORD";
+  shd.attrs[0].sem_index = 0;
+  shd.attrs[1].sem_name = "TEXCOORD";
+  shd.attrs[1].sem_index = 1;
+  shd.attrs[2].sem_name = "TEXCOORD";
+  shd.attrs[2].sem_index = 2;
+
+  sg_shader_uniform_block_desc *ub = &shd.vs.uniform_blocks[0];
+  ub->size = sizeof(BatchUniforms);
+  ub->uniforms[0].name = "vs_params";
+  ub->uniforms[0].type = SG_UNIFORMTYPE_FLOAT4;
+  ub->uniforms[0].array_count = 5;
+
+  shd.fs.images[0].used = true;
+  shd.fs.images[0].image_type = SG_IMAGETYPE_2D;
+  shd.fs.images[0].sample_type = SG_IMAGESAMPLETYPE_FLOAT;
+  shd.fs.samplers[0].used = true;
+  shd.fs.samplers[0].sampler_type = SG_SAMPLERTYPE_FILTERING;
+  shd.fs.image_sampler_pairs[0].used = true;
+  shd.fs.image_sampler_pairs[0].image_slot = 0;
+  shd.fs.image_sampler_pairs[0].sampler_slot = 0;
+  shd.fs.image_sampler_pairs[0].glsl_name = "tex_smp";
+
+  switch (sg_query_backend()) {
+  case SG_BACKEND_GLES3:
+    shd.vs.source = batch_vs_glsl300es;
+    shd.fs.source = batch_fs_glsl300es;
+    break;
+  case SG_BACKEND_D3D11:
+    shd.vs.source = batch_vs_hlsl;
+    shd.fs.source = batch_fs_hlsl;
+    break;
+  default:
+    shd.vs.source = batch_vs_glsl330;
+    shd.fs.source = batch_fs_glsl330;
+    break;
+  }
+  shd.label = "batch-shader";
+  g_renderer.shader = sg_make_shader(shd);
+
+  sg_pipeline_desc pip = {};
+  pip.shader = g_renderer.shader;
+  pip.layout.attrs[0].format = SG_VERTEXFORMAT_FLOAT2;
+  pip.layout.attrs[1].format = SG_VERTEXFORMAT_FLOAT2;
+  pip.layout.attrs[2].format = SG_VERTEXFORMAT_UBYTE4N;
+  pip.index_type = SG_INDEXTYPE_UINT32;
+  pip.colors[0].blend.enabled = true;
+  pip.colors[0].blend.src_factor_rgb = SG_BLENDFACTOR_SRC_ALPHA;
+  pip.colors[0].blend.dst_factor_rgb = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA;
+  pip.label = "batch-pipeline";
+  g_renderer.pipeline = sg_make_pipeline(pip);
+
+  u32 white = 0xFFFFFFFF;
+  sg_image_desc img = {};
+  img.width = 1;
+  img.height = 1;
+  img.data.subimage[0][0] = {&white, sizeof(white)};
+  img.label = "batch-white";
+  g_renderer.white_image = sg_make_image(img);
+
+  sg_sampler_desc smp = {};
+  g_renderer.default_sampler = sg_make_sampler(smp);
+
+  renderer_make_buffers(4096);
+}
+
+void renderer_shutdown() {
+  sg_destroy_buffer(g_renderer.index_buffer);
+  sg_destroy_buffer(g_renderer.vertex_buffer);
+  sg_destroy_sampler(g_renderer.default_sampler);
+  sg_destroy_image(g_renderer.white_image);
+  sg_destroy_pipeline(g_renderer.pipeline);
+  sg_destroy_shader(g_renderer.shader);
+
+  g_renderer.vertices.trash();
+  g_renderer.commands.trash();
+  g_renderer.uniforms.trash();
+}
+
+void renderer_begin_frame(float width, float height) {
+  Matrix4 m = {};
+  m.cols[0][0] = 2.0f / width;
+  m.cols[1][1] = -2.0f / height;
+  m.cols[2][2] = -1.0f;
+  m.cols[3][0] = -1.0f;
+  m.cols[3][1] = 1.0f;
+  m.cols[3][3] = 1.0f;
+  g_renderer.width = width;
+  g_renderer.height = height;
+  g_renderer.projection = m;
+
+  g_renderer.vertices.len = 0;
+  g_renderer.commands.len = 0;
+  g_renderer.uniforms.len = 0;
+  g_renderer.static_quads = 0;
+  g_renderer.layer = 0;
+  g_renderer.texture = SG_INVALID_ID;
+  sgl_layer(0);
+
+  BatchUniforms uniforms = {};
+  uniforms.mvp = m;
+  uniforms.tint[0] = 1.0f;
+  uniforms.tint[1] = 1.0f;
+  uniforms.tint[2] = 1.0f;
+  uniforms.tint[3] = 1.0f;
+  g_renderer.uniforms.push(uniforms);
+}
+
+void renderer_flush() {
+  u64 len = g_renderer.commands.len;
+  if (len > 0 && g_renderer.commands[len - 1].layer == g_renderer.layer) {
+    sgl_layer(++g_renderer.layer);
+  }
+}
+
+void renderer_draw() {
+  PROFILE_FUNC();
+
+  u64 quads = g_renderer.vertices.len / 4;
+  if (g_renderer.static_quads > quads) {
+    quads = g_renderer.static_quads;
+  }
+
+  if (quads > g_renderer.buffer_quads) {
+    u64 cap = g_renderer.buffer_quads;
+    while (cap < quads) {
+      cap *= 2;
+    }
+    renderer_make_buffers(cap);
+  }
+
+  if (g_renderer.vertices.len > 0) {
+    sg_update_buffer(g_renderer.vertex_buffer,
+                     {g_renderer.vertices.data,
+                      g_renderer.vertices.len * sizeof(BatchVertex)});
+  }
+
+  sg_bindings bind = {};
+  bind.vertex_buffers[0] = g_renderer.vertex_buffer;
+  bind.index_buffer = g_renderer.index_buffer;
+
+  RendererStats stats = {};
+  u64 cmd = 0;
+  for (i32 layer = 0; layer <= g_renderer.layer; layer++) {
+    sgl_draw_layer(layer);
+
+    bool applied = false;
+    u32 uniforms = 0;
+    for (; cmd < g_renderer.commands.len &&
+           g_renderer.commands[cmd].layer == layer;
+         cmd++) {
+      BatchCommand c = g_renderer.commands[cmd];
+
+      if (!applied) {
+        sg_apply_pipeline(g_renderer.pipeline);
+      }
+
+      if (!applied || c.uniforms != uniforms) {
+        sg_apply_uniforms(SG_SHADERSTAGE_VS, 0,
+                          SG_RANGE(g_renderer.uniforms[c.uniforms]));
+        uniforms = c.uniforms;
+        applied = true;
+      }
+
+      if (c.vertex_buffer != 0) {
+        bind.vertex_buffers[0] = {c.vertex_buffer};
+      } else {
+        bind.vertex_buffers[0] = g_renderer.vertex_buffer;
+      }
+
+      bind.fs.images[0] = {c.image};
+      bind.fs.samplers[0] = {c.sampler};
+      sg_apply_bindings(bind);
+      sg_draw(c.first, c.count, 1);
+
+      stats.batches++;
+      stats.vertices += c.count / 6 * 4;
+    }
+  }
+
+  g_renderer.stats = stats;
+}
+
+RendererStats renderer_stats() { return g_renderer.stats; }
+
+Vector4 renderer_view_rect() {
+  Matrix4 top = renderer_peek_matrix();
+  float a = top.cols[0][0];
+  float b = top.cols[0][1];
+  float c = top.cols[1][0];
+  float d = top.cols[1][1];
+  float tx = top.cols[3][0];
+  float ty = top.cols[3][1];
+
+  float det = a * d - b * c;
+  if (fabsf(det) < 1e-6f) {
+    return vec4(-INFINITY, -INFINITY, INFINITY, INFINITY);
+  }
+
+  float sx[4] = {0, g_renderer.width, 0, g_renderer.width};
+  float sy[4] = {0, 0, g_renderer.height, g_renderer.height};
+
+  Vector4 rect = vec4(INFINITY, INFINITY, -INFINITY, -INFINITY);
+  for (i32 i = 0; i < 4; i++) {
+    float x = (d * (sx[i] - tx) - c * (sy[i] - ty)) / det;
+    float y = (a * (sy[i] - ty) - b * (sx[i] - tx)) / det;
+    rect.x = x < rect.x ? x : rect.x;
+    rect.y = y < rect.y ? y : rect.y;
+    rect.z = x > rect.z ? x : rect.z;
+    rect.w = y > rect.w ? y : rect.w;
+  }
+
+  return rect;
+}
+
 void renderer_reset() {
   g_renderer.clear_color[0] = 0.0f;
   g_renderer.clear_color[1] = 0.0f;
@@ -50,6 +426,8 @@ void renderer_reset() {
 
 void renderer_use_sampler(u32 sampler) { g_renderer.sampler = sampler; }
 
+void renderer_texture(u32 image) { g_renderer.texture = image; }
+
 void renderer_get_clear_color(float *rgba) {
   memcpy(rgba, g_renderer.clear_color, sizeof(float) * 4);
 }
@@ -169,6 +547,22 @@ void renderer_scale(float x, float y) {
   renderer_set_top_matrix(top);
 }
 
+static u32 renderer_current_image() {
+  u32 image = g_renderer.texture;
+  if (image == SG_INVALID_ID) {
+    image = g_renderer.white_image.id;
+  }
+  return image;
+}
+
+static u32 renderer_current_sampler() {
+  u32 sampler = g_renderer.sampler;
+  if (sampler == SG_INVALID_ID) {
+    sampler = g_renderer.default_sampler.id;
+  }
+  return sampler;
+}
+
 void renderer_push_quad(Vector4 pos, Vector4 tex) {
   Matrix4 top = renderer_peek_matrix();
   Vector4 a = vec4_mul_mat4(vec4_xy(pos.x, pos.y), top);
@@ -176,10 +570,59 @@ void renderer_push_quad(Vector4 pos, Vector4 tex) {
   Vector4 c = vec4_mul_mat4(vec4_xy(pos.z, pos.w), top);
   Vector4 d = vec4_mul_mat4(vec4_xy(pos.z, pos.y), top);
 
-  sgl_v2f_t2f(a.x, a.y, tex.x, tex.y);
-  sgl_v2f_t2f(b.x, b.y, tex.x, tex.w);
-  sgl_v2f_t2f(c.x, c.y, tex.z, tex.w);
-  sgl_v2f_t2f(d.x, d.y, tex.z, tex.y);
+  u32 image = renderer_current_image();
+  u32 sampler = renderer_current_sampler();
+
+  Array<BatchCommand> &commands = g_renderer.commands;
+  BatchCommand *cmd = commands.len > 0 ? &commands[commands.len - 1] : nullptr;
+  if (cmd == nullptr || cmd->image != image || cmd->sampler != sampler ||
+      cmd->vertex_buffer != 0 || cmd->uniforms != 0 ||
+      cmd->layer != g_renderer.layer) {
+    BatchCommand next = {};
+    next.image = image;
+    next.sampler = sampler;
+    next.layer = g_renderer.layer;
+    next.first = (u32)(g_renderer.vertices.len / 4 * 6);
+    commands.push(next);
+    cmd = &commands[commands.len - 1];
+  }
+  cmd->count += 6;
+
+  Color col = g_renderer.draw_colors[g_renderer.draw_colors_len - 1];
+  g_renderer.vertices.push({a.x, a.y, tex.x, tex.y, col});
+  g_renderer.vertices.push({b.x, b.y, tex.x, tex.w, col});
+  g_renderer.vertices.push({c.x, c.y, tex.z, tex.w, col});
+  g_renderer.vertices.push({d.x, d.y, tex.z, tex.y, col});
+}
+
+void renderer_push_static(u32 vertex_buffer, u32 first_quad, u32 quads) {
+  if (quads == 0) {
+    return;
+  }
+
+  Color col = g_renderer.draw_colors[g_renderer.draw_colors_len - 1];
+
+  BatchUniforms uniforms = {};
+  uniforms.mvp = mat4_mul_mat4(g_renderer.projection, renderer_peek_matrix());
+  uniforms.tint[0] = col.r / 255.0f;
+  uniforms.tint[1] = col.g / 255.0f;
+  uniforms.tint[2] = col.b / 255.0f;
+  uniforms.tint[3] = col.a / 255.0f;
+  g_renderer.uniforms.push(uniforms);
+
+  BatchCommand cmd = {};
+  cmd.image = renderer_current_image();
+  cmd.sampler = renderer_current_sampler();
+  cmd.vertex_buffer = vertex_buffer;
+  cmd.uniforms = (u32)(g_renderer.uniforms.len - 1);
+  cmd.layer = g_renderer.layer;
+  cmd.first = first_quad * 6;
+  cmd.count = quads * 6;
+  g_renderer.commands.push(cmd);
+
+  if (first_quad + quads > g_renderer.static_quads) {
+    g_renderer.static_quads = first_quad + quads;
+  }
 }
 
 void renderer_push_xy(float x, float y) {
@@ -198,20 +641,16 @@ void draw_image(const Image *img, DrawDescription *desc) {
   renderer_rotate(desc->rotation);
   renderer_scale(desc->sx, desc->sy);
 
-  sgl_enable_texture();
-  sgl_texture({img->id}, {g_renderer.sampler});
-  sgl_begin_quads();
+  renderer_texture(img->id);
 
   float x0 = -desc->ox;
   float y0 = -desc->oy;
   float x1 = (desc->u1 - desc->u0) * img->width - desc->ox;
   float y1 = (desc->v1 - desc->v0) * img->height - desc->oy;
 
-  renderer_apply_color();
   renderer_push_quad(vec4(x0, y0, x1, y1),
                      vec4(desc->u0, desc->v0, desc->u1, desc->v1));
 
-  sgl_end();
   renderer_pop_matrix();
 }
 
@@ -233,21 +672,17 @@ void draw_sprite(Sprite *spr, DrawDescription *desc) {
   renderer_rotate(desc->rotation);
   renderer_scale(desc->sx, desc->sy);
 
-  sgl_enable_texture();
-  sgl_texture({view.data.img.id}, {g_renderer.sampler});
-  sgl_begin_quads();
+  renderer_texture(view.data->img.id);
 
   float x0 = -desc->ox;
   float y0 = -desc->oy;
-  float x1 = (float)view.data.width - desc->ox;
-  float y1 = (float)view.data.height - desc->oy;
+  float x1 = (float)view.data->width - desc->ox;
+  float y1 = (float)view.data->height - desc->oy;
 
-  SpriteFrame f = view.data.frames[view.frame()];
+  SpriteFrame f = view.data->frames[view.frame()];
 
-  renderer_apply_color();
   renderer_push_quad(vec4(x0, y0, x1, y1), vec4(f.u0, f.v0, f.u1, f.v1));
 
-  sgl_end();
   renderer_pop_matrix();
 }
 
@@ -261,11 +696,9 @@ static void draw_font_line(FontFamily *font, float size, float *start_x,
     float yy = y;
     stbtt_aligned_quad q = font->quad(&atlas, &xx, &yy, size, r.charcode());
 
-    sgl_texture({atlas}, {g_renderer.sampler});
-    sgl_begin_quads();
+    renderer_texture(atlas);
     renderer_push_quad(vec4(x + q.x0, y + q.y0, x + q.x1, y + q.y1),
                        vec4(q.s0, q.t0, q.s1, q.t1));
-    sgl_end();
 
     x = xx;
     y = yy;
@@ -278,8 +711,6 @@ float draw_font(FontFamily *font, float size, float x, float y, String text) {
   PROFILE_FUNC();
 
   y += size;
-  sgl_enable_texture();
-  renderer_apply_color();
 
   for (String line : SplitLines(text)) {
     draw_font_line(font, size, &x, &y, line);
@@ -293,8 +724,6 @@ float draw_font_wrapped(FontFamily *font, float size, float x, float y,
   PROFILE_FUNC();
 
   y += size;
-  sgl_enable_texture();
-  renderer_apply_color();
 
   for (String line : SplitLines(text)) {
     font->sb.clear();
@@ -326,32 +755,68 @@ float draw_font_wrapped(FontFamily *font, float size, float x, float y,
   return y - size;
 }
 
-void draw_tilemap(const Tilemap *tm) {
+static bool rect_overlaps(Vector4 a, Vector4 b) {
+  return a.x < b.z && a.z > b.x && a.y < b.w && a.w > b.y;
+}
+
+void draw_tilemap(const Tilemap *tm, Vector4 view) {
   PROFILE_FUNC();
 
-  sgl_enable_texture();
-  renderer_apply_color();
   for (const TilemapLevel &level : tm->levels) {
+    Vector4 level_rect = vec4(level.world_x, level.world_y,
+                              level.world_x + level.px_width,
+                              level.world_y + level.px_height);
+    if (!rect_overlaps(level_rect, view)) {
+      continue;
+    }
+
     bool ok = renderer_push_matrix();
     if (!ok) {
       return;
     }
 
+    // view relative to level
+    Vector4 local = vec4(view.x - level.world_x, view.y - level.world_y,
+                         view.z - level.world_x, view.w - level.world_y);
+
     renderer_translate(level.world_x, level.world_y);
     for (i32 i = level.layers.len - 1; i >= 0; i--) {
       const TilemapLayer &layer = level.layers[i];
-      sgl_texture({layer.image.id}, {g_renderer.sampler});
-      sgl_begin_quads();
-      for (Tile tile : layer.tiles) {
-        float x0 = tile.x;
-        float y0 = tile.y;
-        float x1 = tile.x + layer.grid_size;
-        float y1 = tile.y + layer.grid_size;
-
-        renderer_push_quad(vec4(x0, y0, x1, y1),
-                           vec4(tile.u0, tile.v0, tile.u1, tile.v1));
+      renderer_texture(layer.image.id);
+
+      u32 first = 0;
+      u32 count = 0;
+      for (TilemapChunk chunk : layer.chunks) {
+        if (!rect_overlaps(vec4(chunk.x0, chunk.y0, chunk.x1, chunk.y1),
+                           local)) {
+          continue;
+        }
+
+        if (layer.vertex_buffer != 0) {
+          // merge neighbouring chunks into one draw
+          if (count > 0 && chunk.first == first + count) {
+            count += chunk.count;
+          } else {
+            renderer_push_static(layer.vertex_buffer, first, count);
+            first = chunk.first;
+            count = chunk.count;
+          }
+          continue;
+        }
+
+        for (u32 j = chunk.first; j < chunk.first + chunk.count; j++) {
+          Tile tile = layer.tiles[j];
+          float x0 = tile.x;
+          float y0 = tile.y;
+          float x1 = tile.x + layer.grid_size;
+          float y1 = tile.y + layer.grid_size;
+
+          renderer_push_quad(vec4(x0, y0, x1, y1),
+                             vec4(tile.u0, tile.v0, tile.u1, tile.v1));
+        }
       }
-      sgl_end();
+
+      renderer_push_static(layer.vertex_buffer, first, count);
     }
     renderer_pop_matrix();
   }
@@ -369,23 +834,21 @@ void draw_filled_rect(RectDescription *desc) {
   renderer_rotate(desc->rotation);
   renderer_scale(desc->sx, desc->sy);
 
-  sgl_disable_texture();
-  sgl_begin_quads();
+  renderer_texture(SG_INVALID_ID);
 
   float x0 = -desc->ox;
   float y0 = -desc->oy;
   float x1 = desc->w - desc->ox;
   float y1 = desc->h - desc->oy;
 
-  renderer_apply_color();
   renderer_push_quad(vec4(x0, y0, x1, y1), vec4(0, 0, 0, 0));
 
-  sgl_end();
   renderer_pop_matrix();
 }
 
 void draw_line_rect(RectDescription *desc) {
   PROFILE_FUNC();
+  renderer_flush();
 
   bool ok = renderer_push_matrix();
   if (!ok) {
@@ -423,6 +886,7 @@ void draw_line_rect(RectDescription *desc) {
 
 void draw_line_circle(float x, float y, float radius) {
   PROFILE_FUNC();
+  renderer_flush();
 
   sgl_disable_texture();
   sgl_begin_line_strip();
@@ -440,6 +904,7 @@ void draw_line_circle(float x, float y, float radius) {
 
 void draw_line(float x0, float y0, float x1, float y1) {
   PROFILE_FUNC();
+  renderer_flush();
 
   sgl_disable_texture();
   sgl_begin_lines();
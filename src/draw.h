@@ -42,8 +42,28 @@ struct Color {
   u8 r, g, b, a;
 };
 
+struct BatchVertex {
+  float x, y;
+  float u, v;
+  Color color;
+};
+
+struct RendererStats {
+  u64 batches;
+  u64 vertices;
+};
+
+void renderer_setup();
+void renderer_shutdown();
+void renderer_begin_frame(float width, float height);
+void renderer_flush();
+void renderer_draw();
+RendererStats renderer_stats();
+Vector4 renderer_view_rect();
+
 void renderer_reset();
 void renderer_use_sampler(u32 sampler);
+void renderer_texture(u32 image);
 void renderer_get_clear_color(float *rgba);
 void renderer_set_clear_color(float *rgba);
 void renderer_apply_color();
@@ -57,6 +77,7 @@ void renderer_translate(float x, float y);
 void renderer_rotate(float angle);
 void renderer_scale(float x, float y);
 void renderer_push_quad(Vector4 pos, Vector4 tex);
+void renderer_push_static(u32 vertex_buffer, u32 first_quad, u32 quads);
 void renderer_push_xy(float x, float y);
 
 void draw_image(const Image *img, DrawDescription *desc);
@@ -64,7 +85,7 @@ void draw_sprite(Sprite *spr, DrawDescription *desc);
 float draw_font(FontFamily *font, float size, float x, float y, String text);
 float draw_font_wrapped(FontFamily *font, float size, float x, float y,
                         String text, float limit);
-void draw_tilemap(const Tilemap *tm);
+void draw_tilemap(const Tilemap *tm, Vector4 view);
 void draw_filled_rect(RectDescription *desc);
 void draw_line_rect(RectDescription *desc);
 void draw_line_circle(float x, float y, float radius);
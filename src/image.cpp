@@ -7,7 +7,7 @@
 #include "vfs.h"
 #include <stdio.h>
 
-bool Image::load(String filepath, bool generate_mips) {
+bool ImagePixels::load(String filepath, bool generate_mips) {
   PROFILE_FUNC();
 
   String contents = {};
@@ -29,25 +29,20 @@ bool Image::load(String filepath, bool generate_mips) {
   }
   defer(stbi_image_free(data));
 
-  sg_image_desc desc = {};
-  desc.pixel_format = SG_PIXELFORMAT_RGBA8;
-  desc.width = width;
-  desc.height = height;
-  desc.data.subimage[0][0].ptr = data;
-  desc.data.subimage[0][0].size = width * height * 4;
-
-  Array<u8 *> mips = {};
-  defer({
-    for (u8 *mip : mips) {
-      mem_free(mip);
-    }
-    mips.trash();
-  });
+  ImagePixels pixels = {};
+  pixels.width = width;
+  pixels.height = height;
+  pixels.channels = channels;
+  pixels.has_mips = generate_mips;
+
+  u8 *base = (u8 *)mem_alloc(width * height * 4);
+  memcpy(base, data, width * height * 4);
+  pixels.mips.push(base);
 
   if (generate_mips) {
-    mips.reserve(SG_MAX_MIPMAPS);
+    pixels.mips.reserve(SG_MAX_MIPMAPS);
 
-    u8 *prev = data;
+    u8 *prev = base;
     i32 w0 = width;
     i32 h0 = height;
     i32 w1 = w0 / 2;
@@ -58,10 +53,7 @@ bool Image::load(String filepath, bool generate_mips) {
 
       u8 *mip = (u8 *)mem_alloc(w1 * h1 * 4);
       stbir_resize_uint8_linear(prev, w0, h0, 0, mip, w1, h1, 0, STBIR_RGBA);
-      mips.push(mip);
-
-      desc.data.subimage[0][mips.len].ptr = mip;
-      desc.data.subimage[0][mips.len].size = w1 * h1 * 4;
+      pixels.mips.push(mip);
 
       prev = mip;
       w0 = w1;
@@ -71,7 +63,34 @@ bool Image::load(String filepath, bool generate_mips) {
     }
   }
 
-  desc.num_mipmaps = mips.len + 1;
+  *this = pixels;
+  return true;
+}
+
+void ImagePixels::trash() {
+  for (u8 *mip : mips) {
+    mem_free(mip);
+  }
+  mips.trash();
+}
+
+void Image::upload(ImagePixels *pixels) {
+  PROFILE_FUNC();
+
+  sg_image_desc desc = {};
+  desc.pixel_format = SG_PIXELFORMAT_RGBA8;
+  desc.width = pixels->width;
+  desc.height = pixels->height;
+  desc.num_mipmaps = (i32)pixels->mips.len;
+
+  i32 w = pixels->width;
+  i32 h = pixels->height;
+  for (u64 i = 0; i < pixels->mips.len; i++) {
+    desc.data.subimage[0][i].ptr = pixels->mips[i];
+    desc.data.subimage[0][i].size = w * h * 4;
+    w /= 2;
+    h /= 2;
+  }
 
   u32 id = 0;
   {
@@ -82,13 +101,27 @@ bool Image::load(String filepath, bool generate_mips) {
 
   Image img = {};
   img.id = id;
-  img.width = width;
-  img.height = height;
-  img.has_mips = generate_mips;
+  img.width = pixels->width;
+  img.height = pixels->height;
+  img.has_mips = pixels->has_mips;
   *this = img;
 
-  printf("created image (%dx%d, %d channels, mipmaps: %s) with id %d\n", width,
-         height, channels, generate_mips ? "true" : "false", id);
+  printf("created image (%dx%d, %d channels, mipmaps: %s) with id %d\n",
+         pixels->width, pixels->height, pixels->channels,
+         img.has_mips ? "true" : "false", id);
+}
+
+bool Image::load(String filepath, bool generate_mips) {
+  PROFILE_FUNC();
+
+  ImagePixels pixels = {};
+  bool ok = pixels.load(filepath, generate_mips);
+  if (!ok) {
+    return false;
+  }
+  defer(pixels.trash());
+
+  upload(&pixels);
   return true;
 }
 
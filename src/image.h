@@ -1,7 +1,19 @@
 #pragma once
 
+#include "array.h"
 #include "prelude.h"
 
+struct ImagePixels {
+  i32 width;
+  i32 height;
+  i32 channels;
+  bool has_mips;
+  Array<u8 *> mips; // rgba8, base level first
+
+  bool load(String filepath, bool generate_mips);
+  void trash();
+};
+
 struct Image {
   u32 id;
   i32 width;
@@ -9,5 +21,6 @@ struct Image {
   bool has_mips;
 
   bool load(String filepath, bool generate_mips);
+  void upload(ImagePixels *pixels);
   void trash();
-};
\ No newline at end of file
+};
@@ -0,0 +1,74 @@
+#include "jobs.h"
+#include "arena.h"
+#include "array.h"
+#include "json.h"
+#include "profile.h"
+#include "queue.h"
+#include "sync.h"
+#include "tilemap.h"
+
+struct Job {
+  JobProc fn;
+  void *udata;
+};
+
+struct Jobs {
+  Queue<Job> queue;
+  Array<Thread> workers;
+};
+
+static Jobs g_jobs = {};
+
+static void job_worker(void *) {
+  while (true) {
+    Job job = g_jobs.queue.demand();
+    if (job.fn == nullptr) {
+      tile_search_trash();
+      json_writer_trash();
+      frame_arena_trash();
+      profile_thread_trash();
+      return;
+    }
+
+    PROFILE_BLOCK("job");
+    job.fn(job.udata);
+    frame_arena_reset();
+  }
+}
+
+void jobs_setup(i32 workers) {
+  g_jobs.queue.make();
+
+#ifndef IS_HTML5
+  for (i32 i = 0; i < workers; i++) {
+    Thread t = {};
+    t.make(job_worker, nullptr);
+    g_jobs.workers.push(t);
+  }
+#endif
+}
+
+void jobs_shutdown() {
+  // sentinels go behind queued work, so pending jobs still finish
+  for (u64 i = 0; i < g_jobs.workers.len; i++) {
+    g_jobs.queue.enqueue({});
+  }
+
+  for (Thread &t : g_jobs.workers) {
+    t.join();
+  }
+
+  g_jobs.workers.trash();
+  g_jobs.queue.trash();
+}
+
+void jobs_push(JobProc fn, void *udata) {
+  if (g_jobs.workers.len == 0) {
+    fn(udata);
+    return;
+  }
+
+  g_jobs.queue.enqueue({fn, udata});
+}
+
+i32 jobs_worker_count() { return (i32)g_jobs.workers.len; }
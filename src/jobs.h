@@ -0,0 +1,10 @@
+#pragma once
+
+#include "prelude.h"
+
+typedef void (*JobProc)(void *);
+
+void jobs_setup(i32 workers);
+void jobs_shutdown();
+void jobs_push(JobProc fn, void *udata);
+i32 jobs_worker_count();
@@ -1,10 +1,15 @@
 #include "json.h"
 #include "arena.h"
-#include "hash_map.h"
+#include "array.h"
+#include "jobs.h"
 #include "luax.h"
 #include "prelude.h"
 #include "profile.h"
 #include "strings.h"
+#include "vfs.h"
+#include <charconv>
+#include <math.h>
+#include <new>
 
 extern "C" {
 #include <lauxlib.h>
@@ -22,8 +27,8 @@ enum JSONTok : i32 {
   JSONTok_True,     // true
   JSONTok_False,    // false
   JSONTok_Null,     // null
-  JSONTok_String,   // "[^"]*"
-  JSONTok_Number,   // [0-9]+\.?[0-9]*
+  JSONTok_String,   // "([^"\\]|\\.)*"
+  JSONTok_Number,   // -?[0-9]+(\.[0-9]+)?([eE][+-]?[0-9]+)?
   JSONTok_Error,
   JSONTok_EOF,
 };
@@ -172,11 +177,29 @@ static JSONToken json_scan_number(JSONScanner *scan) {
     }
   }
 
+  char e = json_peek(scan, 0);
+  if (e == 'e' || e == 'E') {
+    char sign = json_peek(scan, 1);
+    u64 digit = (sign == '+' || sign == '-') ? 2 : 1;
+    if (is_digit(json_peek(scan, digit))) {
+      for (u64 i = 0; i < digit; i++) {
+        json_next_char(scan); // eat 'e' and sign
+      }
+
+      while (is_digit(json_peek(scan, 0))) {
+        json_next_char(scan);
+      }
+    }
+  }
+
   return json_make_tok(scan, JSONTok_Number);
 }
 
 static JSONToken json_scan_string(JSONScanner *scan) {
   while (json_peek(scan, 0) != '"' && !json_at_end(scan)) {
+    if (json_peek(scan, 0) == '\\') {
+      json_next_char(scan);
+    }
     json_next_char(scan);
   }
 
@@ -221,23 +244,173 @@ static JSONToken json_scan_next(Arena *a, JSONScanner *scan) {
   case ',': return json_make_tok(scan, JSONTok_Comma);
   }
 
+  ScratchArena scratch;
   String msg = tmp_fmt("unexpected character: '%c' (%d)", c, (int)c);
   String s = a->bump_string(msg);
   return json_err_tok(scan, s);
 }
 
-static String json_parse_next(Arena *a, JSONScanner *scan, JSON *out);
+static i32 json_hex4(String s, u64 i) {
+  if (i + 4 > s.len) {
+    return -1;
+  }
+
+  i32 n = 0;
+  for (u64 j = i; j < i + 4; j++) {
+    char c = s.data[j];
+    n <<= 4;
+    if (c >= '0' && c <= '9') {
+      n |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      n |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      n |= c - 'A' + 10;
+    } else {
+      return -1;
+    }
+  }
+  return n;
+}
+
+// decodes escape sequences. out needs raw.len bytes, since the decoded
+// string is never longer
+static String json_unescape(String raw, char *out) {
+  u64 len = 0;
+  for (u64 i = 0; i < raw.len; i++) {
+    char c = raw.data[i];
+    if (c != '\\' || i + 1 == raw.len) {
+      out[len++] = c;
+      continue;
+    }
+
+    c = raw.data[++i];
+    switch (c) {
+    case 'b': out[len++] = '\b'; break;
+    case 'f': out[len++] = '\f'; break;
+    case 'n': out[len++] = '\n'; break;
+    case 'r': out[len++] = '\r'; break;
+    case 't': out[len++] = '\t'; break;
+    case 'u': {
+      i32 cp = json_hex4(raw, i + 1);
+      if (cp < 0) {
+        out[len++] = c;
+        break;
+      }
+      i += 4;
+
+      if (cp >= 0xD800 && cp <= 0xDBFF && i + 2 < raw.len &&
+          raw.data[i + 1] == '\\' && raw.data[i + 2] == 'u') {
+        i32 lo = json_hex4(raw, i + 3);
+        if (lo >= 0xDC00 && lo <= 0xDFFF) {
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+          i += 6;
+        }
+      }
+
+      if (cp >= 0xD800 && cp <= 0xDFFF) {
+        cp = 0xFFFD; // unpaired surrogate
+      }
+
+      if (cp < 0x80) {
+        out[len++] = (char)cp;
+      } else if (cp < 0x800) {
+        out[len++] = (char)(0xC0 | (cp >> 6));
+        out[len++] = (char)(0x80 | (cp & 0x3F));
+      } else if (cp < 0x10000) {
+        out[len++] = (char)(0xE0 | (cp >> 12));
+        out[len++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[len++] = (char)(0x80 | (cp & 0x3F));
+      } else {
+        out[len++] = (char)(0xF0 | (cp >> 18));
+        out[len++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        out[len++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[len++] = (char)(0x80 | (cp & 0x3F));
+      }
+      break;
+    }
+    default: out[len++] = c; break; // quote, backslash, slash
+    }
+  }
+
+  return {out, len};
+}
+
+// the contents of a string token, decoded into the arena if it has escapes
+static String json_token_string(Arena *a, JSONToken *tok) {
+  String raw = tok->str.substr(1, tok->str.len - 1);
+  if (memchr(raw.data, '\\', raw.len) == nullptr) {
+    return raw;
+  }
+  return json_unescape(raw, (char *)a->bump(raw.len));
+}
+
+// objects with more entries than this get a hash table
+#define JSON_OBJECT_SCAN_MAX 8
+
+// values and entries are gathered on these stacks while an array or object
+// is being parsed, then copied into the arena in one piece when it closes
+struct JSONParser {
+  Arena *arena;
+  JSONScanner scan;
+  Array<JSON> values;
+  Array<JSONObjectEntry> entries;
+};
+
+static String json_parse_next(JSONParser *p, JSON *out);
+
+static JSONObject *json_make_object(JSONParser *p, u64 first) {
+  Arena *a = p->arena;
+
+  JSONObject *obj = (JSONObject *)a->bump(sizeof(JSONObject));
+  *obj = {};
+  obj->len = p->entries.len - first;
+  if (obj->len > 0) {
+    u64 size = sizeof(JSONObjectEntry) * obj->len;
+    obj->entries = (JSONObjectEntry *)a->bump(size);
+    memcpy(obj->entries, &p->entries[first], size);
+  }
+  p->entries.len = first;
+
+  if (obj->len > JSON_OBJECT_SCAN_MAX) {
+    u64 cap = 16;
+    while (cap < obj->len * 2) {
+      cap *= 2;
+    }
+
+    obj->slots = (u32 *)a->bump(sizeof(u32) * cap);
+    memset(obj->slots, 0, sizeof(u32) * cap);
+    obj->slot_mask = cap - 1;
+
+    // later duplicates replace earlier ones
+    for (u64 i = 0; i < obj->len; i++) {
+      JSONObjectEntry *e = &obj->entries[i];
+      u64 slot = e->hash & obj->slot_mask;
+      while (obj->slots[slot] != 0) {
+        JSONObjectEntry *other = &obj->entries[obj->slots[slot] - 1];
+        if (other->hash == e->hash && other->key == e->key) {
+          break;
+        }
+        slot = (slot + 1) & obj->slot_mask;
+      }
+      obj->slots[slot] = (u32)i + 1;
+    }
+  }
+
+  return obj;
+}
 
-static String json_parse_object(Arena *a, JSONScanner *scan, JSONObject **out) {
+static String json_parse_object(JSONParser *p, JSONObject **out) {
   PROFILE_FUNC();
 
-  JSONObject *obj = nullptr;
+  Arena *a = p->arena;
+  JSONScanner *scan = &p->scan;
+  u64 first = p->entries.len;
 
   json_scan_next(a, scan); // eat brace
 
   while (true) {
     if (scan->token.kind == JSONTok_RBrace) {
-      *out = obj;
+      *out = json_make_object(p, first);
       json_scan_next(a, scan);
       return {};
     }
@@ -245,7 +418,7 @@ static String json_parse_object(Arena *a, JSONScanner *scan, JSONObject **out) {
     String err = {};
 
     JSON key = {};
-    err = json_parse_next(a, scan, &key);
+    err = json_parse_next(p, &key);
     if (err.data != nullptr) {
       return err;
     }
@@ -266,18 +439,16 @@ static String json_parse_object(Arena *a, JSONScanner *scan, JSONObject **out) {
     json_scan_next(a, scan);
 
     JSON value = {};
-    err = json_parse_next(a, scan, &value);
+    err = json_parse_next(p, &value);
     if (err.data != nullptr) {
       return err;
     }
 
-    JSONObject *entry = (JSONObject *)a->bump(sizeof(JSONObject));
-    entry->next = obj;
-    entry->hash = fnv1a(key.string);
-    entry->key = key.string;
-    entry->value = value;
-
-    obj = entry;
+    JSONObjectEntry entry = {};
+    entry.key = key.string;
+    entry.hash = fnv1a(key.string);
+    entry.value = value;
+    p->entries.push(entry);
 
     if (scan->token.kind == JSONTok_Comma) {
       json_scan_next(a, scan);
@@ -285,36 +456,39 @@ static String json_parse_object(Arena *a, JSONScanner *scan, JSONObject **out) {
   }
 }
 
-static String json_parse_array(Arena *a, JSONScanner *scan, JSONArray **out) {
+static String json_parse_array(JSONParser *p, JSONArray **out) {
   PROFILE_FUNC();
 
-  JSONArray *arr = nullptr;
+  Arena *a = p->arena;
+  JSONScanner *scan = &p->scan;
+  u64 first = p->values.len;
 
   json_scan_next(a, scan); // eat bracket
 
   while (true) {
     if (scan->token.kind == JSONTok_RBracket) {
+      JSONArray *arr = (JSONArray *)a->bump(sizeof(JSONArray));
+      *arr = {};
+      arr->len = p->values.len - first;
+      if (arr->len > 0) {
+        u64 size = sizeof(JSON) * arr->len;
+        arr->values = (JSON *)a->bump(size);
+        memcpy(arr->values, &p->values[first], size);
+      }
+      p->values.len = first;
+
       *out = arr;
       json_scan_next(a, scan);
       return {};
     }
 
     JSON value = {};
-    String err = json_parse_next(a, scan, &value);
+    String err = json_parse_next(p, &value);
     if (err.data != nullptr) {
       return err;
     }
 
-    JSONArray *el = (JSONArray *)a->bump(sizeof(JSONArray));
-    el->next = arr;
-    el->value = value;
-    el->index = 0;
-
-    if (arr != nullptr) {
-      el->index = arr->index + 1;
-    }
-
-    arr = el;
+    p->values.push(value);
 
     if (scan->token.kind == JSONTok_Comma) {
       json_scan_next(a, scan);
@@ -322,19 +496,22 @@ static String json_parse_array(Arena *a, JSONScanner *scan, JSONArray **out) {
   }
 }
 
-static String json_parse_next(Arena *a, JSONScanner *scan, JSON *out) {
+static String json_parse_next(JSONParser *p, JSON *out) {
+  Arena *a = p->arena;
+  JSONScanner *scan = &p->scan;
+
   switch (scan->token.kind) {
   case JSONTok_LBrace: {
     out->kind = JSONKind_Object;
-    return json_parse_object(a, scan, &out->object);
+    return json_parse_object(p, &out->object);
   }
   case JSONTok_LBracket: {
     out->kind = JSONKind_Array;
-    return json_parse_array(a, scan, &out->array);
+    return json_parse_array(p, &out->array);
   }
   case JSONTok_String: {
     out->kind = JSONKind_String;
-    out->string = scan->token.str.substr(1, scan->token.str.len - 1);
+    out->string = json_token_string(a, &scan->token);
     json_scan_next(a, scan);
     return {};
   }
@@ -383,21 +560,29 @@ static String json_parse_next(Arena *a, JSONScanner *scan, JSON *out) {
 void JSONDocument::parse(String contents) {
   PROFILE_FUNC();
 
+  // error messages are copied into the document's arena
+  ScratchArena scratch;
+
   arena = {};
 
-  JSONScanner scan = {};
-  scan.contents = contents;
-  scan.line = 1;
+  JSONParser p = {};
+  p.arena = &arena;
+  p.scan.contents = contents;
+  p.scan.line = 1;
+  defer({
+    p.values.trash();
+    p.entries.trash();
+  });
 
-  json_scan_next(&arena, &scan);
+  json_scan_next(&arena, &p.scan);
 
-  String err = json_parse_next(&arena, &scan, &root);
+  String err = json_parse_next(&p, &root);
   if (err.data != nullptr) {
     error = err;
     return;
   }
 
-  if (scan.token.kind != JSONTok_EOF) {
+  if (p.scan.token.kind != JSONTok_EOF) {
     error = "expected EOF";
     return;
   }
@@ -408,11 +593,298 @@ void JSONDocument::trash() {
   arena.trash();
 }
 
+void JSONReader::begin(String contents) {
+  input = contents;
+  offset = 0;
+  line = 1;
+  finished = true;
+}
+
+void JSONReader::feed(String chunk) {
+  assert(!finished);
+
+  if (line == 0) {
+    line = 1;
+  }
+
+  // drop what's been read. the input keeps a null terminator after it,
+  // since the scanner peeks one past the last character
+  u64 remaining = buffer.len - offset;
+  if (remaining > 0 && offset > 0) {
+    memmove(buffer.data, &buffer.data[offset], remaining);
+  }
+  buffer.len = remaining;
+  offset = 0;
+
+  u64 need = buffer.len + chunk.len + 1;
+  if (need > buffer.capacity) {
+    buffer.reserve(need > buffer.capacity * 2 ? need : buffer.capacity * 2);
+  }
+
+  memcpy(&buffer.data[buffer.len], chunk.data, chunk.len);
+  buffer.len += chunk.len;
+  buffer.data[buffer.len] = 0;
+
+  input = {buffer.data, buffer.len};
+}
+
+void JSONReader::finish() {
+  if (line == 0) {
+    line = 1;
+  }
+  finished = true;
+}
+
+// scans the next token. false if the token could continue past the end of
+// input that hasn't been finished yet
+static bool json_reader_scan(JSONReader *r, JSONToken *out) {
+  JSONScanner scan = {};
+  scan.contents = r->input.data != nullptr ? r->input : "";
+  scan.begin = r->offset;
+  scan.end = r->offset;
+  scan.line = r->line;
+  scan.column = r->column;
+
+  JSONToken tok = json_scan_next(&r->arena, &scan);
+
+  if (!r->finished) {
+    bool partial = false;
+    switch (tok.kind) {
+    case JSONTok_EOF: partial = true; break;
+    // "1." and "1e+" could be followed by more digits
+    case JSONTok_Number: partial = scan.end + 2 >= scan.contents.len; break;
+    case JSONTok_True:
+    case JSONTok_False:
+    case JSONTok_Null:
+    case JSONTok_Error: partial = scan.end == scan.contents.len; break;
+    default: break;
+    }
+
+    if (partial) {
+      return false;
+    }
+  }
+
+  r->offset = scan.end;
+  r->line = scan.line;
+  r->column = scan.column;
+  *out = tok;
+  return true;
+}
+
+static JSONEvent json_reader_fail(JSONReader *r, JSONToken tok) {
+  ScratchArena scratch;
+  String msg = {};
+  switch (tok.kind) {
+  case JSONTok_Error:
+    msg = tmp_fmt("%.*s on line %d:%d", (i32)tok.str.len, tok.str.data,
+                  (i32)tok.line, (i32)tok.column);
+    break;
+  case JSONTok_EOF:
+    msg = tmp_fmt("unexpected end of input on line %d:%d", (i32)tok.line,
+                  (i32)tok.column);
+    break;
+  default:
+    if (r->expect == JSONExpect_End) {
+      msg = tmp_fmt("expected EOF on line %d:%d", (i32)tok.line,
+                    (i32)tok.column);
+    } else {
+      msg = tmp_fmt("unexpected %s on line %d:%d", json_tok_string(tok.kind),
+                    (i32)tok.line, (i32)tok.column);
+    }
+    break;
+  }
+
+  r->error = r->arena.bump_string(msg);
+  r->event = JSONEvent_Error;
+  return r->event;
+}
+
+static JSONEvent json_reader_close(JSONReader *r, JSONEvent event) {
+  r->stack.len--;
+  r->expect = r->stack.len == 0 ? JSONExpect_End : JSONExpect_CommaOrClose;
+  r->event = event;
+  return event;
+}
+
+// escaped strings are decoded into a buffer that's reused for every event
+static String json_reader_string(JSONReader *r, JSONToken *tok) {
+  String raw = tok->str.substr(1, tok->str.len - 1);
+  if (memchr(raw.data, '\\', raw.len) == nullptr) {
+    return raw;
+  }
+
+  r->unescaped.reserve(raw.len);
+  return json_unescape(raw, r->unescaped.data);
+}
+
+// JSONEvent_Error if the token doesn't start a value
+static JSONEvent json_reader_value(JSONReader *r, JSONToken tok) {
+  JSONEvent event = JSONEvent_Error;
+  switch (tok.kind) {
+  case JSONTok_LBrace:
+    r->stack.push(true);
+    r->expect = JSONExpect_KeyOrClose;
+    r->event = JSONEvent_ObjectBegin;
+    return r->event;
+  case JSONTok_LBracket:
+    r->stack.push(false);
+    r->expect = JSONExpect_ValueOrClose;
+    r->event = JSONEvent_ArrayBegin;
+    return r->event;
+  case JSONTok_String:
+    r->string = json_reader_string(r, &tok);
+    event = JSONEvent_String;
+    break;
+  case JSONTok_Number:
+    r->number = string_to_double(tok.str);
+    event = JSONEvent_Number;
+    break;
+  case JSONTok_True:
+    r->boolean = true;
+    event = JSONEvent_Boolean;
+    break;
+  case JSONTok_False:
+    r->boolean = false;
+    event = JSONEvent_Boolean;
+    break;
+  case JSONTok_Null: event = JSONEvent_Null; break;
+  default: return JSONEvent_Error;
+  }
+
+  r->expect = r->stack.len == 0 ? JSONExpect_End : JSONExpect_CommaOrClose;
+  r->event = event;
+  return event;
+}
+
+JSONEvent JSONReader::next() {
+  if (event == JSONEvent_End || event == JSONEvent_Error) {
+    return event;
+  }
+
+  while (true) {
+    JSONToken tok = {};
+    if (!json_reader_scan(this, &tok)) {
+      event = JSONEvent_More;
+      return event;
+    }
+
+    if (tok.kind == JSONTok_Error) {
+      return json_reader_fail(this, tok);
+    }
+
+    bool object = stack.len > 0 && stack[stack.len - 1];
+
+    switch (expect) {
+    case JSONExpect_Colon:
+      if (tok.kind == JSONTok_Colon) {
+        expect = JSONExpect_Value;
+        continue;
+      }
+      break;
+    case JSONExpect_CommaOrClose:
+      if (tok.kind == JSONTok_Comma) {
+        expect = object ? JSONExpect_Key : JSONExpect_Value;
+        continue;
+      }
+      if (tok.kind == JSONTok_RBrace && object) {
+        return json_reader_close(this, JSONEvent_ObjectEnd);
+      }
+      if (tok.kind == JSONTok_RBracket && !object) {
+        return json_reader_close(this, JSONEvent_ArrayEnd);
+      }
+      break;
+    case JSONExpect_End:
+      if (tok.kind == JSONTok_EOF) {
+        event = JSONEvent_End;
+        return event;
+      }
+      break;
+    case JSONExpect_KeyOrClose:
+      if (tok.kind == JSONTok_RBrace) {
+        return json_reader_close(this, JSONEvent_ObjectEnd);
+      }
+      // fallthrough
+    case JSONExpect_Key:
+      if (tok.kind == JSONTok_String) {
+        string = json_reader_string(this, &tok);
+        expect = JSONExpect_Colon;
+        event = JSONEvent_Key;
+        return event;
+      }
+      break;
+    case JSONExpect_ValueOrClose:
+      if (tok.kind == JSONTok_RBracket) {
+        return json_reader_close(this, JSONEvent_ArrayEnd);
+      }
+      // fallthrough
+    case JSONExpect_Value: {
+      JSONEvent e = json_reader_value(this, tok);
+      if (e != JSONEvent_Error) {
+        return e;
+      }
+      break;
+    }
+    }
+
+    return json_reader_fail(this, tok);
+  }
+}
+
+JSONEvent JSONReader::skip() {
+  if (!skipping) {
+    if (event == JSONEvent_Key) {
+      skip_depth = stack.len;
+    } else if (event == JSONEvent_ObjectBegin ||
+               event == JSONEvent_ArrayBegin) {
+      skip_depth = stack.len - 1;
+    } else {
+      return event;
+    }
+    skipping = true;
+  }
+
+  while (true) {
+    JSONEvent e = next();
+    if (e == JSONEvent_More) {
+      return e;
+    }
+
+    bool begin = e == JSONEvent_ObjectBegin || e == JSONEvent_ArrayBegin;
+    if (e == JSONEvent_Error || (stack.len == skip_depth && !begin)) {
+      skipping = false;
+      return e;
+    }
+  }
+}
+
+void JSONReader::trash() {
+  buffer.trash();
+  unescaped.trash();
+  stack.trash();
+  arena.trash();
+}
+
 JSON JSON::lookup(String key, bool *ok) {
   if (*ok && kind == JSONKind_Object) {
-    for (JSONObject *o = object; o != nullptr; o = o->next) {
-      if (o->hash == fnv1a(key)) {
-        return o->value;
+    u64 hash = fnv1a(key);
+
+    if (object->slots != nullptr) {
+      u64 slot = hash & object->slot_mask;
+      while (object->slots[slot] != 0) {
+        JSONObjectEntry *e = &object->entries[object->slots[slot] - 1];
+        if (e->hash == hash && e->key == key) {
+          return e->value;
+        }
+        slot = (slot + 1) & object->slot_mask;
+      }
+    } else {
+      // backwards, so later duplicates win like in the table
+      for (u64 i = object->len; i > 0; i--) {
+        JSONObjectEntry *e = &object->entries[i - 1];
+        if (e->hash == hash && e->key == key) {
+          return e->value;
+        }
       }
     }
   }
@@ -422,12 +894,8 @@ JSON JSON::lookup(String key, bool *ok) {
 }
 
 JSON JSON::index(i32 i, bool *ok) {
-  if (*ok && kind == JSONKind_Array) {
-    for (JSONArray *a = array; a != nullptr; a = a->next) {
-      if (a->index == i) {
-        return a->value;
-      }
-    }
+  if (*ok && kind == JSONKind_Array && i >= 0 && (u64)i < array->len) {
+    return array->values[i];
   }
 
   *ok = false;
@@ -494,10 +962,10 @@ static void json_write_string(StringBuilder &sb, JSON *json, i32 level) {
   switch (json->kind) {
   case JSONKind_Object: {
     sb << "{\n";
-    for (JSONObject *o = json->object; o != nullptr; o = o->next) {
+    for (JSONObjectEntry &e : *json->object) {
       sb.concat("  ", level);
-      sb << o->key;
-      json_write_string(sb, &o->value, level + 1);
+      sb << e.key;
+      json_write_string(sb, &e.value, level + 1);
       sb << ",\n";
     }
     sb.concat("  ", level - 1);
@@ -506,9 +974,9 @@ static void json_write_string(StringBuilder &sb, JSON *json, i32 level) {
   }
   case JSONKind_Array: {
     sb << "[\n";
-    for (JSONArray *a = json->array; a != nullptr; a = a->next) {
+    for (JSON &value : *json->array) {
       sb.concat("  ", level);
-      json_write_string(sb, &a->value, level + 1);
+      json_write_string(sb, &value, level + 1);
       sb << ",\n";
     }
     sb.concat("  ", level - 1);
@@ -524,6 +992,7 @@ static void json_write_string(StringBuilder &sb, JSON *json, i32 level) {
 }
 
 void json_write_string(StringBuilder *sb, JSON *json) {
+  ScratchArena scratch;
   json_write_string(*sb, json, 1);
 }
 
@@ -534,22 +1003,53 @@ void json_print(JSON *json) {
   printf("%s\n", sb.data);
 }
 
-void json_to_lua(lua_State *L, JSON *json) {
+// object keys seen recently, kept in lua stack slots. a repeated key is
+// copied from its slot instead of being hashed and interned again
+#define JSON_KEY_CACHE_SIZE 256
+
+struct JSONKeyCache {
+  i32 base; // stack index of the first slot
+  u64 hashes[JSON_KEY_CACHE_SIZE];
+  String keys[JSON_KEY_CACHE_SIZE];
+};
+
+// deeper values are an error instead of running out of C stack
+#define JSON_READ_LUA_MAX_DEPTH 1000
+
+static bool json_to_lua(lua_State *L, JSON *json, JSONKeyCache *cache,
+                        i32 depth) {
+  if (depth > JSON_READ_LUA_MAX_DEPTH || !lua_checkstack(L, 3)) {
+    return false;
+  }
+
   switch (json->kind) {
   case JSONKind_Object: {
-    lua_newtable(L);
-    for (JSONObject *o = json->object; o != nullptr; o = o->next) {
-      lua_pushlstring(L, o->key.data, o->key.len);
-      json_to_lua(L, &o->value);
+    lua_createtable(L, 0, (i32)json->object->len);
+    for (JSONObjectEntry &e : *json->object) {
+      u64 slot = e.hash & (JSON_KEY_CACHE_SIZE - 1);
+      if (cache->hashes[slot] == e.hash && cache->keys[slot] == e.key) {
+        lua_pushvalue(L, cache->base + (i32)slot);
+      } else {
+        lua_pushlstring(L, e.key.data, e.key.len);
+        lua_copy(L, -1, cache->base + (i32)slot);
+        cache->hashes[slot] = e.hash;
+        cache->keys[slot] = e.key;
+      }
+
+      if (!json_to_lua(L, &e.value, cache, depth + 1)) {
+        return false;
+      }
       lua_rawset(L, -3);
     }
     break;
   }
   case JSONKind_Array: {
-    lua_newtable(L);
-    for (JSONArray *a = json->array; a != nullptr; a = a->next) {
-      json_to_lua(L, &a->value);
-      lua_rawseti(L, -2, a->index + 1);
+    lua_createtable(L, (i32)json->array->len, 0);
+    for (u64 i = 0; i < json->array->len; i++) {
+      if (!json_to_lua(L, &json->array->values[i], cache, depth + 1)) {
+        return false;
+      }
+      lua_rawseti(L, -2, i + 1);
     }
     break;
   }
@@ -571,138 +1071,624 @@ void json_to_lua(lua_State *L, JSON *json) {
   }
   default: break;
   }
+
+  return true;
 }
 
-static void lua_to_json_string(StringBuilder &sb, lua_State *L,
-                               HashMap<bool> *visited, String *err, i32 width,
-                               i32 level) {
-  auto indent = [&](i32 offset) {
-    if (width > 0) {
-      sb << "\n";
-      sb.concat(" ", width * (level + offset));
+bool json_to_lua(lua_State *L, JSON *json) {
+  PROFILE_FUNC();
+
+  i32 top = lua_gettop(L);
+  if (!lua_checkstack(L, JSON_KEY_CACHE_SIZE + 1)) {
+    return false;
+  }
+
+  JSONKeyCache cache = {};
+  cache.base = top + 1;
+  for (i32 i = 0; i < JSON_KEY_CACHE_SIZE; i++) {
+    lua_pushnil(L);
+  }
+
+  bool ok = json_to_lua(L, json, &cache, 0);
+  if (ok) {
+    lua_replace(L, top + 1);
+  }
+  lua_settop(L, ok ? top + 1 : top);
+  return ok;
+}
+
+static bool json_read_lua(lua_State *L, JSONReader *r, JSONEvent e) {
+  if (r->stack.len > JSON_READ_LUA_MAX_DEPTH || !lua_checkstack(L, 3)) {
+    r->error = "json is nested too deeply";
+    r->event = JSONEvent_Error;
+    return false;
+  }
+
+  switch (e) {
+  case JSONEvent_ObjectBegin: {
+    lua_newtable(L);
+    while (true) {
+      e = r->next();
+      if (e == JSONEvent_ObjectEnd) {
+        return true;
+      }
+      if (e != JSONEvent_Key) {
+        return false;
+      }
+
+      lua_pushlstring(L, r->string.data, r->string.len);
+      if (!json_read_lua(L, r, r->next())) {
+        return false;
+      }
+      lua_rawset(L, -3);
     }
-  };
+  }
+  case JSONEvent_ArrayBegin: {
+    lua_newtable(L);
+    for (lua_Integer i = 1;; i++) {
+      e = r->next();
+      if (e == JSONEvent_ArrayEnd) {
+        return true;
+      }
+      if (!json_read_lua(L, r, e)) {
+        return false;
+      }
+      lua_rawseti(L, -2, i);
+    }
+  }
+  case JSONEvent_String: {
+    lua_pushlstring(L, r->string.data, r->string.len);
+    return true;
+  }
+  case JSONEvent_Number: {
+    lua_pushnumber(L, r->number);
+    return true;
+  }
+  case JSONEvent_Boolean: {
+    lua_pushboolean(L, r->boolean);
+    return true;
+  }
+  case JSONEvent_Null: {
+    lua_pushnil(L);
+    return true;
+  }
+  default: return false;
+  }
+}
+
+bool json_read_lua(lua_State *L, JSONReader *r) {
+  PROFILE_FUNC();
+
+  i32 top = lua_gettop(L);
+  u64 offset = r->offset;
+  u32 line = r->line;
+  u32 column = r->column;
+  u64 depth = r->stack.len;
+  JSONExpect expect = r->expect;
+
+  if (json_read_lua(L, r, r->next())) {
+    return true;
+  }
+
+  lua_settop(L, top);
+
+  // nested values only push onto the stack, so the entries below depth
+  // are the same as before
+  if (r->event == JSONEvent_More) {
+    r->offset = offset;
+    r->line = line;
+    r->column = column;
+    r->stack.len = depth;
+    r->expect = expect;
+  }
+
+  return false;
+}
+
+// written to the file once the buffer gets this big
+#define JSON_WRITE_FLUSH_SIZE (64 * 1024)
+
+// deeper tables are an error instead of running out of C stack
+#define JSON_WRITE_MAX_DEPTH 1000
+
+static void json_put(JSONWriter *w, const char *data, u64 len) {
+  if (w->file != nullptr && w->buf.len + len > JSON_WRITE_FLUSH_SIZE) {
+    w->flush();
+    if (len > JSON_WRITE_FLUSH_SIZE) {
+      w->failed |= fwrite(data, 1, len, w->file) != len;
+      return;
+    }
+  }
+
+  u64 need = w->buf.len + len;
+  if (need > w->buf.capacity) {
+    u64 cap = w->buf.capacity > 0 ? w->buf.capacity * 2 : 256;
+    w->buf.reserve(cap > need ? cap : need);
+  }
+
+  memcpy(&w->buf.data[w->buf.len], data, len);
+  w->buf.len += len;
+}
+
+static void json_put(JSONWriter *w, char c) { json_put(w, &c, 1); }
+
+static void json_put_indent(JSONWriter *w, i32 level) {
+  json_put(w, '\n');
+  for (i32 i = 0; i < w->width * level; i++) {
+    json_put(w, ' ');
+  }
+}
+
+static void json_put_string(JSONWriter *w, String s) {
+  json_put(w, '"');
+
+  u64 run = 0;
+  for (u64 i = 0; i < s.len; i++) {
+    u8 c = (u8)s.data[i];
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+
+    json_put(w, &s.data[run], i - run);
+    run = i + 1;
+
+    switch (c) {
+    case '"': json_put(w, "\\\"", 2); break;
+    case '\\': json_put(w, "\\\\", 2); break;
+    case '\b': json_put(w, "\\b", 2); break;
+    case '\f': json_put(w, "\\f", 2); break;
+    case '\n': json_put(w, "\\n", 2); break;
+    case '\r': json_put(w, "\\r", 2); break;
+    case '\t': json_put(w, "\\t", 2); break;
+    default: {
+      const char *hex = "0123456789abcdef";
+      char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+      json_put(w, esc, sizeof(esc));
+      break;
+    }
+    }
+  }
+
+  json_put(w, &s.data[run], s.len - run);
+  json_put(w, '"');
+}
 
-  if (err->len != 0) {
+// floats use the shortest form that reads back as the same double. whole
+// numbers are written as integers, since the shortest form of 100000 is 1e+05
+static void json_put_double(JSONWriter *w, double n) {
+  if (!isfinite(n)) {
+    json_put(w, "null", 4); // json has no inf or nan
     return;
   }
 
+  char buf[32];
+  std::to_chars_result res = {};
+  if (n == trunc(n) && fabs(n) < 9007199254740992.0) {
+    res = std::to_chars(buf, buf + sizeof(buf), (i64)n);
+  } else {
+    res = std::to_chars(buf, buf + sizeof(buf), n);
+  }
+  json_put(w, buf, res.ptr - buf);
+}
+
+static void json_put_integer(JSONWriter *w, i64 n) {
+  char buf[32];
+  std::to_chars_result res = std::to_chars(buf, buf + sizeof(buf), n);
+  json_put(w, buf, res.ptr - buf);
+}
+
+// integers are written exactly
+static void json_put_number(JSONWriter *w, lua_State *L, i32 arg) {
+  if (lua_isinteger(L, arg)) {
+    json_put_integer(w, lua_tointeger(L, arg));
+  } else {
+    json_put_double(w, lua_tonumber(L, arg));
+  }
+}
+
+// writes the value on top of the stack. on error, the stack is left for
+// JSONWriter::write_lua to clean up
+template <bool Pretty>
+static void json_write_lua(JSONWriter *w, lua_State *L, String *err,
+                           i32 level) {
   i32 top = lua_gettop(L);
   switch (lua_type(L, top)) {
   case LUA_TTABLE: {
-    uintptr_t ptr = (uintptr_t)lua_topointer(L, top);
+    const void *ptr = lua_topointer(L, top);
+    for (const void *t : w->tables) {
+      if (t == ptr) {
+        *err = "table has cycles";
+        return;
+      }
+    }
 
-    bool *visit = nullptr;
-    bool exist = visited->find_or_insert(ptr, &visit);
-    if (exist && *visit) {
-      *err = "table has cycles";
+    if (w->tables.len == JSON_WRITE_MAX_DEPTH || !lua_checkstack(L, 3)) {
+      *err = "table is nested too deeply";
       return;
     }
 
-    *visit = true;
+    w->tables.push(ptr);
 
     lua_pushnil(L);
-    if (lua_next(L, -2) == 0) {
-      sb << "[]";
+    if (lua_next(L, top) == 0) {
+      json_put(w, "[]", 2);
+      w->tables.len--;
       return;
     }
 
     i32 key_type = lua_type(L, -2);
-
     if (key_type == LUA_TNUMBER) {
-      sb << "[";
-
-      indent(0);
-      lua_to_json_string(sb, L, visited, err, width, level + 1);
+      lua_pop(L, 2); // key, value
 
-      i32 len = luax_len(L, top);
-      assert(len > 0);
-      i32 i = 1;
-      for (lua_pop(L, 1); lua_next(L, -2); lua_pop(L, 1)) {
+      // every key has to be an index up to the length. values are written
+      // in index order, which lua_next doesn't promise
+      lua_Integer len = (lua_Integer)lua_rawlen(L, top);
+      lua_Integer count = 0;
+      for (lua_pushnil(L); lua_next(L, top); lua_pop(L, 1)) {
         if (lua_type(L, -2) != LUA_TNUMBER) {
-          lua_pop(L, -2);
           *err = "expected all keys to be numbers";
           return;
         }
 
-        sb << ",";
-        indent(0);
-        lua_to_json_string(sb, L, visited, err, width, level + 1);
-        i++;
+        lua_Integer i = lua_tointeger(L, -2);
+        if (!lua_isinteger(L, -2) || i < 1 || i > len) {
+          *err = "array is not continuous";
+          return;
+        }
+        count++;
       }
-      indent(-1);
-      sb << "]";
 
-      if (i != len) {
+      if (count != len) {
         *err = "array is not continuous";
         return;
       }
-    } else if (key_type == LUA_TSTRING) {
-      sb << "{";
-      indent(0);
 
-      lua_pushvalue(L, -2);
-      lua_to_json_string(sb, L, visited, err, width, level + 1);
-      lua_pop(L, 1);
-      sb << ":";
-      if (width > 0) {
-        sb << " ";
+      json_put(w, '[');
+      for (lua_Integer i = 1; i <= len; i++) {
+        if (i > 1) {
+          json_put(w, ',');
+        }
+        if (Pretty) {
+          json_put_indent(w, level);
+        }
+
+        lua_rawgeti(L, top, i);
+        json_write_lua<Pretty>(w, L, err, level + 1);
+        if (err->len != 0) {
+          return;
+        }
+        lua_pop(L, 1);
+      }
+      if (Pretty) {
+        json_put_indent(w, level - 1);
       }
-      lua_to_json_string(sb, L, visited, err, width, level + 1);
+      json_put(w, ']');
+    } else if (key_type == LUA_TSTRING) {
+      json_put(w, '{');
 
-      for (lua_pop(L, 1); lua_next(L, -2); lua_pop(L, 1)) {
+      bool first = true;
+      do {
         if (lua_type(L, -2) != LUA_TSTRING) {
-          lua_pop(L, -2);
           *err = "expected all keys to be strings";
           return;
         }
 
-        sb << ",";
-        indent(0);
+        if (!first) {
+          json_put(w, ',');
+        }
+        first = false;
 
-        lua_pushvalue(L, -2);
-        lua_to_json_string(sb, L, visited, err, width, level + 1);
-        lua_pop(L, 1);
-        sb << ":";
-        if (width > 0) {
-          sb << " ";
+        if (Pretty) {
+          json_put_indent(w, level);
+        }
+
+        size_t len = 0;
+        const char *key = lua_tolstring(L, -2, &len);
+        json_put_string(w, {key, len});
+        json_put(w, ':');
+        if (Pretty) {
+          json_put(w, ' ');
+        }
+
+        json_write_lua<Pretty>(w, L, err, level + 1);
+        if (err->len != 0) {
+          return;
         }
-        lua_to_json_string(sb, L, visited, err, width, level + 1);
+        lua_pop(L, 1);
+      } while (lua_next(L, top));
+
+      if (Pretty) {
+        json_put_indent(w, level - 1);
       }
-      indent(-1);
-      sb << "}";
+      json_put(w, '}');
     } else {
-      lua_pop(L, 2); // key, value
       *err = "expected table keys to be strings or numbers";
       return;
     }
 
-    visited->unset(ptr);
+    w->tables.len--;
+    break;
+  }
+  case LUA_TNIL: json_put(w, "null", 4); break;
+  case LUA_TNUMBER: json_put_number(w, L, top); break;
+  case LUA_TSTRING: {
+    size_t len = 0;
+    const char *str = lua_tolstring(L, top, &len);
+    json_put_string(w, {str, len});
+    break;
+  }
+  case LUA_TBOOLEAN: {
+    if (lua_toboolean(L, top)) {
+      json_put(w, "true", 4);
+    } else {
+      json_put(w, "false", 5);
+    }
     break;
   }
-  case LUA_TNIL: sb << "null"; break;
-  case LUA_TNUMBER: sb << tmp_fmt("%g", lua_tonumber(L, top)); break;
-  case LUA_TSTRING: sb << "\"" << luax_check_string(L, top) << "\""; break;
-  case LUA_TBOOLEAN: sb << (lua_toboolean(L, top) ? "true" : "false"); break;
   default: *err = "type is not serializable";
   }
 }
 
-String lua_to_json_string(lua_State *L, i32 arg, String *contents, i32 width) {
-  StringBuilder sb = {};
+String JSONWriter::write_lua(lua_State *L, i32 arg) {
+  PROFILE_FUNC();
 
-  HashMap<bool> visited = {};
-  defer(visited.trash());
+  i32 top = lua_gettop(L);
+  lua_pushvalue(L, arg);
+  tables.len = 0;
 
   String err = {};
-  lua_pushvalue(L, arg);
-  lua_to_json_string(sb, L, &visited, &err, width, 1);
-  lua_pop(L, 1);
+  if (width > 0) {
+    json_write_lua<true>(this, L, &err, 1);
+  } else {
+    json_write_lua<false>(this, L, &err, 1);
+  }
 
-  if (err.len != 0) {
-    sb.trash();
+  lua_settop(L, top);
+
+  if (err.len == 0 && file != nullptr) {
+    flush();
   }
+  return err;
+}
+
+// same output as json_write_lua. table entries are in no particular order,
+// so array entries are sorted by index into w->order first
+template <bool Pretty>
+static void json_write_variant(JSONWriter *w, LuaVariant *v, String *err,
+                               i32 level) {
+  switch (v->type) {
+  case LUA_TTABLE: {
+    Slice<LuaTableEntry> table = v->table;
+    if (table.len == 0) {
+      json_put(w, "[]", 2);
+      return;
+    }
+
+    if (level > JSON_WRITE_MAX_DEPTH) {
+      *err = "table is nested too deeply";
+      return;
+    }
 
-  *contents = String(sb);
+    if (table[0].key.type == LUA_TNUMBER) {
+      u64 first = w->order.len;
+      w->order.resize(first + table.len);
+      for (u64 i = 0; i < table.len; i++) {
+        w->order[first + i] = -1;
+      }
+
+      // keys are unique, so if each one is an index up to the length, every
+      // index is there once
+      for (u64 i = 0; i < table.len; i++) {
+        LuaVariant *key = &table[i].key;
+        if (key->type != LUA_TNUMBER) {
+          *err = "expected all keys to be numbers";
+          return;
+        }
+
+        i64 n = key->is_integer ? key->integer : 0;
+        if (n < 1 || n > (i64)table.len) {
+          *err = "array is not continuous";
+          return;
+        }
+        w->order[first + n - 1] = (i32)i;
+      }
+
+      json_put(w, '[');
+      for (u64 i = 0; i < table.len; i++) {
+        if (i > 0) {
+          json_put(w, ',');
+        }
+        if (Pretty) {
+          json_put_indent(w, level);
+        }
+
+        LuaVariant *value = &table[w->order[first + i]].value;
+        json_write_variant<Pretty>(w, value, err, level + 1);
+        if (err->len != 0) {
+          return;
+        }
+      }
+      if (Pretty) {
+        json_put_indent(w, level - 1);
+      }
+      json_put(w, ']');
+
+      w->order.len = first;
+    } else if (table[0].key.type == LUA_TSTRING) {
+      json_put(w, '{');
+
+      for (u64 i = 0; i < table.len; i++) {
+        LuaTableEntry *e = &table[i];
+        if (e->key.type != LUA_TSTRING) {
+          *err = "expected all keys to be strings";
+          return;
+        }
+
+        if (i > 0) {
+          json_put(w, ',');
+        }
+        if (Pretty) {
+          json_put_indent(w, level);
+        }
+
+        json_put_string(w, e->key.string);
+        json_put(w, ':');
+        if (Pretty) {
+          json_put(w, ' ');
+        }
+
+        json_write_variant<Pretty>(w, &e->value, err, level + 1);
+        if (err->len != 0) {
+          return;
+        }
+      }
+
+      if (Pretty) {
+        json_put_indent(w, level - 1);
+      }
+      json_put(w, '}');
+    } else {
+      *err = "expected table keys to be strings or numbers";
+    }
+    break;
+  }
+  case LUA_TNIL: json_put(w, "null", 4); break;
+  case LUA_TNUMBER: {
+    if (v->is_integer) {
+      json_put_integer(w, v->integer);
+    } else {
+      json_put_double(w, v->number);
+    }
+    break;
+  }
+  case LUA_TSTRING: json_put_string(w, v->string); break;
+  case LUA_TBOOLEAN: {
+    if (v->boolean) {
+      json_put(w, "true", 4);
+    } else {
+      json_put(w, "false", 5);
+    }
+    break;
+  }
+  default: *err = "type is not serializable";
+  }
+}
+
+String JSONWriter::write_variant(LuaVariant *v) {
+  PROFILE_FUNC();
+
+  order.len = 0;
+
+  String err = {};
+  if (width > 0) {
+    json_write_variant<true>(this, v, &err, 1);
+  } else {
+    json_write_variant<false>(this, v, &err, 1);
+  }
+
+  if (err.len == 0 && file != nullptr) {
+    flush();
+  }
   return err;
 }
+
+void JSONWriter::flush() {
+  if (file != nullptr && buf.len > 0) {
+    failed |= fwrite(buf.data, 1, buf.len, file) != buf.len;
+    buf.len = 0;
+  }
+}
+
+void JSONWriter::trash() {
+  buf.trash();
+  tables.trash();
+  order.trash();
+}
+
+static thread_local JSONWriter t_json_writer;
+
+JSONWriter *json_writer() { return &t_json_writer; }
+
+void json_writer_trash() {
+  t_json_writer.trash();
+  t_json_writer = {};
+}
+
+static void json_job_proc(void *udata) {
+  PROFILE_FUNC();
+
+  JSONJob *job = (JSONJob *)udata;
+
+  switch (job->kind) {
+  case JSONJobKind_Read: {
+    if (job->path.len != 0 &&
+        !vfs_read_entire_file(&job->contents, job->path)) {
+      job->error = "failed to read file";
+      break;
+    }
+
+    job->doc.parse(job->contents);
+    job->error = job->doc.error;
+    break;
+  }
+  case JSONJobKind_Write: {
+    job->error = job->writer.write_variant(&job->value);
+
+    // the snapshot isn't needed anymore
+    job->value.trash();
+    job->value = {};
+    break;
+  }
+  }
+
+  job->done.store(true, std::memory_order_release);
+  json_job_release(job);
+}
+
+static JSONJob *json_job_make(JSONJobKind kind) {
+  JSONJob *job = (JSONJob *)mem_alloc(sizeof(JSONJob));
+  memset(job, 0, sizeof(JSONJob));
+  new (&job->refs) std::atomic<i32>(2); // the caller and the job
+  new (&job->done) std::atomic<bool>();
+  job->kind = kind;
+  return job;
+}
+
+JSONJob *json_read_async(String contents, String path) {
+  JSONJob *job = json_job_make(JSONJobKind_Read);
+  job->contents = contents;
+  job->path = path;
+
+  jobs_push(json_job_proc, job);
+  return job;
+}
+
+JSONJob *json_write_async(lua_State *L, i32 arg, i32 width) {
+  PROFILE_FUNC();
+
+  JSONJob *job = json_job_make(JSONJobKind_Write);
+  job->writer.width = width;
+
+  if (!job->value.make(L, arg)) {
+    job->value.trash();
+    job->value = {};
+    job->error = "table has cycles or is nested too deeply";
+    job->done.store(true, std::memory_order_release);
+    json_job_release(job);
+    return job;
+  }
+
+  jobs_push(json_job_proc, job);
+  return job;
+}
+
+void json_job_release(JSONJob *job) {
+  if (job->refs.fetch_sub(1) == 1) {
+    job->doc.trash();
+    mem_free(job->contents.data);
+    mem_free(job->path.data);
+    job->value.trash();
+    job->writer.trash();
+    mem_free(job);
+  }
+}
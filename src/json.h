@@ -1,6 +1,9 @@
 #pragma once
 
 #include "arena.h"
+#include "array.h"
+#include "concurrency.h"
+#include <atomic>
 
 enum JSONKind : i32 {
   JSONKind_Null,
@@ -39,17 +42,31 @@ struct JSON {
   double index_number(i32 i, bool *ok);
 };
 
-struct JSONObject {
-  JSON value;
+struct JSONObjectEntry {
   String key;
-  JSONObject *next;
   u64 hash;
+  JSON value;
+};
+
+// entries are in document order. larger objects also get an open addressed
+// table of entry indices, so lookups don't scan every key
+struct JSONObject {
+  JSONObjectEntry *entries;
+  u64 len;
+  u32 *slots; // entry index + 1, or 0 if empty. nullptr for small objects
+  u64 slot_mask;
+
+  JSONObjectEntry *begin() { return entries; }
+  JSONObjectEntry *end() { return &entries[len]; }
 };
 
 struct JSONArray {
-  JSON value;
-  JSONArray *next;
-  u64 index;
+  JSON *values;
+  u64 len;
+
+  JSON &operator[](u64 i) { return values[i]; }
+  JSON *begin() { return values; }
+  JSON *end() { return &values[len]; }
 };
 
 struct JSONDocument {
@@ -61,10 +78,133 @@ struct JSONDocument {
   void trash();
 };
 
+enum JSONEvent : i32 {
+  JSONEvent_More, // chunked input ran out. feed more, then call next again
+  JSONEvent_ObjectBegin,
+  JSONEvent_ObjectEnd,
+  JSONEvent_ArrayBegin,
+  JSONEvent_ArrayEnd,
+  JSONEvent_Key,
+  JSONEvent_String,
+  JSONEvent_Number,
+  JSONEvent_Boolean,
+  JSONEvent_Null,
+  JSONEvent_End,
+  JSONEvent_Error,
+};
+
+enum JSONExpect : i32 {
+  JSONExpect_Value,
+  JSONExpect_ValueOrClose, // after [
+  JSONExpect_Key,
+  JSONExpect_KeyOrClose, // after {
+  JSONExpect_Colon,
+  JSONExpect_CommaOrClose,
+  JSONExpect_End,
+};
+
+// pull parser. reports one event per call to next without building a
+// document. input is either the whole document (begin), or arrives in
+// pieces (feed, then finish). keys and strings point into the input, which
+// is copied into buffer when it's fed, or into unescaped if they have
+// escape sequences. either way, they're valid until the next event
+struct JSONReader {
+  JSONEvent event;
+  String string; // key or string
+  double number;
+  bool boolean;
+  String error;
+
+  String input;
+  u64 offset;
+  u32 line;
+  u32 column;
+  bool finished; // no more input after what's in the buffer
+  Array<char> buffer;
+  Array<char> unescaped;
+  Array<bool> stack; // true for objects, false for arrays
+  JSONExpect expect;
+  bool skipping;
+  u64 skip_depth;
+  Arena arena; // error messages
+
+  void begin(String contents);
+  void feed(String chunk);
+  void finish();
+  JSONEvent next();
+
+  // skips the rest of the value the last event started. after a key, skips
+  // its value. returns the event that ended it, or JSONEvent_More if the
+  // input ran out, in which case call skip again after the next feed
+  JSONEvent skip();
+
+  u64 depth() { return stack.len; }
+  void trash();
+};
+
 struct StringBuilder;
 void json_write_string(StringBuilder *sb, JSON *json);
 void json_print(JSON *json);
 
 struct lua_State;
-void json_to_lua(lua_State *L, JSON *json);
-String lua_to_json_string(lua_State *L, i32 arg, String *contents, i32 width);
+
+// false if the value is nested too deeply, in which case nothing is pushed
+bool json_to_lua(lua_State *L, JSON *json);
+
+// reads the next value from the reader and pushes it. returns false and
+// pushes nothing if the next event doesn't start a value. if the input ran
+// out partway, the reader is rewound to before the value
+bool json_read_lua(lua_State *L, JSONReader *r);
+
+// serializes lua values into buf. if file is set, buf is written to it in
+// pieces as it fills, so the whole output is never in memory at once
+struct JSONWriter {
+  Array<char> buf;
+  FILE *file;
+  bool failed; // a write to file failed
+  i32 width;   // spaces per indent level. 0 for compact output
+  Array<const void *> tables; // being written, to catch cycles
+  Array<i32> order;           // entry indices of variant arrays
+
+  // returns an error message, or an empty string on success
+  String write_lua(lua_State *L, i32 arg);
+  String write_variant(LuaVariant *v);
+  void flush();
+  void trash();
+};
+
+// kept per thread, so the buffer is reused between calls
+JSONWriter *json_writer();
+void json_writer_trash();
+
+enum JSONJobKind : i32 {
+  JSONJobKind_Read,
+  JSONJobKind_Write,
+};
+
+// parses or serializes on a worker. reads are turned into lua tables on
+// the thread that asks for the result. writes work on a snapshot of the
+// value, taken when the job starts
+struct JSONJob {
+  std::atomic<i32> refs;
+  std::atomic<bool> done;
+  JSONJobKind kind;
+  String error; // static string, or in doc.arena
+
+  // read
+  String path; // empty if contents was given directly
+  String contents;
+  JSONDocument doc;
+
+  // write
+  LuaVariant value;
+  JSONWriter writer;
+};
+
+// takes ownership of contents or path
+JSONJob *json_read_async(String contents, String path);
+
+// the value is copied before this returns
+JSONJob *json_write_async(lua_State *L, i32 arg, i32 width);
+
+void json_job_release(JSONJob *job);
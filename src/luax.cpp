@@ -1,5 +1,6 @@
 #include "luax.h"
 #include "app.h"
+#include "arena.h"
 #include "profile.h"
 #include "strings.h"
 #include "vfs.h"
@@ -32,8 +33,8 @@ i32 luax_require_script(lua_State *L, String filepath) {
     return LUA_REFNIL;
   }
 
-  String path = to_cstr(filepath);
-  defer(mem_free(path.data));
+  ScratchArena scratch;
+  String path = scratch.bump_string(filepath);
 
   String contents;
   bool ok = vfs_read_entire_file(&contents, filepath);
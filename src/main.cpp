@@ -1,5 +1,6 @@
 #include "api.h"
 #include "app.h"
+#include "arena.h"
 #include "array.h"
 #include "assets.h"
 #include "concurrency.h"
@@ -13,6 +14,8 @@
 #include "draw.h"
 #include "font.h"
 #include "http.h"
+#include "jobs.h"
+#include "json.h"
 #include "luax.h"
 #include "microui.h"
 #ifndef NO_NUKLEAR
@@ -22,6 +25,7 @@
 #include "prelude.h"
 #include "profile.h"
 #include "sync.h"
+#include "tilemap.h"
 #include "vfs.h"
 
 #if defined(IS_LINUX) || defined(__linux__) || defined(__ANDROID__)
@@ -47,7 +51,9 @@ static void init() {
 
     sg_desc sg = {};
     sg.logger.func = slog_func;
-    sg.context = sapp_sgcontext();
+    if (!g_app->headless) {
+      sg.context = sapp_sgcontext();
+    }
     sg_setup(sg);
 
     sgl_desc_t sgl = {};
@@ -61,6 +67,8 @@ static void init() {
     sg_pipline.colors[0].blend.dst_factor_rgb =
         SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA;
     g_pipeline = sgl_make_pipeline(sg_pipline);
+
+    renderer_setup();
   }
 
   {
@@ -72,6 +80,7 @@ static void init() {
     ma_config.channels = 2;
     ma_config.sampleRate = 44100;
     ma_config.pResourceManagerVFS = g_app->miniaudio_vfs;
+    ma_config.noDevice = g_app->headless;
     ma_result res = ma_engine_init(&ma_config, &g_app->audio_engine);
     if (res != MA_SUCCESS) {
       fatal_error("failed to initialize audio engine");
@@ -86,6 +95,9 @@ static void init() {
 
   renderer_reset();
 
+  i32 workers = os_cpu_count() - 1;
+  jobs_setup(workers > 0 ? workers : 1);
+
   g_app->time.startup = stm_now();
   g_app->time.last = stm_now();
 
@@ -167,14 +179,16 @@ static void render() {
 
     {
       LockGuard lock{&g_app->gpu_mtx};
-      sg_begin_default_pass(pass, sapp_width(), sapp_height());
+      sg_begin_default_pass(pass, (i32)app_width(), (i32)app_height());
     }
 
     sgl_defaults();
     sgl_load_pipeline(g_pipeline);
 
-    sgl_viewport(0, 0, sapp_width(), sapp_height(), true);
-    sgl_ortho(0, sapp_widthf(), sapp_heightf(), 0, -1, 1);
+    sgl_viewport(0, 0, (i32)app_width(), (i32)app_height(), true);
+    sgl_ortho(0, app_width(), app_height(), 0, -1, 1);
+
+    renderer_begin_frame(app_width(), app_height());
   }
 
   if (g_app->error_mode.load()) {
@@ -195,7 +209,7 @@ static void render() {
       y += font_size;
 
       y = draw_font_wrapped(g_app->default_font, font_size, x, y,
-                            g_app->fatal_error, sapp_widthf() - x);
+                            g_app->fatal_error, app_width() - x);
       y += font_size;
 
       if (g_app->traceback.data) {
@@ -224,6 +238,7 @@ static void render() {
 
     assert(lua_gettop(L) == 1);
 
+    renderer_flush();
     microui_end_and_present();
 #ifndef NO_NUKLEAR
     nuklear_end_and_present();
@@ -234,7 +249,7 @@ static void render() {
     PROFILE_BLOCK("end render pass");
     LockGuard lock{&g_app->gpu_mtx};
 
-    sgl_draw();
+    renderer_draw();
 
     sgl_error_t sgl_err = sgl_error();
     if (sgl_err != SGL_NO_ERROR) {
@@ -249,7 +264,9 @@ static void render() {
 static void frame() {
   PROFILE_FUNC();
 
-  {
+  if (g_app->headless) {
+    g_app->time.delta = g_app->headless_dt;
+  } else {
     AppTime *time = &g_app->time;
     u64 lap = stm_laptime(&time->last);
     time->delta = stm_sec(lap);
@@ -303,6 +320,8 @@ static void frame() {
   g_app->gpu_mtx.unlock();
   render();
   assets_perform_hot_reload_changes();
+  assets_perform_async_uploads();
+  assets_collect_garbage();
   g_app->gpu_mtx.lock();
 
   memcpy(g_app->prev_key_state, g_app->key_state, sizeof(g_app->key_state));
@@ -329,6 +348,10 @@ static void frame() {
       i++;
     }
   }
+
+  g_app->frame_allocs = g_allocator->alloc_count.exchange(0);
+  frame_arena_reset();
+  profile_end_frame();
 }
 
 static void actually_cleanup() {
@@ -364,6 +387,7 @@ static void actually_cleanup() {
     PROFILE_BLOCK("destroy assets");
 
     lua_channels_shutdown();
+    jobs_shutdown();
 #ifndef NO_NETWORK
     http_shutdown();
 #endif
@@ -389,6 +413,7 @@ static void actually_cleanup() {
 
   {
     PROFILE_BLOCK("destory sokol");
+    renderer_shutdown();
     sgl_destroy_pipeline(g_pipeline);
     sgl_shutdown();
     sg_shutdown();
@@ -411,6 +436,10 @@ static void actually_cleanup() {
 
 static void cleanup() {
   actually_cleanup();
+  tile_search_trash();
+  json_writer_trash();
+  lua_channels_select_trash();
+  frame_arena_trash();
 
 #ifdef USE_PROFILER
   profile_shutdown();
@@ -483,6 +512,103 @@ static void load_all_lua_scripts(lua_State *L) {
   }
 }
 
+static void print_json_string(String str) {
+  putchar('"');
+  for (char c : str) {
+    switch (c) {
+    case '"': fputs("\\\"", stdout); break;
+    case '\\': fputs("\\\\", stdout); break;
+    case '\n': fputs("\\n", stdout); break;
+    case '\t': fputs("\\t", stdout); break;
+    default: putchar(c); break;
+    }
+  }
+  putchar('"');
+}
+
+static void headless_run(i32 frames) {
+  init();
+
+  lua_State *L = g_app->L;
+
+  Array<u64> ticks = {};
+  ticks.reserve(frames > 0 ? frames : 1);
+
+  u64 allocs = 0;
+  u64 batches = 0;
+  u64 vertices = 0;
+  i32 lua_peak_kb = 0;
+
+  g_allocator->alloc_count.store(0);
+
+  for (i32 i = 0; i < frames && !g_app->error_mode.load() &&
+                  !g_app->headless_quit.load();
+       i++) {
+    u64 start = stm_now();
+    frame();
+    ticks.push(stm_since(start));
+
+    RendererStats stats = renderer_stats();
+    allocs += g_app->frame_allocs;
+    batches += stats.batches;
+    vertices += stats.vertices;
+
+    i32 lua_kb = lua_gc(L, LUA_GCCOUNT, 0);
+    if (lua_kb > lua_peak_kb) {
+      lua_peak_kb = lua_kb;
+    }
+  }
+
+  qsort(ticks.data, ticks.len, sizeof(u64),
+        [](const void *a, const void *b) -> int {
+          u64 lhs = *(u64 *)a;
+          u64 rhs = *(u64 *)b;
+          return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+        });
+
+  u64 total = 0;
+  for (u64 t : ticks) {
+    total += t;
+  }
+
+  auto percentile = [&](double p) -> double {
+    if (ticks.len == 0) {
+      return 0;
+    }
+    u64 i = (u64)(p * (ticks.len - 1) + 0.5);
+    return stm_ms(ticks[i]);
+  };
+
+  double n = ticks.len > 0 ? (double)ticks.len : 1;
+  bool failed = g_app->error_mode.load();
+
+  printf("{\n");
+  printf("  \"frames\": %llu,\n", (unsigned long long)ticks.len);
+  printf("  \"dt\": %g,\n", g_app->headless_dt);
+  printf("  \"frame_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, "
+         "\"p99\": %.4f, \"max\": %.4f},\n",
+         stm_ms(total) / n, percentile(0.5), percentile(0.9), percentile(0.99),
+         percentile(1));
+  printf("  \"allocations\": {\"total\": %llu, \"per_frame\": %.2f},\n",
+         (unsigned long long)allocs, allocs / n);
+  printf("  \"draw\": {\"batches_per_frame\": %.2f, "
+         "\"vertices_per_frame\": %.2f},\n",
+         batches / n, vertices / n);
+  printf("  \"lua\": {\"memory_kb\": %d, \"peak_memory_kb\": %d}",
+         lua_gc(L, LUA_GCCOUNT, 0), lua_peak_kb);
+  if (failed) {
+    printf(",\n  \"error\": ");
+    LockGuard lock{&g_app->error_mtx};
+    print_json_string(g_app->fatal_error);
+  }
+  printf("\n}\n");
+  fflush(stdout);
+
+  ticks.trash();
+  cleanup();
+  exit(failed ? 1 : 0);
+}
+
 /* extern(app.h) */ App *g_app;
 /* extern(prelude.h) */ Allocator *g_allocator;
 
@@ -506,9 +632,32 @@ sapp_desc sokol_main(int argc, char **argv) {
 
   const char *mount_path = nullptr;
   const char *script_file = nullptr;
+  bool headless = false;
+  i32 headless_frames = 600;
 
   for (i32 i = 1; i < argc; i++) {
-    if (argv[i][0] != '-') {
+    String arg = argv[i];
+    if (arg == "--profile") {
+      profile_start();
+      continue;
+    }
+
+    if (arg == "--profile-frames" && i + 1 < argc) {
+      profile_capture_frames(atoi(argv[++i]));
+      continue;
+    }
+
+    if (arg == "--headless") {
+      headless = true;
+      continue;
+    }
+
+    if (arg == "--frames" && i + 1 < argc) {
+      headless_frames = atoi(argv[++i]);
+      continue;
+    }
+
+    if (argv[i][0] != '-' && mount_path == nullptr) {
       mount_path = argv[i];
       
       // Check if it's a single .lua file
@@ -541,13 +690,13 @@ sapp_desc sokol_main(int argc, char **argv) {
           script_file = argv[i];
         }
       }
-      
-      break;
     }
   }
 
   g_app = (App *)mem_alloc(sizeof(App));
   memset(g_app, 0, sizeof(App));
+  g_app->main_thread_id.store(this_thread_id());
+  g_app->headless = headless;
 
   g_app->args.resize(argc);
   for (i32 i = 0; i < argc; i++) {
@@ -619,6 +768,25 @@ sapp_desc sokol_main(int argc, char **argv) {
     g_app->time.target_ticks = 1000000000 / target_fps;
   }
 
+#ifdef SOKOL_USE_DUMMY
+  if (!headless) {
+    panic("this build uses the dummy graphics backend, run with --headless");
+  }
+#else
+  if (headless) {
+    panic("--headless needs a build with -DUSE_HEADLESS=ON");
+  }
+#endif
+
+  if (headless) {
+    g_app->headless_dt = target_fps != 0 ? 1.0 / target_fps : 1.0 / 60.0;
+    g_app->headless_width = (float)width;
+    g_app->headless_height = (float)height;
+    g_app->time.target_ticks = 0;
+    g_app->hot_reload_enabled.store(false);
+    headless_run(headless_frames);
+  }
+
 #ifdef IS_WIN32
   if (!g_app->win_console) {
     FreeConsole();
@@ -27,6 +27,16 @@ i32 os_change_dir(const char *path) { return -1; }  // Not supported on Android
 i32 os_change_dir(const char *path) { return chdir(path); }
 #endif
 
+#if defined(IS_WIN32)
+bool os_replace_file(const char *from, const char *to) {
+  return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+#else
+bool os_replace_file(const char *from, const char *to) {
+  return rename(from, to) == 0;
+}
+#endif
+
 String os_program_dir() {
   String str = os_program_path();
   char *buf = str.data;
@@ -85,6 +95,12 @@ void os_high_timer_resolution() { timeBeginPeriod(8); }
 void os_sleep(u32 ms) { Sleep(ms); }
 void os_yield() { YieldProcessor(); }
 
+i32 os_cpu_count() {
+  SYSTEM_INFO info = {};
+  GetSystemInfo(&info);
+  return (i32)info.dwNumberOfProcessors;
+}
+
 #endif // IS_WIN32
 
 #ifdef IS_LINUX
@@ -95,11 +111,13 @@ String os_program_path() {
   return {s_buf, (u64)len};
 }
 
+// nanoseconds, so two saves in the same second don't look the same
 u64 os_file_modtime(const char *filename) {
   struct stat attrib = {};
   i32 err = stat(filename, &attrib);
   if (err == 0) {
-    return (u64)attrib.st_mtime;
+    return (u64)attrib.st_mtim.tv_sec * 1000000000 +
+           (u64)attrib.st_mtim.tv_nsec;
   } else {
     return 0;
   }
@@ -116,6 +134,8 @@ void os_sleep(u32 ms) {
 
 void os_yield() { sched_yield(); }
 
+i32 os_cpu_count() { return (i32)sysconf(_SC_NPROCESSORS_ONLN); }
+
 #endif // IS_LINUX
 
 #ifdef IS_HTML5
@@ -125,6 +145,7 @@ u64 os_file_modtime(const char *filename) { return 0; }
 void os_high_timer_resolution() {}
 void os_sleep(u32 ms) {}
 void os_yield() {}
+i32 os_cpu_count() { return 1; }
 
 #endif // IS_HTML5
 
@@ -132,11 +153,13 @@ void os_yield() {}
 
 String os_program_path() { return {}; }
 
+// nanoseconds, so two saves in the same second don't look the same
 u64 os_file_modtime(const char *filename) {
   struct stat attrib = {};
   i32 err = stat(filename, &attrib);
   if (err == 0) {
-    return (u64)attrib.st_mtime;
+    return (u64)attrib.st_mtim.tv_sec * 1000000000 +
+           (u64)attrib.st_mtim.tv_nsec;
   } else {
     return 0;
   }
@@ -153,4 +176,6 @@ void os_sleep(u32 ms) {
 
 void os_yield() { sched_yield(); }
 
+i32 os_cpu_count() { return (i32)sysconf(_SC_NPROCESSORS_ONLN); }
+
 #endif // IS_ANDROID
@@ -6,6 +6,8 @@ i32 os_change_dir(const char *path);
 String os_program_dir();
 String os_program_path();
 u64 os_file_modtime(const char *filename);
+bool os_replace_file(const char *from, const char *to);
 void os_high_timer_resolution();
 void os_sleep(u32 ms);
 void os_yield();
+i32 os_cpu_count();
@@ -240,6 +240,24 @@ void draw_fixtures_for_body(b2Body *body, float meter) {
       }
       break;
     }
+    case b2Shape::e_chain: {
+      b2ChainShape *chain = (b2ChainShape *)f->GetShape();
+
+      if (chain->m_count > 0) {
+        sgl_disable_texture();
+        sgl_begin_line_strip();
+
+        renderer_apply_color();
+
+        for (i32 i = 0; i < chain->m_count; i++) {
+          b2Vec2 pos = body->GetWorldPoint(chain->m_vertices[i]);
+          renderer_push_xy(pos.x * meter, pos.y * meter);
+        }
+
+        sgl_end();
+      }
+      break;
+    }
     default: break;
     }
   }
@@ -1,6 +1,8 @@
 #include "prelude.h"
 
 void *DebugAllocator::alloc(size_t bytes, const char *file, i32 line) {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+
   LockGuard lock{&mtx};
 
     DebugAllocInfo *info =
@@ -2,6 +2,7 @@
 
 #include "sync.h"
 #include <assert.h>
+#include <atomic>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdarg.h>
@@ -68,6 +69,8 @@ inline void panic(const char *fmt, ...) {
 }
 
 struct Allocator {
+  std::atomic<u64> alloc_count = {}; // calls to alloc, from any thread
+
   virtual void make() = 0;
   virtual void trash() = 0;
   virtual void *alloc(size_t bytes, const char *file, i32 line) = 0;
@@ -77,7 +80,10 @@ struct Allocator {
 struct HeapAllocator : Allocator {
   void make() {}
   void trash() {}
-  void *alloc(size_t bytes, const char *, i32) { return malloc(bytes); }
+  void *alloc(size_t bytes, const char *, i32) {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return malloc(bytes);
+  }
   void free(void *ptr) { ::free(ptr); }
 };
 
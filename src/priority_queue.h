@@ -101,3 +101,139 @@ template <typename T> struct PriorityQueue {
     return true;
   }
 };
+
+// min heap of integer ids in [0, capacity). positions[id] is the slot of id
+// in the heap, or -1 if it isn't queued, so a queued id can have its cost
+// lowered in place instead of being pushed again
+struct IndexedPriorityQueue {
+  i32 *ids = nullptr;
+  float *costs = nullptr;
+  i32 *positions = nullptr;
+  u64 len = 0;
+  u64 capacity = 0;
+
+  void trash() {
+    mem_free(ids);
+    mem_free(costs);
+    mem_free(positions);
+  }
+
+  void reserve(u64 cap) {
+    if (cap <= capacity) {
+      return;
+    }
+
+    i32 *ibuf = (i32 *)mem_alloc(sizeof(i32) * cap);
+    memcpy(ibuf, ids, sizeof(i32) * len);
+    mem_free(ids);
+    ids = ibuf;
+
+    float *cbuf = (float *)mem_alloc(sizeof(float) * cap);
+    memcpy(cbuf, costs, sizeof(float) * len);
+    mem_free(costs);
+    costs = cbuf;
+
+    i32 *pbuf = (i32 *)mem_alloc(sizeof(i32) * cap);
+    memcpy(pbuf, positions, sizeof(i32) * capacity);
+    for (u64 i = capacity; i < cap; i++) {
+      pbuf[i] = -1;
+    }
+    mem_free(positions);
+    positions = pbuf;
+
+    capacity = cap;
+  }
+
+  // only touches queued ids, so it's cheap after a search that ended early
+  void clear() {
+    for (u64 i = 0; i < len; i++) {
+      positions[ids[i]] = -1;
+    }
+    len = 0;
+  }
+
+  bool contains(i32 id) { return positions[id] != -1; }
+
+  void swap(i32 i, i32 j) {
+    i32 t = ids[i];
+    ids[i] = ids[j];
+    ids[j] = t;
+
+    float f = costs[i];
+    costs[i] = costs[j];
+    costs[j] = f;
+
+    positions[ids[i]] = i;
+    positions[ids[j]] = j;
+  }
+
+  void shift_up(i32 j) {
+    while (j > 0) {
+      i32 i = (j - 1) / 2;
+      if (costs[i] <= costs[j]) {
+        break;
+      }
+
+      swap(i, j);
+      j = i;
+    }
+  }
+
+  void shift_down(i32 i) {
+    i32 n = (i32)len;
+    i32 j = 2 * i + 1;
+    while (j < n) {
+      if (j + 1 < n && costs[j + 1] < costs[j]) {
+        j = j + 1;
+      }
+
+      if (costs[i] <= costs[j]) {
+        break;
+      }
+
+      swap(i, j);
+      i = j;
+      j = 2 * i + 1;
+    }
+  }
+
+  // queues id, or lowers its cost if it's already queued
+  void push(i32 id, float cost) {
+    assert(id >= 0 && (u64)id < capacity);
+
+    i32 pos = positions[id];
+    if (pos != -1) {
+      if (cost < costs[pos]) {
+        costs[pos] = cost;
+        shift_up(pos);
+      }
+      return;
+    }
+
+    ids[len] = id;
+    costs[len] = cost;
+    positions[id] = (i32)len;
+    len++;
+
+    shift_up((i32)len - 1);
+  }
+
+  bool pop(i32 *id) {
+    if (len == 0) {
+      return false;
+    }
+
+    *id = ids[0];
+    positions[ids[0]] = -1;
+
+    len--;
+    if (len > 0) {
+      ids[0] = ids[len];
+      costs[0] = costs[len];
+      positions[ids[0]] = 0;
+      shift_down(0);
+    }
+
+    return true;
+  }
+};
@@ -1,81 +1,441 @@
 #include "profile.h"
-#include "queue.h"
 
 #ifndef USE_PROFILER
 void profile_setup() {}
 void profile_shutdown() {}
+void profile_thread_trash() {}
+void profile_start() {}
+void profile_stop() {}
+void profile_capture_frames(i32) {}
+void profile_end_frame() {}
+bool profile_active() { return false; }
 #endif
 
 #ifdef USE_PROFILER
 
+#include "array.h"
 #include "deps/sokol_time.h"
+#include "hash_map.h"
 #include "os.h"
 #include "strings.h"
 #include "sync.h"
+#include <new>
+
+#define PROFILE_RING_SIZE 8192 // must be a power of two
+
+struct TraceEvent {
+  const char *cat;
+  const char *name;
+  u64 start;
+  u64 end;
+};
+
+// single producer (the owning thread), single consumer (the writer thread)
+struct ProfileRing {
+  std::atomic<u64> head;
+  std::atomic<u64> tail;
+  std::atomic<u64> dropped;
+  std::atomic<bool> dead; // owning thread exited, freed once drained
+  u32 tid;
+  ProfileRing *next;
+  TraceEvent events[PROFILE_RING_SIZE];
+};
+
+// binary trace layout:
+//   "SPRYTRC1"
+//   string record: u8 kind, u32 id, u32 len, char[len]
+//   event record:  u8 kind, u32 cat, u32 name, u32 tid, u64 start, u64 end
+enum TraceRecord : u8 {
+  TraceRecord_String,
+  TraceRecord_Event,
+};
+
+static const char TRACE_MAGIC[8] = {'S', 'P', 'R', 'Y', 'T', 'R', 'C', '1'};
 
 struct Profile {
-  Queue<TraceEvent> events;
-  Thread recv_thread;
+  std::atomic<ProfileRing *> rings;
+  std::atomic<i32> frames_left;
+  std::atomic<u32> captures; // bumped on every start request
+  std::atomic<i32> dead_rings;
+
+  // the writer sleeps on shutdown_notify until there's something to do:
+  // a capture, a ring to free, or shutdown
+  Thread writer_thread;
+  Mutex shutdown_mtx;
+  Cond shutdown_notify;
+  bool shutdown;
+
+  // only touched by the writer thread
+  FILE *file;
+  HashMap<u32> strings; // key: pointer
+  u32 next_string;
+  u64 dropped;
 };
 
+std::atomic<bool> g_profile_active;
 static Profile g_profile = {};
+static thread_local ProfileRing *t_ring;
+
+static void profile_wake() {
+  LockGuard lock{&g_profile.shutdown_mtx};
+  g_profile.shutdown_notify.signal();
+}
+
+static ProfileRing *profile_ring() {
+  if (t_ring != nullptr) {
+    return t_ring;
+  }
+
+  ProfileRing *ring = (ProfileRing *)mem_alloc(sizeof(ProfileRing));
+  memset(ring, 0, sizeof(ProfileRing));
+  new (&ring->head) std::atomic<u64>();
+  new (&ring->tail) std::atomic<u64>();
+  new (&ring->dropped) std::atomic<u64>();
+  new (&ring->dead) std::atomic<bool>();
+  ring->tid = (u32)this_thread_id();
+
+  ring->next = g_profile.rings.load();
+  while (!g_profile.rings.compare_exchange_weak(ring->next, ring)) {
+  }
+
+  t_ring = ring;
+  return ring;
+}
+
+void profile_thread_trash() {
+  if (t_ring != nullptr) {
+    t_ring->dead.store(true, std::memory_order_release);
+    t_ring = nullptr;
+    g_profile.dead_rings++;
+    profile_wake();
+  }
+}
+
+void Instrument::begin(const char *name) {
+  this->name = name;
+  start = stm_now();
+}
+
+void Instrument::end() {
+  u64 now = stm_now();
+  ProfileRing *ring = profile_ring();
+
+  u64 head = ring->head.load(std::memory_order_relaxed);
+  u64 tail = ring->tail.load(std::memory_order_acquire);
+  if (head - tail == PROFILE_RING_SIZE) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
 
-static void profile_recv_thread(void *) {
+  TraceEvent *e = &ring->events[head & (PROFILE_RING_SIZE - 1)];
+  e->cat = cat;
+  e->name = name;
+  e->start = start;
+  e->end = now;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+static String profile_file_path(String file) {
   StringBuilder sb = {};
-  sb.swap_filename(os_program_path(), "profile.json");
+  sb.swap_filename(os_program_path(), file);
+  return String(sb);
+}
 
-  FILE *f = fopen(sb.data, "w");
-  sb.trash();
+template <typename T> static void trace_write(T value) {
+  fwrite(&value, sizeof(T), 1, g_profile.file);
+}
 
-  defer(fclose(f));
+template <typename T> static bool trace_read(FILE *f, T *value) {
+  return fread(value, sizeof(T), 1, f) == 1;
+}
 
-  fputs("[", f);
-  while (true) {
-    TraceEvent e = g_profile.events.demand();
-    if (e.name == nullptr) {
+static u32 trace_string(const char *str) {
+  u32 *existing = g_profile.strings.get((u64)str);
+  if (existing != nullptr) {
+    return *existing;
+  }
+
+  u32 id = g_profile.next_string++;
+  g_profile.strings[(u64)str] = id;
+
+  u32 len = (u32)strlen(str);
+  trace_write<u8>(TraceRecord_String);
+  trace_write(id);
+  trace_write(len);
+  fwrite(str, 1, len, g_profile.file);
+  return id;
+}
+
+// only the writer thread removes rings. other threads only push new ones
+// to the front of the list
+static void profile_unlink(ProfileRing *prev, ProfileRing *ring) {
+  if (prev == nullptr) {
+    ProfileRing *expected = ring;
+    if (g_profile.rings.compare_exchange_strong(expected, ring->next)) {
       return;
     }
 
-    fprintf(f,
-            R"({"name":"%s","cat":"%s","ph":"%c","ts":%.3f,"pid":0,"tid":%hu},)"
-            "\n",
-            e.name, e.cat, e.ph, stm_us(e.ts), e.tid);
+    prev = expected;
+    while (prev->next != ring) {
+      prev = prev->next;
+    }
+  }
+
+  prev->next = ring->next;
+}
+
+static void profile_drain(bool write) {
+  ProfileRing *prev = nullptr;
+  ProfileRing *ring = g_profile.rings.load();
+  while (ring != nullptr) {
+    // loaded before head, so a dead ring is empty after this drain
+    bool dead = ring->dead.load(std::memory_order_acquire);
+    u64 tail = ring->tail.load(std::memory_order_relaxed);
+    u64 head = ring->head.load(std::memory_order_acquire);
+
+    if (write) {
+      for (; tail != head; tail++) {
+        TraceEvent e = ring->events[tail & (PROFILE_RING_SIZE - 1)];
+
+        u32 cat = trace_string(e.cat);
+        u32 name = trace_string(e.name);
+        trace_write<u8>(TraceRecord_Event);
+        trace_write(cat);
+        trace_write(name);
+        trace_write(ring->tid);
+        trace_write(e.start);
+        trace_write(e.end);
+      }
+    }
+
+    ring->tail.store(head, std::memory_order_release);
+    g_profile.dropped += ring->dropped.exchange(0);
+
+    ProfileRing *next = ring->next;
+    if (dead) {
+      profile_unlink(prev, ring);
+      mem_free(ring);
+      g_profile.dead_rings--;
+    } else {
+      prev = ring;
+    }
+    ring = next;
+  }
+}
+
+static bool profile_convert(String trace_path, String json_path) {
+  FILE *in = fopen(trace_path.data, "rb");
+  if (in == nullptr) {
+    return false;
+  }
+  defer(fclose(in));
+
+  char magic[sizeof(TRACE_MAGIC)] = {};
+  if (!trace_read(in, &magic) ||
+      memcmp(magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+    return false;
+  }
+
+  FILE *out = fopen(json_path.data, "w");
+  if (out == nullptr) {
+    return false;
+  }
+  defer(fclose(out));
+
+  Array<String> strings = {};
+  defer({
+    for (String s : strings) {
+      mem_free(s.data);
+    }
+    strings.trash();
+  });
+
+  fputs("[", out);
+
+  bool first = true;
+  u8 kind = 0;
+  while (trace_read(in, &kind)) {
+    if (kind == TraceRecord_String) {
+      u32 id = 0, len = 0;
+      if (!trace_read(in, &id) || !trace_read(in, &len) || id != strings.len) {
+        break;
+      }
+
+      char *str = (char *)mem_alloc(len + 1);
+      if (fread(str, 1, len, in) != len) {
+        mem_free(str);
+        break;
+      }
+      str[len] = '\0';
+      strings.push({str, len});
+    } else if (kind == TraceRecord_Event) {
+      u32 cat = 0, name = 0, tid = 0;
+      u64 start = 0, end = 0;
+      if (!trace_read(in, &cat) || !trace_read(in, &name) ||
+          !trace_read(in, &tid) || !trace_read(in, &start) ||
+          !trace_read(in, &end)) {
+        break;
+      }
+
+      if (cat >= strings.len || name >= strings.len) {
+        break;
+      }
+
+      fprintf(
+          out,
+          R"(%s{"name":"%s","cat":"%s","ph":"X","ts":%.3f,"dur":%.3f,"pid":0,"tid":%u})",
+          first ? "\n" : ",\n", strings[name].data, strings[cat].data,
+          stm_us(start), stm_us(end - start), tid);
+      first = false;
+    } else {
+      break;
+    }
+  }
+
+  fputs("\n]\n", out);
+  return true;
+}
+
+static void profile_begin_capture() {
+  String path = profile_file_path("profile.trace");
+  defer(mem_free(path.data));
+
+  g_profile.file = fopen(path.data, "wb");
+  if (g_profile.file == nullptr) {
+    fprintf(stderr, "profile: failed to open %s\n", path.data);
+    g_profile_active.store(false);
+    return;
+  }
+
+  fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), g_profile.file);
+  g_profile.strings.clear();
+  g_profile.next_string = 0;
+  g_profile.dropped = 0;
+}
+
+static void profile_end_capture() {
+  fclose(g_profile.file);
+  g_profile.file = nullptr;
+
+  if (g_profile.dropped > 0) {
+    fprintf(stderr, "profile: dropped %llu events\n",
+            (unsigned long long)g_profile.dropped);
+  }
+
+  String trace = profile_file_path("profile.trace");
+  defer(mem_free(trace.data));
+  String json = profile_file_path("profile.json");
+  defer(mem_free(json.data));
+
+  if (!profile_convert(trace, json)) {
+    fprintf(stderr, "profile: failed to write %s\n", json.data);
+  }
+}
+
+static void profile_writer_thread(void *) {
+  u32 captures = 0;
+
+  while (true) {
+    bool shutdown = false;
+    {
+      LockGuard lock{&g_profile.shutdown_mtx};
+      if (!g_profile.shutdown) {
+        // don't poll while nothing is being captured
+        bool idle = g_profile.file == nullptr && !g_profile_active.load() &&
+                    g_profile.captures.load() == captures &&
+                    g_profile.dead_rings.load() == 0;
+        if (idle) {
+          g_profile.shutdown_notify.wait(&g_profile.shutdown_mtx);
+        } else {
+          g_profile.shutdown_notify.timed_wait(&g_profile.shutdown_mtx, 10);
+        }
+      }
+      shutdown = g_profile.shutdown;
+    }
+
+    // a short capture can start and stop between two wakeups
+    bool requested = g_profile.captures.load() != captures;
+    captures = g_profile.captures.load();
+
+    bool active = !shutdown && g_profile_active.load();
+    if ((active || requested) && g_profile.file == nullptr) {
+      profile_begin_capture();
+    }
+
+    if (g_profile.file != nullptr) {
+      profile_drain(true);
+      if (!active) {
+        profile_end_capture();
+      }
+    } else {
+      // stragglers from scopes that were open when capture stopped
+      profile_drain(false);
+    }
+
+    if (shutdown) {
+      return;
+    }
   }
 }
 
 void profile_setup() {
-  g_profile.events.make();
-  g_profile.events.reserve(256);
-  g_profile.recv_thread.make(profile_recv_thread, nullptr);
+  g_profile.shutdown_mtx.make();
+  g_profile.shutdown_notify.make();
+  g_profile.writer_thread.make(profile_writer_thread, nullptr);
+
+#ifndef NDEBUG
+  profile_start();
+#endif
 }
 
 void profile_shutdown() {
-  g_profile.events.enqueue({});
-  g_profile.recv_thread.join();
-  g_profile.events.trash();
-}
+  g_profile_active.store(false);
 
-Instrument::Instrument(const char *cat, const char *name)
-    : cat(cat), name(name), tid(this_thread_id()) {
-  TraceEvent e = {};
-  e.cat = cat;
-  e.name = name;
-  e.ph = 'B';
-  e.ts = stm_now();
-  e.tid = tid;
+  {
+    LockGuard lock{&g_profile.shutdown_mtx};
+    g_profile.shutdown = true;
+  }
+  g_profile.shutdown_notify.signal();
+  g_profile.writer_thread.join();
 
-  g_profile.events.enqueue(e);
+  ProfileRing *ring = g_profile.rings.exchange(nullptr);
+  while (ring != nullptr) {
+    ProfileRing *next = ring->next;
+    mem_free(ring);
+    ring = next;
+  }
+  t_ring = nullptr;
+
+  g_profile.strings.trash();
+  g_profile.shutdown_notify.trash();
+  g_profile.shutdown_mtx.trash();
 }
 
-Instrument::~Instrument() {
-  TraceEvent e = {};
-  e.cat = cat;
-  e.name = name;
-  e.ph = 'E';
-  e.ts = stm_now();
-  e.tid = tid;
+void profile_start() {
+  g_profile.frames_left.store(0);
+  g_profile.captures++;
+  g_profile_active.store(true);
+  profile_wake();
+}
 
-  g_profile.events.enqueue(e);
+void profile_stop() { g_profile_active.store(false); }
+
+void profile_capture_frames(i32 frames) {
+  g_profile.frames_left.store(frames);
+  if (frames > 0) {
+    g_profile.captures++;
+  }
+  g_profile_active.store(frames > 0);
+  profile_wake();
+}
+
+void profile_end_frame() {
+  if (g_profile.frames_left.load() > 0 &&
+      g_profile.frames_left.fetch_sub(1) == 1) {
+    g_profile_active.store(false);
+  }
 }
 
-#endif // USE_PROFILER
\ No newline at end of file
+bool profile_active() { return g_profile_active.load(); }
+
+#endif // USE_PROFILER
@@ -1,32 +1,49 @@
 #pragma once
 
+#include "prelude.h"
+
 void profile_setup();
 void profile_shutdown();
+void profile_thread_trash(); // call before a thread that profiled exits
+
+// capture writes a binary trace next to the executable while active, and
+// converts it to chrome trace json (profile.json) when capture stops
+void profile_start();
+void profile_stop();
+void profile_capture_frames(i32 frames);
+void profile_end_frame();
+bool profile_active();
 
-#ifndef NDEBUG
-#if !defined(USE_PROFILER) && !defined(__EMSCRIPTEN__)
+#if !defined(USE_PROFILER) && !defined(NO_PROFILER) && !defined(__EMSCRIPTEN__)
 #define USE_PROFILER
 #endif
-#endif
 
 #ifdef USE_PROFILER
-#include "prelude.h"
+#include <atomic>
 
-struct TraceEvent {
-  const char *cat;
-  const char *name;
-  u64 ts;
-  u16 tid;
-  char ph;
-};
+extern std::atomic<bool> g_profile_active;
 
+// cat and name must point to static storage, the trace only keeps pointers
+// until it is written out
 struct Instrument {
   const char *cat;
   const char *name;
-  i32 tid;
-
-  Instrument(const char *cat, const char *name);
-  ~Instrument();
+  u64 start;
+
+  Instrument(const char *cat, const char *name) : cat(cat), name(nullptr) {
+    if (g_profile_active.load(std::memory_order_relaxed)) {
+      begin(name);
+    }
+  }
+
+  ~Instrument() {
+    if (name != nullptr) {
+      end();
+    }
+  }
+
+  void begin(const char *name);
+  void end();
 };
 
 #define PROFILE_FUNC()                                                         \
@@ -8,7 +8,7 @@
 #include "slice.h"
 #include "vfs.h"
 
-bool SpriteData::load(String filepath) {
+bool SpriteData::decode(String filepath, ImagePixels *out) {
   PROFILE_FUNC();
 
   String contents = {};
@@ -33,9 +33,7 @@ bool SpriteData::load(String filepath) {
   Slice<SpriteFrame> frames = {};
   frames.resize(&arena, ase->frame_count);
 
-  Array<char> pixels = {};
-  pixels.reserve(ase->frame_count * rect);
-  defer(pixels.trash());
+  u8 *pixels = (u8 *)mem_alloc(ase->frame_count * rect);
 
   for (i32 i = 0; i < ase->frame_count; i++) {
     ase_frame_t &frame = ase->frames[i];
@@ -49,26 +47,14 @@ bool SpriteData::load(String filepath) {
     sf.v1 = (float)(i + 1) / ase->frame_count;
 
     frames[i] = sf;
-    memcpy(pixels.data + (i * rect), &frame.pixels[0].r, rect);
+    memcpy(pixels + (i * rect), &frame.pixels[0].r, rect);
   }
 
-  sg_image_desc desc = {};
-  desc.width = ase->w;
-  desc.height = ase->h * ase->frame_count;
-  desc.data.subimage[0][0].ptr = pixels.data;
-  desc.data.subimage[0][0].size = ase->frame_count * rect;
-
-  u32 id = 0;
-  {
-    PROFILE_BLOCK("make image");
-    LockGuard lock{&g_app->gpu_mtx};
-    id = sg_make_image(desc).id;
-  }
-
-  Image img = {};
-  img.id = id;
-  img.width = desc.width;
-  img.height = desc.height;
+  ImagePixels img = {};
+  img.width = ase->w;
+  img.height = ase->h * ase->frame_count;
+  img.channels = 4;
+  img.mips.push(pixels);
 
   HashMap<SpriteLoop> by_tag = {};
   by_tag.reserve(ase->tag_count);
@@ -88,17 +74,35 @@ bool SpriteData::load(String filepath) {
     by_tag[fnv1a(tag.name)] = loop;
   }
 
-  printf("created sprite with image id: %d and %llu frames\n", img.id,
-         (unsigned long long)frames.len);
-
   SpriteData s = {};
   s.arena = arena;
-  s.img = img;
   s.frames = frames;
   s.by_tag = by_tag;
   s.width = ase->w;
   s.height = ase->h;
   *this = s;
+  *out = img;
+  return true;
+}
+
+void SpriteData::upload(ImagePixels *pixels) {
+  img.upload(pixels);
+
+  printf("created sprite with image id: %d and %llu frames\n", img.id,
+         (unsigned long long)frames.len);
+}
+
+bool SpriteData::load(String filepath) {
+  PROFILE_FUNC();
+
+  ImagePixels pixels = {};
+  bool ok = decode(filepath, &pixels);
+  if (!ok) {
+    return false;
+  }
+  defer(pixels.trash());
+
+  upload(&pixels);
   return true;
 }
 
@@ -122,7 +126,7 @@ void Sprite::update(float dt) {
   }
 
   i32 index = view.frame();
-  SpriteFrame frame = view.data.frames[index];
+  SpriteFrame frame = view.data->frames[index];
 
   elapsed += dt * 1000;
   if (elapsed > frame.duration) {
@@ -150,14 +154,13 @@ void Sprite::set_frame(i32 frame) {
 }
 
 bool SpriteView::make(Sprite *spr) {
-  Asset a = {};
-  bool ok = asset_read(spr->sprite, &a);
-  if (!ok) {
+  Asset *a = asset_get(spr->sprite);
+  if (a == nullptr) {
     return false;
   }
 
-  SpriteData data = a.sprite;
-  const SpriteLoop *res = data.by_tag.get(spr->loop);
+  SpriteData *data = &a->sprite;
+  const SpriteLoop *res = data->by_tag.get(spr->loop);
 
   SpriteView view = {};
   view.sprite = spr;
@@ -183,6 +186,6 @@ u64 SpriteView::len() {
   if (loop.indices.data != nullptr) {
     return loop.indices.len;
   } else {
-    return data.frames.len;
+    return data->frames.len;
   }
 }
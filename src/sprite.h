@@ -22,11 +22,13 @@ struct SpriteData {
   i32 height;
 
   bool load(String filepath);
+  bool decode(String filepath, ImagePixels *out);
+  void upload(ImagePixels *pixels);
   void trash();
 };
 
 struct Sprite {
-  u64 sprite; // index into assets
+  u64 sprite; // asset handle
   u64 loop;   // index into SpriteData::by_tag
   float elapsed;
   i32 current_frame;
@@ -38,7 +40,7 @@ struct Sprite {
 
 struct SpriteView {
   Sprite *sprite;
-  SpriteData data;
+  SpriteData *data;
   SpriteLoop loop;
 
   bool make(Sprite *spr);
@@ -1,6 +1,8 @@
 #include "strings.h"
+#include "arena.h"
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 SplitLinesIterator &SplitLinesIterator::operator++() {
   if (&view.data[view.len] == &data.data[data.len]) {
@@ -240,51 +242,102 @@ String str_fmt(const char *fmt, ...) {
 }
 
 String tmp_fmt(const char *fmt, ...) {
-  static char s_buf[1024] = {};
-
   va_list args;
   va_start(args, fmt);
-  i32 len = vsnprintf(s_buf, sizeof(s_buf), fmt, args);
+  i32 len = vsnprintf(nullptr, 0, fmt, args);
+  va_end(args);
+
+  if (len <= 0) {
+    return "";
+  }
+
+  char *data = (char *)frame_arena()->bump(len + 1);
+  va_start(args, fmt);
+  vsnprintf(data, len + 1, fmt, args);
   va_end(args);
-  return {s_buf, (u64)len};
+  return {data, (u64)len};
 }
 
 double string_to_double(String str) {
-  double n = 0;
-  double sign = 1;
-
-  if (str.len == 0) {
-    return n;
-  }
+  static const double pow10[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
 
   u64 i = 0;
-  if (str.data[0] == '-' && str.len > 1 && is_digit(str.data[1])) {
+  bool negative = false;
+  if (i < str.len && str.data[i] == '-') {
+    negative = true;
     i++;
-    sign = -1;
   }
 
-  while (i < str.len) {
-    if (!is_digit(str.data[i])) {
-      break;
+  // up to 19 significant digits fit in the mantissa. if there are more,
+  // strtod does the rounding
+  u64 mantissa = 0;
+  i32 digits = 0;
+  i32 exponent = 0;
+  bool exact = true;
+
+  for (; i < str.len && is_digit(str.data[i]); i++) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (str.data[i] - '0');
+      digits += mantissa != 0;
+    } else {
+      exponent++;
+      exact = false;
     }
-
-    n = n * 10 + (str.data[i] - '0');
-    i++;
   }
 
   if (i < str.len && str.data[i] == '.') {
-    i++;
-    double place = 10;
-    while (i < str.len) {
-      if (!is_digit(str.data[i])) {
-        break;
+    for (i++; i < str.len && is_digit(str.data[i]); i++) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (str.data[i] - '0');
+        digits += mantissa != 0;
+        exponent--;
+      } else {
+        exact = false;
       }
+    }
+  }
 
-      n += (str.data[i] - '0') / place;
-      place *= 10;
+  if (i < str.len && (str.data[i] == 'e' || str.data[i] == 'E')) {
+    i++;
+    bool negative_exp = false;
+    if (i < str.len && (str.data[i] == '-' || str.data[i] == '+')) {
+      negative_exp = str.data[i] == '-';
       i++;
     }
+
+    i32 e = 0;
+    for (; i < str.len && is_digit(str.data[i]); i++) {
+      if (e < 100000) {
+        e = e * 10 + (str.data[i] - '0');
+      }
+    }
+    exponent += negative_exp ? -e : e;
+  }
+
+  // both the mantissa and the power of ten are exact doubles, so one
+  // multiply or divide rounds correctly
+  if (exact && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+    double n = (double)mantissa;
+    n = exponent < 0 ? n / pow10[-exponent] : n * pow10[exponent];
+    return negative ? -n : n;
+  }
+
+  char buf[128];
+  String cstr = {};
+  if (i < sizeof(buf)) {
+    memcpy(buf, str.data, i);
+    buf[i] = 0;
+    cstr = {buf, i};
+  } else {
+    cstr = to_cstr(str.substr(0, i));
   }
 
-  return n * sign;
-}
\ No newline at end of file
+  double n = strtod(cstr.data, nullptr);
+  if (cstr.data != buf) {
+    mem_free(cstr.data);
+  }
+  return n;
+}
@@ -69,6 +69,7 @@ struct StringBuilder {
 };
 
 FORMAT_ARGS(1) String str_fmt(const char *fmt, ...);
+// allocated in the thread's frame arena
 FORMAT_ARGS(1) String tmp_fmt(const char *fmt, ...);
 
 double string_to_double(String str);
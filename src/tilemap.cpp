@@ -1,7 +1,12 @@
 #include "tilemap.h"
+#include "app.h"
 #include "arena.h"
+#include "deps/sokol_gfx.h"
+#include "draw.h"
 #include "hash_map.h"
+#include "jobs.h"
 #include "json.h"
+#include "os.h"
 #include "prelude.h"
 #include "priority_queue.h"
 #include "profile.h"
@@ -9,13 +14,121 @@
 #include "strings.h"
 #include "vfs.h"
 #include <box2d/b2_body.h>
+#include <box2d/b2_chain_shape.h>
 #include <box2d/b2_fixture.h>
 #include <box2d/b2_polygon_shape.h>
 #include <box2d/b2_world.h>
+#include <new>
+
+static constexpr i32 TILEMAP_CHUNK_TILES = 16;
+
+static void layer_make_chunks(TilemapLayer *layer, Arena *arena) {
+  PROFILE_FUNC();
+
+  if (layer->tiles.len == 0 || layer->grid_size <= 0) {
+    return;
+  }
+
+  float chunk_size = layer->grid_size * TILEMAP_CHUNK_TILES;
+  i32 cols = (layer->c_width + TILEMAP_CHUNK_TILES - 1) / TILEMAP_CHUNK_TILES;
+  i32 rows = (layer->c_height + TILEMAP_CHUNK_TILES - 1) / TILEMAP_CHUNK_TILES;
+  cols = cols > 0 ? cols : 1;
+  rows = rows > 0 ? rows : 1;
+
+  auto chunk_index = [&](Tile tile) {
+    i32 cx = (i32)(tile.x / chunk_size);
+    i32 cy = (i32)(tile.y / chunk_size);
+    cx = cx < 0 ? 0 : (cx >= cols ? cols - 1 : cx);
+    cy = cy < 0 ? 0 : (cy >= rows ? rows - 1 : cy);
+    return cy * cols + cx;
+  };
+
+  // counting sort keeps the draw order of tiles within a chunk
+  u32 *offsets = (u32 *)mem_alloc(sizeof(u32) * (cols * rows + 1));
+  defer(mem_free(offsets));
+  memset(offsets, 0, sizeof(u32) * (cols * rows + 1));
+
+  for (Tile tile : layer->tiles) {
+    offsets[chunk_index(tile) + 1]++;
+  }
+
+  u64 non_empty = 0;
+  for (i32 i = 0; i < cols * rows; i++) {
+    if (offsets[i + 1] != 0) {
+      non_empty++;
+    }
+    offsets[i + 1] += offsets[i];
+  }
+
+  Tile *sorted = (Tile *)mem_alloc(sizeof(Tile) * layer->tiles.len);
+  defer(mem_free(sorted));
+
+  Slice<TilemapChunk> chunks = {};
+  chunks.resize(arena, non_empty);
+
+  u64 n = 0;
+  for (i32 i = 0; i < cols * rows; i++) {
+    if (offsets[i] == offsets[i + 1]) {
+      continue;
+    }
+
+    TilemapChunk chunk = {};
+    chunk.x0 = chunk.y0 = INFINITY;
+    chunk.x1 = chunk.y1 = -INFINITY;
+    chunk.first = offsets[i];
+    chunk.count = offsets[i + 1] - offsets[i];
+    chunks[n++] = chunk;
+  }
+
+  u32 *cursor = offsets;
+  for (Tile tile : layer->tiles) {
+    sorted[cursor[chunk_index(tile)]++] = tile;
+  }
+  memcpy(layer->tiles.data, sorted, sizeof(Tile) * layer->tiles.len);
+
+  for (TilemapChunk &chunk : chunks) {
+    for (u32 i = chunk.first; i < chunk.first + chunk.count; i++) {
+      Tile tile = layer->tiles[i];
+      chunk.x0 = tile.x < chunk.x0 ? tile.x : chunk.x0;
+      chunk.y0 = tile.y < chunk.y0 ? tile.y : chunk.y0;
+      float x1 = tile.x + layer->grid_size;
+      float y1 = tile.y + layer->grid_size;
+      chunk.x1 = x1 > chunk.x1 ? x1 : chunk.x1;
+      chunk.y1 = y1 > chunk.y1 ? y1 : chunk.y1;
+    }
+  }
+
+  layer->chunks = chunks;
+}
+
+static void layer_tile_uvs(TilemapLayer *layer) {
+  for (Tile &tile : layer->tiles) {
+    tile.u0 = tile.u / layer->image.width;
+    tile.v0 = tile.v / layer->image.height;
+    tile.u1 = (tile.u + layer->grid_size) / layer->image.width;
+    tile.v1 = (tile.v + layer->grid_size) / layer->image.height;
+
+    i32 FLIP_X = 1 << 0;
+    i32 FLIP_Y = 1 << 1;
+
+    if (tile.flip_bits & FLIP_X) {
+      float tmp = tile.u0;
+      tile.u0 = tile.u1;
+      tile.u1 = tmp;
+    }
+
+    if (tile.flip_bits & FLIP_Y) {
+      float tmp = tile.v0;
+      tile.v0 = tile.v1;
+      tile.v1 = tmp;
+    }
+  }
+}
 
 static bool layer_from_json(TilemapLayer *layer, JSON *json, bool *ok,
                             Arena *arena, String filepath,
-                            HashMap<Image> *images) {
+                            HashMap<Image> *images,
+                            HashMap<ImagePixels> *pixels) {
   PROFILE_FUNC();
 
   layer->identifier =
@@ -31,42 +144,53 @@ static bool layer_from_json(TilemapLayer *layer, JSON *json, bool *ok,
   JSONArray *grid_tiles = json->lookup_array("gridTiles", ok);
   JSONArray *auto_layer_tiles = json->lookup_array("autoLayerTiles", ok);
 
-  JSONArray *arr_tiles = (grid_tiles != nullptr && grid_tiles->index != 0)
+  JSONArray *arr_tiles = (grid_tiles != nullptr && grid_tiles->len != 0)
                              ? grid_tiles
                              : auto_layer_tiles;
 
   JSONArray *entity_instances = json->lookup_array("entityInstances", ok);
 
   if (tileset_rel_path.kind == JSONKind_String) {
-    StringBuilder sb = {};
-    defer(sb.trash());
-    sb.swap_filename(filepath, tileset_rel_path.as_string(ok));
+    ScratchArena scratch;
 
-    u64 key = fnv1a(String(sb));
+    String rel = tileset_rel_path.as_string(ok);
+    u64 slash = filepath.last_of('/');
+    i32 dir_len = slash == (u64)-1 ? 0 : (i32)slash + 1;
+    String tileset_path = tmp_fmt("%.*s%.*s", dir_len, filepath.data,
+                                  (i32)rel.len, rel.data);
+
+    u64 key = fnv1a(tileset_path);
 
     Image *img = images->get(key);
     if (img != nullptr) {
       layer->image = *img;
     } else {
-      Image create_img = {};
-      bool success = create_img.load(String(sb), false);
+      ImagePixels decoded = {};
+      bool success = decoded.load(tileset_path, false);
       if (!success) {
         return false;
       }
 
+      // uploaded later by Tilemap::upload
+      Image create_img = {};
+      create_img.width = decoded.width;
+      create_img.height = decoded.height;
+
       layer->image = create_img;
       (*images)[key] = create_img;
+      (*pixels)[key] = decoded;
     }
+    layer->image_key = key;
+    layer->tileset_path = arena->bump_string(tileset_path);
   }
 
   Slice<TilemapInt> grid = {};
   if (int_grid_csv != nullptr) {
     PROFILE_BLOCK("int grid");
 
-    i32 len = int_grid_csv->index + 1;
-    grid.resize(arena, len);
-    for (JSONArray *a = int_grid_csv; a != nullptr; a = a->next) {
-      grid[--len] = (TilemapInt)a->value.as_number(ok);
+    grid.resize(arena, int_grid_csv->len);
+    for (u64 i = 0; i < int_grid_csv->len; i++) {
+      grid[i] = (TilemapInt)(*int_grid_csv)[i].as_number(ok);
     }
   }
   layer->int_grid = grid;
@@ -75,11 +199,11 @@ static bool layer_from_json(TilemapLayer *layer, JSON *json, bool *ok,
   if (arr_tiles != nullptr) {
     PROFILE_BLOCK("tiles");
 
-    i32 len = arr_tiles->index + 1;
-    tiles.resize(arena, len);
-    for (JSONArray *a = arr_tiles; a != nullptr; a = a->next) {
-      JSON px = a->value.lookup("px", ok);
-      JSON src = a->value.lookup("src", ok);
+    tiles.resize(arena, arr_tiles->len);
+    for (u64 i = 0; i < arr_tiles->len; i++) {
+      JSON *value = &(*arr_tiles)[i];
+      JSON px = value->lookup("px", ok);
+      JSON src = value->lookup("src", ok);
 
       Tile tile = {};
       tile.x = px.index_number(0, ok);
@@ -88,50 +212,31 @@ static bool layer_from_json(TilemapLayer *layer, JSON *json, bool *ok,
       tile.u = src.index_number(0, ok);
       tile.v = src.index_number(1, ok);
 
-      tile.flip_bits = (i32)a->value.lookup_number("f", ok);
-      tiles[--len] = tile;
+      tile.flip_bits = (i32)value->lookup_number("f", ok);
+      tiles[i] = tile;
     }
   }
   layer->tiles = tiles;
 
-  for (Tile &tile : layer->tiles) {
-    tile.u0 = tile.u / layer->image.width;
-    tile.v0 = tile.v / layer->image.height;
-    tile.u1 = (tile.u + layer->grid_size) / layer->image.width;
-    tile.v1 = (tile.v + layer->grid_size) / layer->image.height;
-
-    i32 FLIP_X = 1 << 0;
-    i32 FLIP_Y = 1 << 1;
-
-    if (tile.flip_bits & FLIP_X) {
-      float tmp = tile.u0;
-      tile.u0 = tile.u1;
-      tile.u1 = tmp;
-    }
-
-    if (tile.flip_bits & FLIP_Y) {
-      float tmp = tile.v0;
-      tile.v0 = tile.v1;
-      tile.v1 = tmp;
-    }
-  }
+  layer_tile_uvs(layer);
+  layer_make_chunks(layer, arena);
 
   Slice<TilemapEntity> entities = {};
   if (entity_instances != nullptr) {
     PROFILE_BLOCK("entities");
 
-    i32 len = entity_instances->index + 1;
-    entities.resize(arena, len);
-    for (JSONArray *a = entity_instances; a != nullptr; a = a->next) {
-      JSON px = a->value.lookup("px", ok);
+    entities.resize(arena, entity_instances->len);
+    for (u64 i = 0; i < entity_instances->len; i++) {
+      JSON *value = &(*entity_instances)[i];
+      JSON px = value->lookup("px", ok);
 
       TilemapEntity entity = {};
       entity.x = px.index_number(0, ok);
       entity.y = px.index_number(1, ok);
       entity.identifier =
-          arena->bump_string(a->value.lookup_string("__identifier", ok));
+          arena->bump_string(value->lookup_string("__identifier", ok));
 
-      entities[--len] = entity;
+      entities[i] = entity;
     }
   }
   layer->entities = entities;
@@ -139,50 +244,108 @@ static bool layer_from_json(TilemapLayer *layer, JSON *json, bool *ok,
   return true;
 }
 
-static bool level_from_json(TilemapLevel *level, JSON *json, bool *ok,
-                            Arena *arena, String filepath,
-                            HashMap<Image> *images) {
+static void layer_make_vertex_buffer(TilemapLayer *layer) {
   PROFILE_FUNC();
 
-  level->identifier = arena->bump_string(json->lookup_string("identifier", ok));
-  level->iid = arena->bump_string(json->lookup_string("iid", ok));
-  level->world_x = json->lookup_number("worldX", ok);
-  level->world_y = json->lookup_number("worldY", ok);
-  level->px_width = json->lookup_number("pxWid", ok);
-  level->px_height = json->lookup_number("pxHei", ok);
+  if (layer->tiles.len == 0) {
+    return;
+  }
 
-  JSONArray *layer_instances = json->lookup_array("layerInstances", ok);
+  u64 len = layer->tiles.len * 4;
+  BatchVertex *vertices = (BatchVertex *)mem_alloc(sizeof(BatchVertex) * len);
+  defer(mem_free(vertices));
+
+  Color white = {255, 255, 255, 255};
+  for (u64 i = 0; i < layer->tiles.len; i++) {
+    Tile tile = layer->tiles[i];
+    float x0 = tile.x;
+    float y0 = tile.y;
+    float x1 = tile.x + layer->grid_size;
+    float y1 = tile.y + layer->grid_size;
+
+    vertices[i * 4 + 0] = {x0, y0, tile.u0, tile.v0, white};
+    vertices[i * 4 + 1] = {x0, y1, tile.u0, tile.v1, white};
+    vertices[i * 4 + 2] = {x1, y1, tile.u1, tile.v1, white};
+    vertices[i * 4 + 3] = {x1, y0, tile.u1, tile.v0, white};
+  }
 
+  sg_buffer_desc desc = {};
+  desc.data = {vertices, sizeof(BatchVertex) * len};
+  desc.label = "tilemap-layer";
+
+  LockGuard lock{&g_app->gpu_mtx};
+  layer->vertex_buffer = sg_make_buffer(desc).id;
+}
+
+static bool layers_from_json(Slice<TilemapLayer> *out,
+                             JSONArray *layer_instances, bool *ok,
+                             Arena *arena, String filepath,
+                             HashMap<Image> *images,
+                             HashMap<ImagePixels> *pixels) {
   Slice<TilemapLayer> layers = {};
   if (layer_instances != nullptr) {
-    i32 len = layer_instances->index + 1;
-    layers.resize(arena, len);
-    for (JSONArray *a = layer_instances; a != nullptr; a = a->next) {
+    layers.resize(arena, layer_instances->len);
+    for (u64 i = 0; i < layer_instances->len; i++) {
       TilemapLayer layer = {};
-      bool success =
-          layer_from_json(&layer, &a->value, ok, arena, filepath, images);
+      bool success = layer_from_json(&layer, &(*layer_instances)[i], ok, arena,
+                                     filepath, images, pixels);
       if (!success) {
         return false;
       }
-      layers[--len] = layer;
+      layers[i] = layer;
     }
   }
-  level->layers = layers;
 
+  *out = layers;
   return true;
 }
 
-bool Tilemap::load(String filepath) {
+static bool level_from_json(TilemapLevel *level, JSON *json, bool *ok,
+                            Arena *arena, String filepath,
+                            HashMap<Image> *images,
+                            HashMap<ImagePixels> *pixels) {
+  PROFILE_FUNC();
+
+  level->identifier = arena->bump_string(json->lookup_string("identifier", ok));
+  level->iid = arena->bump_string(json->lookup_string("iid", ok));
+  level->world_x = json->lookup_number("worldX", ok);
+  level->world_y = json->lookup_number("worldY", ok);
+  level->px_width = json->lookup_number("pxWid", ok);
+  level->px_height = json->lookup_number("pxHei", ok);
+
+  // null when the level is inside the map file, missing in old versions
+  bool found = true;
+  JSON external = json->lookup("externalRelPath", &found);
+  if (external.kind == JSONKind_String) {
+    String rel = external.as_string(ok);
+    u64 slash = filepath.last_of('/');
+    i32 dir_len = slash == (u64)-1 ? 0 : (i32)slash + 1;
+    level->external = arena->bump_string(tmp_fmt(
+        "%.*s%.*s", dir_len, filepath.data, (i32)rel.len, rel.data));
+
+    // layers are read from the level file
+    return true;
+  }
+
+  JSONArray *layer_instances = json->lookup_array("layerInstances", ok);
+  return layers_from_json(&level->layers, layer_instances, ok, arena,
+                          filepath, images, pixels);
+}
+
+// layers of a level saved in its own file
+static bool level_layers_from_file(Slice<TilemapLayer> *out,
+                                   String level_path, String filepath,
+                                   Arena *arena, HashMap<Image> *images,
+                                   HashMap<ImagePixels> *pixels) {
   PROFILE_FUNC();
 
   String contents = {};
-  bool success = vfs_read_entire_file(&contents, filepath);
-  if (!success) {
+  bool ok = vfs_read_entire_file(&contents, level_path);
+  if (!ok) {
     return false;
   }
   defer(mem_free(contents.data));
 
-  bool ok = true;
   JSONDocument doc = {};
   doc.parse(contents);
   defer(doc.trash());
@@ -191,374 +354,3145 @@ bool Tilemap::load(String filepath) {
     return false;
   }
 
-  Arena arena = {};
-  HashMap<Image> images = {};
-  bool created = false;
-  defer({
-    if (!created) {
-      for (auto [k, v] : images) {
-        v->trash();
-      }
-      images.trash();
-      arena.trash();
+  JSONArray *layer_instances = doc.root.lookup_array("layerInstances", &ok);
+  bool success = layers_from_json(out, layer_instances, &ok, arena, filepath,
+                                  images, pixels);
+  return success && ok;
+}
+
+// cooked tilemaps are written next to the source file (map.ldtk.cooked) and
+// loaded instead of parsing the json while the source hasn't changed. the
+// file is one block: a header, then the levels, layers, tiles, chunks, int
+// grids and entities as flat arrays. pointers are stored as offsets from the
+// start of the file, and are fixed up after it's copied into the arena
+#define TILEMAP_COOKED_VERSION 2
+
+struct TilemapCookedHeader {
+  char magic[8];
+  u32 version;
+  u32 sizes[4]; // Tile, TilemapEntity, TilemapLayer, TilemapLevel
+  u64 file_size;
+  u64 source_size;
+  u64 source_modtime;
+  u64 source_hash;
+  Slice<TilemapLevel> levels;
+};
+
+static const char TILEMAP_COOKED_MAGIC[8] = {'S', 'P', 'R', 'Y',
+                                             'M', 'A', 'P', '1'};
+
+static const u32 TILEMAP_COOKED_SIZES[4] = {
+    sizeof(Tile),
+    sizeof(TilemapEntity),
+    sizeof(TilemapLayer),
+    sizeof(TilemapLevel),
+};
+
+struct TilemapCooker {
+  Array<u8> bytes;
+
+  u64 write(const void *data, u64 size) {
+    u64 offset = (bytes.len + 15) & ~(u64)15;
+    if (offset + size > bytes.capacity) {
+      u64 cap = bytes.capacity * 2;
+      bytes.reserve(cap > offset + size ? cap : offset + size);
     }
-  });
 
-  JSONArray *arr_levels = doc.root.lookup_array("levels", &ok);
+    memset(&bytes.data[bytes.len], 0, offset - bytes.len);
+    memcpy(&bytes.data[offset], data, size);
+    bytes.len = offset + size;
+    return offset;
+  }
 
-  Slice<TilemapLevel> levels = {};
-  if (arr_levels != nullptr) {
-    i32 len = arr_levels->index + 1;
-    levels.resize(&arena, len);
-    for (JSONArray *a = arr_levels; a != nullptr; a = a->next) {
-      TilemapLevel level = {};
-      bool success =
-          level_from_json(&level, &a->value, &ok, &arena, filepath, &images);
-      if (!success) {
-        return false;
+  String string(String s) {
+    if (s.len == 0) {
+      return {};
+    }
+
+    // arena strings are null terminated, keep it
+    u64 offset = write(s.data, s.len + 1);
+    return {(char *)(uintptr_t)offset, s.len};
+  }
+
+  template <typename T> Slice<T> slice(Slice<T> s) {
+    Slice<T> out = {};
+    if (s.len > 0) {
+      out.data = (T *)(uintptr_t)write(s.data, sizeof(T) * s.len);
+      out.len = s.len;
+    }
+    return out;
+  }
+
+  template <typename T> T *at(Slice<T> s, u64 i) {
+    return (T *)&bytes.data[(uintptr_t)s.data] + i;
+  }
+};
+
+static void tilemap_write_cooked(Tilemap *tm, String filepath,
+                                 String source, u64 modtime) {
+  PROFILE_FUNC();
+
+  TilemapCooker cook = {};
+  defer(cook.bytes.trash());
+
+  TilemapCookedHeader header = {};
+  cook.write(&header, sizeof(header));
+
+  Slice<TilemapLevel> levels = cook.slice(tm->levels);
+  for (u64 i = 0; i < levels.len; i++) {
+    TilemapLevel level = tm->levels[i];
+    level.identifier = cook.string(level.identifier);
+    level.iid = cook.string(level.iid);
+    level.external = cook.string(level.external);
+
+    Slice<TilemapLayer> layers = cook.slice(level.layers);
+    for (u64 j = 0; j < layers.len; j++) {
+      TilemapLayer layer = level.layers[j];
+      layer.identifier = cook.string(layer.identifier);
+      layer.tileset_path = cook.string(layer.tileset_path);
+      layer.image = {};
+      layer.vertex_buffer = 0;
+      layer.tiles = cook.slice(layer.tiles);
+      layer.chunks = cook.slice(layer.chunks);
+      layer.int_grid = cook.slice(layer.int_grid);
+
+      Slice<TilemapEntity> entities = cook.slice(layer.entities);
+      for (u64 k = 0; k < entities.len; k++) {
+        TilemapEntity entity = layer.entities[k];
+        entity.identifier = cook.string(entity.identifier);
+        *cook.at(entities, k) = entity;
       }
-      levels[--len] = level;
+      layer.entities = entities;
+
+      *cook.at(layers, j) = layer;
     }
+    level.layers = layers;
+
+    *cook.at(levels, i) = level;
   }
 
-  if (!ok) {
+  memcpy(header.magic, TILEMAP_COOKED_MAGIC, sizeof(header.magic));
+  header.version = TILEMAP_COOKED_VERSION;
+  memcpy(header.sizes, TILEMAP_COOKED_SIZES, sizeof(header.sizes));
+  header.file_size = cook.bytes.len;
+  header.source_size = source.len;
+  header.source_modtime = modtime;
+  header.source_hash = fnv1a(source);
+  header.levels = levels;
+  memcpy(cook.bytes.data, &header, sizeof(header));
+
+  // fails on read only mounts, which keep parsing the json
+  String path = tmp_fmt("%.*s.cooked", (i32)filepath.len, filepath.data);
+  vfs_write_entire_file(path, {(char *)cook.bytes.data, cook.bytes.len});
+}
+
+static bool tilemap_cooked_header(String cooked, TilemapCookedHeader *out) {
+  if (cooked.len < sizeof(TilemapCookedHeader)) {
     return false;
   }
 
-  Tilemap tilemap = {};
-  tilemap.arena = arena;
-  tilemap.levels = levels;
-  tilemap.images = images;
+  TilemapCookedHeader header = {};
+  memcpy(&header, cooked.data, sizeof(header));
 
-  printf("loaded tilemap with %llu levels\n",
-         (unsigned long long)tilemap.levels.len);
-  *this = tilemap;
-  created = true;
+  if (memcmp(header.magic, TILEMAP_COOKED_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TILEMAP_COOKED_VERSION ||
+      memcmp(header.sizes, TILEMAP_COOKED_SIZES, sizeof(header.sizes)) != 0 ||
+      header.file_size != cooked.len) {
+    return false;
+  }
+
+  *out = header;
   return true;
 }
 
-void Tilemap::trash() {
-  for (auto [k, v] : images) {
-    v->trash();
+template <typename T> static bool cooked_fix(Slice<T> *s, String file) {
+  if (s->len == 0) {
+    s->data = nullptr;
+    return true;
   }
-  images.trash();
 
-  bodies.trash();
-  graph.trash();
-  frontier.trash();
+  u64 offset = (u64)(uintptr_t)s->data;
+  if (offset > file.len || s->len > (file.len - offset) / sizeof(T)) {
+    return false;
+  }
 
-  arena.trash();
+  s->data = (T *)&file.data[offset];
+  return true;
 }
 
-void Tilemap::destroy_bodies(b2World *world) {
-  for (auto [k, v] : bodies) {
-    world->DestroyBody(*v);
+static bool cooked_fix(String *s, String file) {
+  if (s->len == 0) {
+    s->data = nullptr;
+    return true;
+  }
+
+  u64 offset = (u64)(uintptr_t)s->data;
+  if (offset > file.len || s->len + 1 > file.len - offset) {
+    return false;
   }
+
+  s->data = &file.data[offset];
+  return s->data[s->len] == '\0';
 }
 
-static void make_collision_for_layer(b2Body *body, TilemapLayer *layer,
-                                     float world_x, float world_y, float meter,
-                                     Slice<TilemapInt> walls) {
+static bool tilemap_decode_cooked(Tilemap *tm, String cooked,
+                                  TilemapCookedHeader header,
+                                  HashMap<ImagePixels> *pixels) {
   PROFILE_FUNC();
 
-  auto is_wall = [layer, walls](i32 y, i32 x) {
-    if (x >= layer->c_width || y >= layer->c_height) {
-      return false;
+  Arena arena = {};
+  HashMap<Image> images = {};
+  HashMap<ImagePixels> decoded = {};
+  bool created = false;
+  defer({
+    if (!created) {
+      for (auto [k, v] : decoded) {
+        v->trash();
+      }
+      images.trash();
+      arena.trash();
     }
+    decoded.trash();
+  });
 
-    for (TilemapInt n : walls) {
-      if (layer->int_grid[y * layer->c_width + x] == n) {
-        return true;
+  // one copy into the arena, then pointers are fixed up in place
+  String file = {(char *)arena.bump(cooked.len), cooked.len};
+  memcpy(file.data, cooked.data, cooked.len);
+
+  Slice<TilemapLevel> levels = header.levels;
+  bool ok = cooked_fix(&levels, file);
+  for (u64 i = 0; ok && i < levels.len; i++) {
+    TilemapLevel *level = &levels[i];
+    ok = cooked_fix(&level->identifier, file) &&
+         cooked_fix(&level->iid, file) && cooked_fix(&level->external, file) &&
+         cooked_fix(&level->layers, file);
+
+    for (u64 j = 0; ok && j < level->layers.len; j++) {
+      TilemapLayer *layer = &level->layers[j];
+      ok = cooked_fix(&layer->identifier, file) &&
+           cooked_fix(&layer->tileset_path, file) &&
+           cooked_fix(&layer->tiles, file) &&
+           cooked_fix(&layer->chunks, file) &&
+           cooked_fix(&layer->int_grid, file) &&
+           cooked_fix(&layer->entities, file);
+
+      for (u64 k = 0; ok && k < layer->entities.len; k++) {
+        ok = cooked_fix(&layer->entities[k].identifier, file);
       }
     }
+  }
 
+  if (!ok) {
     return false;
-  };
-
-  Array<bool> filled = {};
-  defer(filled.trash());
-  filled.resize(layer->c_width * layer->c_height);
-  memset(filled.data, 0, layer->c_width * layer->c_height);
-  for (i32 y = 0; y < layer->c_height; y++) {
-    for (i32 x = 0; x < layer->c_width; x++) {
-      i32 x0 = x;
-      i32 y0 = y;
-      i32 x1 = x;
-      i32 y1 = y;
-
-      if (!is_wall(y1, x1)) {
-        continue;
-      }
+  }
 
-      if (filled[y1 * layer->c_width + x1]) {
+  for (TilemapLevel &level : levels) {
+    for (TilemapLayer &layer : level.layers) {
+      if (layer.tileset_path.len == 0) {
         continue;
       }
 
-      while (is_wall(y1, x1 + 1)) {
-        x1++;
-      }
-
-      while (true) {
-        bool walkable = false;
-        for (i32 x = x0; x <= x1; x++) {
-          if (!is_wall(y1 + 1, x)) {
-            walkable = true;
-          }
-        }
-
-        if (walkable) {
-          break;
+      u64 key = fnv1a(layer.tileset_path);
+      Image *img = images.get(key);
+      if (img == nullptr) {
+        ImagePixels image_pixels = {};
+        bool success = image_pixels.load(layer.tileset_path, false);
+        if (!success) {
+          return false;
         }
 
-        y1++;
-      }
+        // uploaded later by Tilemap::upload
+        Image create_img = {};
+        create_img.width = image_pixels.width;
+        create_img.height = image_pixels.height;
 
-      for (i32 y = y0; y <= y1; y++) {
-        for (i32 x = x0; x <= x1; x++) {
-          filled[y * layer->c_width + x] = true;
-        }
+        images[key] = create_img;
+        decoded[key] = image_pixels;
+        img = images.get(key);
       }
 
-      float dx = (float)(x1 + 1 - x0) * layer->grid_size / 2.0f;
-      float dy = (float)(y1 + 1 - y0) * layer->grid_size / 2.0f;
+      layer.image = *img;
+      layer.image_key = key;
 
-      b2Vec2 pos = {
-          (x0 * layer->grid_size + dx + world_x) / meter,
-          (y0 * layer->grid_size + dy + world_y) / meter,
-      };
+      // the tileset may have been resized since the map was cooked
+      layer_tile_uvs(&layer);
+    }
+  }
 
-      b2PolygonShape box = {};
-      box.SetAsBox(dx / meter, dy / meter, pos, 0.0f);
+  for (auto [k, v] : decoded) {
+    (*pixels)[k] = *v;
+  }
 
-      b2FixtureDef def = {};
-      def.friction = 0;
-      def.shape = &box;
+  Tilemap tilemap = {};
+  tilemap.arena = arena;
+  tilemap.levels = levels;
+  tilemap.images = images;
 
-      body->CreateFixture(&def);
-    }
-  }
+  *tm = tilemap;
+  created = true;
+  return true;
 }
 
-void Tilemap::make_collision(b2World *world, float meter, String layer_name,
-                             Slice<TilemapInt> walls) {
+static bool tilemap_decode_json(Tilemap *tm, String filepath, String contents,
+                                HashMap<ImagePixels> *pixels) {
   PROFILE_FUNC();
 
-  b2Body *body = nullptr;
-  {
-    b2BodyDef def = {};
-    def.position.x = 0;
-    def.position.y = 0;
-    def.fixedRotation = true;
-    def.allowSleep = true;
-    def.awake = false;
-    def.type = b2_staticBody;
-    def.gravityScale = 0;
+  bool ok = true;
+  JSONDocument doc = {};
+  doc.parse(contents);
+  defer(doc.trash());
 
-    body = world->CreateBody(&def);
+  if (doc.error.len != 0) {
+    return false;
   }
 
-  for (TilemapLevel &level : levels) {
-    for (TilemapLayer &l : level.layers) {
-      if (l.identifier == layer_name) {
-        make_collision_for_layer(body, &l, level.world_x, level.world_y, meter,
-                                 walls);
+  Arena arena = {};
+  HashMap<Image> images = {};
+  bool created = false;
+  defer({
+    if (!created) {
+      images.trash();
+      arena.trash();
+    }
+  });
+
+  JSONArray *arr_levels = doc.root.lookup_array("levels", &ok);
+
+  Slice<TilemapLevel> levels = {};
+  if (arr_levels != nullptr) {
+    levels.resize(&arena, arr_levels->len);
+    for (u64 i = 0; i < arr_levels->len; i++) {
+      TilemapLevel level = {};
+      bool success = level_from_json(&level, &(*arr_levels)[i], &ok, &arena,
+                                     filepath, &images, pixels);
+      if (!success) {
+        return false;
       }
+      levels[i] = level;
     }
   }
 
-  bodies[fnv1a(layer_name)] = body;
-}
+  if (!ok) {
+    return false;
+  }
+
+  Tilemap tilemap = {};
+  tilemap.arena = arena;
+  tilemap.levels = levels;
+  tilemap.images = images;
+
+  *tm = tilemap;
+  created = true;
+  return true;
+}
+
+static bool tilemap_decode_map(Tilemap *tm, String filepath,
+                               HashMap<ImagePixels> *pixels) {
+  // for the tmp_fmt paths in here, since spry.thread never resets its
+  // frame arena
+  ScratchArena scratch;
+
+  u64 modtime =
+      os_file_modtime(tmp_fmt("%.*s", (i32)filepath.len, filepath.data).data);
+  String cooked_path =
+      tmp_fmt("%.*s.cooked", (i32)filepath.len, filepath.data);
+
+  String contents = {};
+  defer(mem_free(contents.data));
+
+  String cooked = {};
+  if (vfs_read_entire_file(&cooked, cooked_path)) {
+    defer(mem_free(cooked.data));
+
+    TilemapCookedHeader header = {};
+    if (tilemap_cooked_header(cooked, &header)) {
+      // a matching modtime is enough, since it has sub-second resolution.
+      // otherwise (or inside a zip, where there's no modtime) compare
+      // against the source contents
+      bool fresh = modtime != 0 && header.source_modtime == modtime;
+      if (!fresh && vfs_read_entire_file(&contents, filepath)) {
+        fresh = header.source_size == contents.len &&
+                header.source_hash == fnv1a(contents);
+
+        if (fresh && modtime != 0) {
+          header.source_modtime = modtime;
+          memcpy(cooked.data, &header, sizeof(header));
+          vfs_write_entire_file(cooked_path, cooked);
+        }
+      }
+
+      if (fresh && tilemap_decode_cooked(tm, cooked, header, pixels)) {
+        return true;
+      }
+    }
+  }
+
+  if (contents.data == nullptr &&
+      !vfs_read_entire_file(&contents, filepath)) {
+    return false;
+  }
+
+  if (!tilemap_decode_json(tm, filepath, contents, pixels)) {
+    return false;
+  }
+
+  tilemap_write_cooked(tm, filepath, contents, modtime);
+  return true;
+}
+
+static TilemapStream *tilemap_stream_make(Tilemap *tm, String filepath) {
+  TilemapStream *stream = (TilemapStream *)mem_alloc(sizeof(TilemapStream));
+  *stream = {};
+  stream->filepath = to_cstr(filepath);
+  stream->levels.resize(tm->levels.len);
+  for (u64 i = 0; i < tm->levels.len; i++) {
+    TilemapStreamLevel sl = {};
+    sl.state = tm->levels[i].external.len == 0 ? TilemapLevelState_Loaded
+                                                : TilemapLevelState_Unloaded;
+    stream->levels[i] = sl;
+  }
+  return stream;
+}
+
+bool Tilemap::decode(String filepath, bool stream_levels,
+                     HashMap<ImagePixels> *pixels) {
+  PROFILE_FUNC();
+
+  if (!tilemap_decode_map(this, filepath, pixels)) {
+    return false;
+  }
+
+  if (stream_levels) {
+    stream = tilemap_stream_make(this, filepath);
+    return true;
+  }
+
+  // levels in separate files aren't part of the cooked map, since it would
+  // go stale when they change
+  for (TilemapLevel &level : levels) {
+    if (level.external.len == 0) {
+      continue;
+    }
+
+    bool ok = level_layers_from_file(&level.layers, level.external, filepath,
+                                     &arena, &images, pixels);
+    if (!ok) {
+      images.trash();
+      arena.trash();
+      *this = {};
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void Tilemap::upload(HashMap<ImagePixels> *pixels) {
+  PROFILE_FUNC();
+
+  for (auto [k, v] : *pixels) {
+    images[k].upload(v);
+  }
+
+  for (TilemapLevel &level : levels) {
+    for (TilemapLayer &layer : level.layers) {
+      Image *img = images.get(layer.image_key);
+      if (img != nullptr) {
+        layer.image = *img;
+      }
+      layer_make_vertex_buffer(&layer);
+    }
+  }
+
+  printf("loaded tilemap with %llu levels\n", (unsigned long long)levels.len);
+}
+
+bool Tilemap::load(String filepath, bool stream_levels) {
+  PROFILE_FUNC();
+
+  HashMap<ImagePixels> pixels = {};
+  defer({
+    for (auto [k, v] : pixels) {
+      v->trash();
+    }
+    pixels.trash();
+  });
+
+  bool ok = decode(filepath, stream_levels, &pixels);
+  if (!ok) {
+    return false;
+  }
+
+  upload(&pixels);
+  return true;
+}
+
+static void tile_collision_layer_trash(TileCollisionLayer *cl) {
+  for (TileCollisionFixture &f : cl->fixtures) {
+    f.edges.trash();
+  }
+  cl->fixtures.trash();
+  cl->free_fixtures.trash();
+  cl->solid.trash();
+  cl->owners.trash();
+  cl->outline.trash();
+}
+
+static void tile_collision_body_trash(TileCollisionBody *body) {
+  for (TileCollisionLayer &cl : body->layers) {
+    tile_collision_layer_trash(&cl);
+  }
+  body->layers.trash();
+  body->walls.trash();
+}
+
+void tilemap_level_load_release(TilemapLevelLoad *load) {
+  if (load->refs.fetch_sub(1) == 1) {
+    for (auto [k, v] : load->pixels) {
+      v->trash();
+    }
+    load->pixels.trash();
+    load->images.trash();
+    load->arena.trash();
+    mem_free(load->filepath.data);
+    mem_free(load->level_path.data);
+    mem_free(load);
+  }
+}
+
+static void tilemap_stream_trash(TilemapStream *stream) {
+  for (TilemapStreamLevel &sl : stream->levels) {
+    if (sl.load != nullptr) {
+      tilemap_level_load_release(sl.load);
+    }
+  }
+  stream->levels.trash();
+
+  for (auto [k, v] : stream->images) {
+    v->trash();
+  }
+  stream->images.trash();
+  stream->image_users.trash();
+
+  mem_free(stream->filepath.data);
+  mem_free(stream);
+}
+
+void Tilemap::trash() {
+  for (TilemapLevel &level : levels) {
+    for (TilemapLayer &layer : level.layers) {
+      if (layer.vertex_buffer != 0) {
+        LockGuard lock{&g_app->gpu_mtx};
+        sg_destroy_buffer({layer.vertex_buffer});
+      }
+    }
+  }
+
+  for (auto [k, v] : images) {
+    v->trash();
+  }
+  images.trash();
+
+  for (auto [k, v] : bodies) {
+    tile_collision_body_trash(v);
+  }
+  bodies.trash();
+
+  if (graph != nullptr) {
+    tile_graph_release(graph);
+  }
+  graph_costs.trash();
+
+  // after the vertex buffers, streamed layers live in the level loads
+  if (stream != nullptr) {
+    tilemap_stream_trash(stream);
+  }
+
+  arena.trash();
+}
+
+void Tilemap::destroy_bodies(b2World *world) {
+  for (auto [k, v] : bodies) {
+    world->DestroyBody(v->body);
+    tile_collision_body_trash(v);
+  }
+  bodies.clear();
+}
+
+struct TileWalls {
+  bool *cells;
+  i32 width, height;
+
+  bool at(i32 x, i32 y) {
+    if (x < 0 || y < 0 || x >= width || y >= height) {
+      return false;
+    }
+    return cells[y * width + x];
+  }
+
+  // quadrants around lattice point (x, y). 1: top left, 2: top right,
+  // 4: bottom left, 8: bottom right
+  i32 corners(i32 x, i32 y) {
+    return (at(x - 1, y - 1) ? 1 : 0) | (at(x, y - 1) ? 2 : 0) |
+           (at(x - 1, y) ? 4 : 0) | (at(x, y) ? 8 : 0);
+  }
+
+  // outline edge leaving lattice point (x, y), with the wall on its left
+  bool edge(i32 x, i32 y, i32 dir) {
+    switch (dir) {
+    case 0: return at(x, y) && !at(x, y - 1);
+    case 1: return at(x - 1, y) && !at(x, y);
+    case 2: return at(x - 1, y - 1) && !at(x - 1, y);
+    case 3: return at(x, y - 1) && !at(x - 1, y - 1);
+    default: return false;
+    }
+  }
+};
+
+static bool tile_is_wall(TileCollisionBody *body, TilemapInt n) {
+  for (TilemapInt wall : body->walls) {
+    if (wall == n) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static TileWalls tile_layer_walls(TileCollisionLayer *cl) {
+  TileWalls walls = {};
+  walls.cells = cl->solid.data;
+  walls.width = cl->layer->c_width;
+  walls.height = cl->layer->c_height;
+  return walls;
+}
+
+struct TileCollider {
+  TileCollisionBody *body;
+  TileCollisionLayer *layer;
+  i32 ox, oy; // cell offset of the walls being meshed
+  i32 fixtures;
+  i32 proxies;
+  Array<i32> edges; // outline edges of the loop being traced
+
+  i32 add(b2Shape *shape) {
+    b2FixtureDef def = {};
+    def.friction = 0;
+    def.shape = shape;
+
+    i32 slot = 0;
+    if (layer->free_fixtures.len > 0) {
+      slot = layer->free_fixtures[layer->free_fixtures.len - 1];
+      layer->free_fixtures.len--;
+    } else {
+      slot = (i32)layer->fixtures.len;
+      layer->fixtures.push({});
+    }
+
+    layer->fixtures[slot].fixture = body->body->CreateFixture(&def);
+    fixtures++;
+    proxies += shape->GetChildCount();
+    return slot;
+  }
+
+  // cells x0..x1 and y0..y1, inclusive
+  void box(i32 x0, i32 y0, i32 x1, i32 y1) {
+    x0 += ox;
+    y0 += oy;
+    x1 += ox;
+    y1 += oy;
+
+    float grid_size = layer->layer->grid_size;
+    float meter = body->meter;
+    float dx = (float)(x1 + 1 - x0) * grid_size / 2.0f;
+    float dy = (float)(y1 + 1 - y0) * grid_size / 2.0f;
+
+    b2Vec2 pos = {
+        (x0 * grid_size + dx + layer->level->world_x) / meter,
+        (y0 * grid_size + dy + layer->level->world_y) / meter,
+    };
+
+    b2PolygonShape box = {};
+    box.SetAsBox(dx / meter, dy / meter, pos, 0.0f);
+
+    i32 slot = add(&box);
+    TileCollisionFixture *f = &layer->fixtures[slot];
+    f->x0 = x0;
+    f->y0 = y0;
+    f->x1 = x1;
+    f->y1 = y1;
+
+    i32 width = layer->layer->c_width;
+    for (i32 y = y0; y <= y1; y++) {
+      for (i32 x = x0; x <= x1; x++) {
+        layer->owners[y * width + x] = slot;
+      }
+    }
+  }
+
+  // lattice points, counter clockwise with y pointing down
+  void loop(Slice<b2Vec2> points) {
+    float grid_size = layer->layer->grid_size;
+    float meter = body->meter;
+    for (b2Vec2 &p : points) {
+      p = {
+          (p.x * grid_size + layer->level->world_x) / meter,
+          (p.y * grid_size + layer->level->world_y) / meter,
+      };
+    }
+
+    b2ChainShape chain = {};
+    chain.CreateLoop(points.data, (i32)points.len);
+
+    i32 slot = add(&chain);
+    TileCollisionFixture *f = &layer->fixtures[slot];
+    f->edges.len = 0;
+    for (i32 e : edges) {
+      f->edges.push(e);
+      layer->owners[e] = slot;
+    }
+  }
+};
+
+static void tile_collision_free(TileCollider *c, i32 slot) {
+  TileCollisionLayer *layer = c->layer;
+  TileCollisionFixture *f = &layer->fixtures[slot];
+
+  c->body->body->DestroyFixture(f->fixture);
+  f->fixture = nullptr;
+
+  if (c->body->mode == TileCollision_Chains) {
+    for (i32 e : f->edges) {
+      layer->owners[e] = -1;
+    }
+  } else {
+    i32 width = layer->layer->c_width;
+    for (i32 y = f->y0; y <= f->y1; y++) {
+      for (i32 x = f->x0; x <= f->x1; x++) {
+        layer->owners[y * width + x] = -1;
+      }
+    }
+  }
+
+  layer->free_fixtures.push(slot);
+}
+
+static void make_greedy_boxes(TileCollider *c, TileWalls walls) {
+  PROFILE_FUNC();
+
+  ScratchArena scratch;
+  u64 cells = walls.width * walls.height;
+  bool *filled = (bool *)scratch.bump(cells);
+  memset(filled, 0, cells);
+  for (i32 y = 0; y < walls.height; y++) {
+    for (i32 x = 0; x < walls.width; x++) {
+      i32 x0 = x;
+      i32 y0 = y;
+      i32 x1 = x;
+      i32 y1 = y;
+
+      if (!walls.at(x1, y1)) {
+        continue;
+      }
+
+      if (filled[y1 * walls.width + x1]) {
+        continue;
+      }
+
+      while (walls.at(x1 + 1, y1) && !filled[y1 * walls.width + x1 + 1]) {
+        x1++;
+      }
+
+      while (true) {
+        bool walkable = false;
+        for (i32 x = x0; x <= x1; x++) {
+          if (!walls.at(x, y1 + 1) || filled[(y1 + 1) * walls.width + x]) {
+            walkable = true;
+          }
+        }
+
+        if (walkable) {
+          break;
+        }
+
+        y1++;
+      }
+
+      for (i32 y = y0; y <= y1; y++) {
+        for (i32 x = x0; x <= x1; x++) {
+          filled[y * walls.width + x] = true;
+        }
+      }
+
+      c->box(x0, y0, x1, y1);
+    }
+  }
+}
+
+// segment between two reflex corners, on lattice points
+struct TileChord {
+  i32 x0, y0, x1, y1;
+};
+
+static bool tile_chords_cross(TileChord h, TileChord v) {
+  return h.x0 <= v.x0 && v.x0 <= h.x1 && v.y0 <= h.y0 && h.y0 <= v.y1;
+}
+
+// fewest rectangles. the largest set of non crossing chords between reflex
+// corners is found with bipartite matching (horizontal against vertical
+// chords), those chords are cut, and every reflex corner left over is cut
+// vertically until it meets a wall or another cut
+static void make_min_rects(TileCollider *c, TileWalls walls) {
+  PROFILE_FUNC();
+
+  i32 w = walls.width;
+  i32 h = walls.height;
+  i32 pw = w + 1;
+
+  // cut directions away from the one empty quadrant, or 0 if not reflex
+  auto reflex = [&](i32 x, i32 y, i32 *dx, i32 *dy) {
+    i32 mask = walls.corners(x, y);
+    i32 empty = 15 ^ mask;
+    if (empty == 0 || (empty & (empty - 1)) != 0) {
+      return false;
+    }
+
+    *dx = (empty & (1 | 4)) ? 1 : -1;
+    *dy = (empty & (1 | 2)) ? 1 : -1;
+    return true;
+  };
+
+  Array<TileChord> hchords = {};
+  defer(hchords.trash());
+  Array<TileChord> vchords = {};
+  defer(vchords.trash());
+
+  for (i32 y = 0; y <= h; y++) {
+    for (i32 x = 0; x <= w; x++) {
+      i32 dx = 0, dy = 0;
+      if (!reflex(x, y, &dx, &dy)) {
+        continue;
+      }
+
+      if (dx > 0) {
+        for (i32 x1 = x + 1; x1 <= w; x1++) {
+          i32 mask = walls.corners(x1, y);
+          if (mask != 15) {
+            i32 rx = 0, ry = 0;
+            if (reflex(x1, y, &rx, &ry)) {
+              hchords.push({x, y, x1, y});
+            }
+            break;
+          }
+        }
+      }
+
+      if (dy > 0) {
+        for (i32 y1 = y + 1; y1 <= h; y1++) {
+          i32 mask = walls.corners(x, y1);
+          if (mask != 15) {
+            i32 rx = 0, ry = 0;
+            if (reflex(x, y1, &rx, &ry)) {
+              vchords.push({x, y, x, y1});
+            }
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  ScratchArena scratch;
+
+  bool *hcut = (bool *)scratch.bump(w * (h + 1));
+  memset(hcut, 0, w * (h + 1));
+  bool *vcut = (bool *)scratch.bump(pw * h);
+  memset(vcut, 0, pw * h);
+
+  if (hchords.len > 0 && vchords.len > 0) {
+    Array<u32> first = {};
+    defer(first.trash());
+    Array<i32> adjacent = {};
+    defer(adjacent.trash());
+
+    first.reserve(hchords.len + 1);
+    for (TileChord hc : hchords) {
+      first.push((u32)adjacent.len);
+      for (u64 i = 0; i < vchords.len; i++) {
+        if (tile_chords_cross(hc, vchords[i])) {
+          adjacent.push((i32)i);
+        }
+      }
+    }
+    first.push((u32)adjacent.len);
+
+    i32 hn = (i32)hchords.len;
+    i32 vn = (i32)vchords.len;
+    i32 *match_h = (i32 *)scratch.bump(sizeof(i32) * hn);
+    i32 *match_v = (i32 *)scratch.bump(sizeof(i32) * vn);
+    i32 *from = (i32 *)scratch.bump(sizeof(i32) * vn);
+    i32 *seen_h = (i32 *)scratch.bump(sizeof(i32) * hn);
+    i32 *seen_v = (i32 *)scratch.bump(sizeof(i32) * vn);
+    i32 *queue = (i32 *)scratch.bump(sizeof(i32) * hn);
+    memset(match_h, 0xff, sizeof(i32) * hn);
+    memset(match_v, 0xff, sizeof(i32) * vn);
+    memset(seen_h, 0xff, sizeof(i32) * hn);
+    memset(seen_v, 0xff, sizeof(i32) * vn);
+
+    // augmenting paths, breadth first from each horizontal chord
+    for (i32 root = 0; root < hn; root++) {
+      i32 head = 0, tail = 0;
+      queue[tail++] = root;
+      seen_h[root] = root;
+
+      bool augmented = false;
+      while (head < tail && !augmented) {
+        i32 u = queue[head++];
+        for (u32 i = first[u]; i < first[u + 1]; i++) {
+          i32 v = adjacent[i];
+          if (seen_v[v] == root) {
+            continue;
+          }
+          seen_v[v] = root;
+          from[v] = u;
+
+          if (match_v[v] == -1) {
+            while (v != -1) {
+              i32 hu = from[v];
+              i32 next = match_h[hu];
+              match_h[hu] = v;
+              match_v[v] = hu;
+              v = next;
+            }
+            augmented = true;
+            break;
+          }
+
+          if (seen_h[match_v[v]] != root) {
+            seen_h[match_v[v]] = root;
+            queue[tail++] = match_v[v];
+          }
+        }
+      }
+    }
+
+    // konig: alternating reachability from unmatched horizontal chords.
+    // reached horizontal and unreached vertical chords don't cross
+    i32 head = 0, tail = 0;
+    for (i32 u = 0; u < hn; u++) {
+      seen_h[u] = -1;
+      if (match_h[u] == -1) {
+        seen_h[u] = hn;
+        queue[tail++] = u;
+      }
+    }
+    for (i32 v = 0; v < vn; v++) {
+      seen_v[v] = -1;
+    }
+
+    while (head < tail) {
+      i32 u = queue[head++];
+      for (u32 i = first[u]; i < first[u + 1]; i++) {
+        i32 v = adjacent[i];
+        if (seen_v[v] == hn) {
+          continue;
+        }
+        seen_v[v] = hn;
+
+        i32 next = match_v[v];
+        if (next != -1 && seen_h[next] != hn) {
+          seen_h[next] = hn;
+          queue[tail++] = next;
+        }
+      }
+    }
+
+    for (i32 u = 0; u < hn; u++) {
+      if (seen_h[u] == hn) {
+        TileChord hc = hchords[u];
+        for (i32 x = hc.x0; x < hc.x1; x++) {
+          hcut[hc.y0 * w + x] = true;
+        }
+      }
+    }
+
+    for (i32 v = 0; v < vn; v++) {
+      if (seen_v[v] != hn) {
+        TileChord vc = vchords[v];
+        for (i32 y = vc.y0; y < vc.y1; y++) {
+          vcut[y * pw + vc.x0] = true;
+        }
+      }
+    }
+  } else {
+    for (TileChord hc : hchords) {
+      for (i32 x = hc.x0; x < hc.x1; x++) {
+        hcut[hc.y0 * w + x] = true;
+      }
+    }
+
+    for (TileChord vc : vchords) {
+      for (i32 y = vc.y0; y < vc.y1; y++) {
+        vcut[y * pw + vc.x0] = true;
+      }
+    }
+  }
+
+  for (i32 y = 0; y <= h; y++) {
+    for (i32 x = 0; x <= w; x++) {
+      i32 dx = 0, dy = 0;
+      if (!reflex(x, y, &dx, &dy)) {
+        continue;
+      }
+
+      bool cut_x = hcut[y * w + (dx > 0 ? x : x - 1)];
+      bool cut_y = vcut[(dy > 0 ? y : y - 1) * pw + x];
+      if (cut_x || cut_y) {
+        continue;
+      }
+
+      for (i32 y1 = y;;) {
+        i32 seg = dy > 0 ? y1 : y1 - 1;
+        if (seg < 0 || seg >= h || !walls.at(x - 1, seg) ||
+            !walls.at(x, seg)) {
+          break;
+        }
+
+        vcut[seg * pw + x] = true;
+        y1 += dy;
+
+        if ((x > 0 && hcut[y1 * w + x - 1]) || (x < w && hcut[y1 * w + x])) {
+          break;
+        }
+      }
+    }
+  }
+
+  // every region is a rectangle now
+  bool *filled = (bool *)scratch.bump(w * h);
+  memset(filled, 0, w * h);
+  for (i32 y0 = 0; y0 < h; y0++) {
+    for (i32 x0 = 0; x0 < w; x0++) {
+      if (!walls.at(x0, y0) || filled[y0 * w + x0]) {
+        continue;
+      }
+
+      i32 x1 = x0;
+      while (walls.at(x1 + 1, y0) && !vcut[y0 * pw + x1 + 1]) {
+        x1++;
+      }
+
+      i32 y1 = y0;
+      while (walls.at(x0, y1 + 1) && !hcut[(y1 + 1) * w + x0]) {
+        y1++;
+      }
+
+      for (i32 y = y0; y <= y1; y++) {
+        for (i32 x = x0; x <= x1; x++) {
+          filled[y * w + x] = true;
+        }
+      }
+
+      c->box(x0, y0, x1, y1);
+    }
+  }
+}
+
+// follow the edges marked in the layer's outline from a lattice point, and
+// make a chain for every loop found. where two walls touch diagonally,
+// turning left keeps them apart. straight runs become a single edge
+static void trace_wall_chains(TileCollider *c, i32 start) {
+  static const i32 dir_x[4] = {1, 0, -1, 0};
+  static const i32 dir_y[4] = {0, 1, 0, -1};
+  static const i32 turns[3] = {1, 0, 3}; // left, straight, right
+
+  u8 *out = c->layer->outline.data;
+  i32 pw = c->layer->layer->c_width + 1;
+
+  Array<b2Vec2> loop = {};
+  defer(loop.trash());
+
+  while (out[start] != 0) {
+    i32 first_dir = 0;
+    while ((out[start] & (1 << first_dir)) == 0) {
+      first_dir++;
+    }
+    out[start] &= ~(1 << first_dir);
+
+    loop.len = 0;
+    c->edges.len = 0;
+    c->edges.push(start * 4 + first_dir);
+
+    i32 x = start % pw + dir_x[first_dir];
+    i32 y = start / pw + dir_y[first_dir];
+    i32 dir = first_dir;
+
+    while (true) {
+      i32 p = y * pw + x;
+      i32 mask = out[p];
+      if (p == start) {
+        mask |= 1 << first_dir;
+      }
+
+      i32 next = -1;
+      for (i32 turn : turns) {
+        i32 d = (dir + turn) & 3;
+        if (mask & (1 << d)) {
+          next = d;
+          break;
+        }
+      }
+      assert(next != -1);
+
+      if (next != dir) {
+        loop.push({(float)x, (float)y});
+      }
+
+      if (p == start && next == first_dir) {
+        break;
+      }
+
+      out[p] &= ~(1 << next);
+      c->edges.push(p * 4 + next);
+      dir = next;
+      x += dir_x[dir];
+      y += dir_y[dir];
+    }
+
+    c->loop(Slice(loop));
+  }
+}
+
+// outlines of wall regions as closed loops, one chain per loop. edges run
+// with the wall on their left, so chain normals face out of the walls
+static void make_wall_chains(TileCollider *c, TileWalls walls) {
+  PROFILE_FUNC();
+
+  i32 pw = walls.width + 1;
+  i32 points = pw * (walls.height + 1);
+
+  u8 *out = c->layer->outline.data;
+  for (i32 p = 0; p < points; p++) {
+    for (i32 d = 0; d < 4; d++) {
+      if (walls.edge(p % pw, p / pw, d)) {
+        out[p] |= 1 << d;
+      }
+    }
+  }
+
+  for (i32 p = 0; p < points; p++) {
+    trace_wall_chains(c, p);
+  }
+}
+
+static void make_collision_for_layer(TileCollider *c) {
+  PROFILE_FUNC();
+
+  TileCollisionLayer *cl = c->layer;
+  TilemapLayer *layer = cl->layer;
+
+  cl->solid.resize(layer->c_width * layer->c_height);
+  for (u64 i = 0; i < cl->solid.len; i++) {
+    cl->solid[i] = tile_is_wall(c->body, layer->int_grid[i]);
+  }
+  TileWalls walls = tile_layer_walls(cl);
+
+  if (c->body->mode == TileCollision_Chains) {
+    u64 points = (u64)(layer->c_width + 1) * (layer->c_height + 1);
+    cl->owners.resize(points * 4);
+    cl->outline.resize(points);
+    memset(cl->outline.data, 0, points);
+  } else {
+    cl->owners.resize(layer->c_width * layer->c_height);
+  }
+
+  for (i32 &owner : cl->owners) {
+    owner = -1;
+  }
+
+  switch (c->body->mode) {
+  case TileCollision_Boxes: make_greedy_boxes(c, walls); break;
+  case TileCollision_Rects: make_min_rects(c, walls); break;
+  case TileCollision_Chains: make_wall_chains(c, walls); break;
+  }
+}
+
+void Tilemap::make_collision(b2World *world, float meter, String layer_name,
+                             Slice<TilemapInt> walls, TileCollision mode,
+                             Array<TileCollisionCount> *counts) {
+  PROFILE_FUNC();
+
+  TileCollisionBody *body = bodies.get(fnv1a(layer_name));
+  if (body != nullptr) {
+    tile_collision_body_trash(body);
+  } else {
+    body = &bodies[fnv1a(layer_name)];
+  }
+  *body = {};
+  body->meter = meter;
+  body->mode = mode;
+  body->walls.resize(walls.len);
+  memcpy(body->walls.data, walls.data, sizeof(TilemapInt) * walls.len);
+
+  {
+    b2BodyDef def = {};
+    def.position.x = 0;
+    def.position.y = 0;
+    def.fixedRotation = true;
+    def.allowSleep = true;
+    def.awake = false;
+    def.type = b2_staticBody;
+    def.gravityScale = 0;
+
+    body->body = world->CreateBody(&def);
+  }
+
+  for (TilemapLevel &level : levels) {
+    for (TilemapLayer &l : level.layers) {
+      if (l.identifier == layer_name) {
+        TileCollisionLayer cl = {};
+        cl.level = &level;
+        cl.layer = &l;
+        body->layers.push(cl);
+      }
+    }
+  }
+
+  for (TileCollisionLayer &cl : body->layers) {
+    TileCollider c = {};
+    c.body = body;
+    c.layer = &cl;
+    defer(c.edges.trash());
+
+    make_collision_for_layer(&c);
+
+    if (counts != nullptr) {
+      counts->push({cl.level->identifier, c.fixtures, c.proxies});
+    }
+  }
+}
+
+// rebuild the rectangles around a cell that changed. a new wall merges with
+// the rectangles next to it
+static void update_collision_rects(TileCollider *c, i32 x, i32 y,
+                                   TileWalls walls) {
+  TileCollisionLayer *cl = c->layer;
+  i32 width = walls.width;
+  bool wall = walls.at(x, y);
+
+  i32 slots[5] = {};
+  i32 count = 0;
+  auto add = [&](i32 nx, i32 ny) {
+    if (nx < 0 || ny < 0 || nx >= width || ny >= walls.height) {
+      return;
+    }
+
+    i32 slot = cl->owners[ny * width + nx];
+    for (i32 i = 0; i < count; i++) {
+      if (slots[i] == slot) {
+        return;
+      }
+    }
+
+    if (slot != -1) {
+      slots[count++] = slot;
+    }
+  };
+
+  add(x, y);
+  if (wall) {
+    add(x - 1, y);
+    add(x + 1, y);
+    add(x, y - 1);
+    add(x, y + 1);
+  }
+
+  i32 x0 = x, y0 = y, x1 = x, y1 = y;
+  for (i32 i = 0; i < count; i++) {
+    TileCollisionFixture *f = &cl->fixtures[slots[i]];
+    x0 = f->x0 < x0 ? f->x0 : x0;
+    y0 = f->y0 < y0 ? f->y0 : y0;
+    x1 = f->x1 > x1 ? f->x1 : x1;
+    y1 = f->y1 > y1 ? f->y1 : y1;
+  }
+
+  ScratchArena scratch;
+
+  TileWalls region = {};
+  region.width = x1 + 1 - x0;
+  region.height = y1 + 1 - y0;
+  u64 cells = region.width * region.height;
+  region.cells = (bool *)scratch.bump(cells);
+  memset(region.cells, 0, cells);
+
+  for (i32 i = 0; i < count; i++) {
+    TileCollisionFixture *f = &cl->fixtures[slots[i]];
+    for (i32 ry = f->y0; ry <= f->y1; ry++) {
+      for (i32 rx = f->x0; rx <= f->x1; rx++) {
+        region.cells[(ry - y0) * region.width + rx - x0] = walls.at(rx, ry);
+      }
+    }
+    tile_collision_free(c, slots[i]);
+  }
+  region.cells[(y - y0) * region.width + x - x0] = wall;
+
+  c->ox = x0;
+  c->oy = y0;
+  if (c->body->mode == TileCollision_Rects) {
+    make_min_rects(c, region);
+  } else {
+    make_greedy_boxes(c, region);
+  }
+}
+
+// retrace the loops that pass by the corners of a cell that changed. the
+// rest keep their fixtures
+static void update_collision_chains(TileCollider *c, i32 x, i32 y,
+                                    TileWalls walls) {
+  TileCollisionLayer *cl = c->layer;
+  i32 pw = walls.width + 1;
+
+  Array<i32> edges = {};
+  defer(edges.trash());
+
+  i32 corners[4] = {
+      y * pw + x,
+      y * pw + x + 1,
+      (y + 1) * pw + x,
+      (y + 1) * pw + x + 1,
+  };
+
+  for (i32 p : corners) {
+    for (i32 d = 0; d < 4; d++) {
+      i32 slot = cl->owners[p * 4 + d];
+      if (slot != -1) {
+        for (i32 e : cl->fixtures[slot].edges) {
+          edges.push(e);
+        }
+        tile_collision_free(c, slot);
+      }
+    }
+  }
+
+  // the four sides of the cell, either way around
+  edges.push(corners[0] * 4 + 0);
+  edges.push(corners[1] * 4 + 2);
+  edges.push(corners[1] * 4 + 1);
+  edges.push(corners[3] * 4 + 3);
+  edges.push(corners[2] * 4 + 0);
+  edges.push(corners[3] * 4 + 2);
+  edges.push(corners[0] * 4 + 1);
+  edges.push(corners[2] * 4 + 3);
+
+  for (i32 e : edges) {
+    i32 p = e / 4;
+    i32 d = e % 4;
+    if (cl->owners[e] == -1 && walls.edge(p % pw, p / pw, d)) {
+      cl->outline[p] |= 1 << d;
+    }
+  }
+
+  for (i32 e : edges) {
+    trace_wall_chains(c, e / 4);
+  }
+}
+
+static void update_collision(TileCollisionBody *body, TileCollisionLayer *cl,
+                             i32 x, i32 y) {
+  PROFILE_FUNC();
+
+  i32 cell = y * cl->layer->c_width + x;
+  bool wall = tile_is_wall(body, cl->layer->int_grid[cell]);
+  if (cl->solid[cell] == wall) {
+    return;
+  }
+  cl->solid[cell] = wall;
+
+  TileWalls walls = tile_layer_walls(cl);
+
+  TileCollider c = {};
+  c.body = body;
+  c.layer = cl;
+  defer(c.edges.trash());
+
+  if (body->mode == TileCollision_Chains) {
+    update_collision_chains(&c, x, y, walls);
+  } else {
+    update_collision_rects(&c, x, y, walls);
+  }
+}
+
+static float get_tile_cost(TilemapInt n, Slice<TileCost> costs) {
+  for (TileCost cost : costs) {
+    if (cost.cell == n) {
+      return cost.value;
+    }
+  }
+  return -1;
+}
+
+static void make_graph_for_layer(TileGraph *graph, TilemapLayer *layer,
+                                 i32 tile_x, i32 tile_y,
+                                 Slice<TileCost> costs) {
+  PROFILE_FUNC();
+
+  for (i32 y = 0; y < layer->c_height; y++) {
+    for (i32 x = 0; x < layer->c_width; x++) {
+      float cost =
+          get_tile_cost(layer->int_grid[y * layer->c_width + x], costs);
+      if (cost > 0) {
+        i32 gx = tile_x + x - graph->x;
+        i32 gy = tile_y + y - graph->y;
+        graph->costs[gy * graph->width + gx] = cost;
+      }
+    }
+  }
+}
+
+static bool tile_graph_rect_walkable(TileGraph *graph, i32 x0, i32 y0, i32 x1,
+                                     i32 y1) {
+  i32 lhs = x0 <= x1 ? x0 : x1;
+  i32 rhs = x0 <= x1 ? x1 : x0;
+  i32 top = y0 <= y1 ? y0 : y1;
+  i32 bot = y0 <= y1 ? y1 : y0;
+
+  for (i32 y = top; y <= bot; y++) {
+    for (i32 x = lhs; x <= rhs; x++) {
+      if ((x == x0 && y == y0) || (x == x1 && y == y1)) {
+        continue;
+      }
+
+      if (graph->costs[y * graph->width + x] == 0) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// append the offsets cell can step along to out
+static void make_neighbor_list(TileGraph *graph, i32 cell, Array<u16> *out) {
+  if (graph->costs[cell] == 0) {
+    return;
+  }
+
+  i32 x = cell % graph->width;
+  i32 y = cell / graph->width;
+
+  for (u64 i = 0; i < graph->offsets.len; i++) {
+    TileOffset offset = graph->offsets[i];
+    i32 nx = x + offset.x;
+    i32 ny = y + offset.y;
+    if (nx < 0 || ny < 0 || nx >= graph->width || ny >= graph->height) {
+      continue;
+    }
+
+    if (graph->costs[cell + offset.delta] == 0) {
+      continue;
+    }
+
+    if (!tile_graph_rect_walkable(graph, x, y, nx, ny)) {
+      continue;
+    }
+
+    out->push((u16)i);
+  }
+}
+
+static void create_neighbor_lists(TileGraph *graph, i32 bloom) {
+  PROFILE_FUNC();
+
+  for (i32 y = -bloom; y <= bloom; y++) {
+    for (i32 x = -bloom; x <= bloom; x++) {
+      if (x == 0 && y == 0) {
+        continue;
+      }
+
+      TileOffset offset = {};
+      offset.x = x;
+      offset.y = y;
+      offset.delta = y * graph->width + x;
+      offset.distance = sqrtf((float)(x * x + y * y));
+      graph->offsets.push(offset);
+    }
+  }
+  graph->bloom = bloom;
 
-static float get_tile_cost(TilemapInt n, Slice<TileCost> costs) {
-  for (TileCost cost : costs) {
-    if (cost.cell == n) {
-      return cost.value;
+  u64 cells = graph->costs.len;
+  graph->first_neighbor.resize(cells + 1);
+
+  for (u64 cell = 0; cell < cells; cell++) {
+    graph->first_neighbor[cell] = (u32)graph->neighbors.len;
+    make_neighbor_list(graph, (i32)cell, &graph->neighbors);
+  }
+  graph->first_neighbor[cells] = (u32)graph->neighbors.len;
+}
+
+// rebuild the neighbor lists of the cells in [x0, x1] x [y0, y1]. the cells
+// between the first and last row keep their lists, but are copied along so
+// the whole range can be spliced in at once
+static void rebuild_neighbor_lists(TileGraph *graph, i32 x0, i32 y0, i32 x1,
+                                   i32 y1) {
+  PROFILE_FUNC();
+
+  i32 width = graph->width;
+  i32 lo = y0 * width + x0;
+  i32 hi = y1 * width + x1 + 1;
+
+  Array<u16> lists = {};
+  defer(lists.trash());
+
+  Array<u32> first = {};
+  defer(first.trash());
+  first.resize(hi - lo);
+
+  for (i32 cell = lo; cell < hi; cell++) {
+    first[cell - lo] = (u32)lists.len;
+
+    i32 x = cell % width;
+    if (x >= x0 && x <= x1) {
+      make_neighbor_list(graph, cell, &lists);
+    } else {
+      for (u64 i = graph->neighbors_begin(cell); i < graph->neighbors_end(cell);
+           i++) {
+        lists.push(graph->neighbors[i]);
+      }
+    }
+  }
+
+  u64 begin = graph->first_neighbor[lo];
+  u64 end = graph->first_neighbor[hi];
+  u64 len = graph->neighbors.len;
+  u64 new_end = begin + lists.len;
+
+  if (new_end > end) {
+    graph->neighbors.resize(len + (new_end - end));
+  }
+  memmove(graph->neighbors.data + new_end, graph->neighbors.data + end,
+          sizeof(u16) * (len - end));
+  memcpy(graph->neighbors.data + begin, lists.data, sizeof(u16) * lists.len);
+  graph->neighbors.len = len - end + new_end;
+
+  for (i32 cell = lo; cell < hi; cell++) {
+    graph->first_neighbor[cell] = (u32)begin + first[cell - lo];
+  }
+
+  u32 shift = (u32)(new_end - end); // wraps when the lists got shorter
+  for (u64 cell = hi; cell < graph->first_neighbor.len; cell++) {
+    graph->first_neighbor[cell] += shift;
+  }
+}
+
+#define TILE_ENTRANCE_SPLIT 6 // longer openings get an entrance at each end
+
+struct TileClusterRect {
+  i32 x0, y0, x1, y1; // in cells, x1 and y1 are exclusive
+};
+
+static TileClusterRect tile_cluster_rect(TileGraph *graph, i32 cluster) {
+  i32 size = graph->cluster_size;
+
+  TileClusterRect r = {};
+  r.x0 = (cluster % graph->clusters_x) * size;
+  r.y0 = (cluster / graph->clusters_x) * size;
+  r.x1 = r.x0 + size < graph->width ? r.x0 + size : graph->width;
+  r.y1 = r.y0 + size < graph->height ? r.y0 + size : graph->height;
+  return r;
+}
+
+static i32 tile_cluster_of(TileGraph *graph, i32 cell) {
+  i32 cx = (cell % graph->width) / graph->cluster_size;
+  i32 cy = (cell / graph->width) / graph->cluster_size;
+  return cy * graph->clusters_x + cx;
+}
+
+static i32 tile_cluster_local(TileGraph *graph, TileClusterRect r, i32 cell) {
+  i32 x = cell % graph->width - r.x0;
+  i32 y = cell / graph->width - r.y0;
+  return y * (r.x1 - r.x0) + x;
+}
+
+// dijkstra from cell without leaving the cluster. dist is indexed by
+// position in the cluster. if reverse is true, dist holds the cost of
+// reaching cell instead of the cost of leaving it
+static void tile_cluster_dijkstra(TileGraph *graph, TileClusterRect r, i32 cell,
+                                  bool reverse, float *dist,
+                                  IndexedPriorityQueue *frontier) {
+  i32 w = r.x1 - r.x0;
+  i32 h = r.y1 - r.y0;
+  for (i32 i = 0; i < w * h; i++) {
+    dist[i] = INFINITY;
+  }
+
+  frontier->reserve(w * h);
+  frontier->clear();
+
+  i32 local = tile_cluster_local(graph, r, cell);
+  dist[local] = 0;
+  frontier->push(local, 0);
+
+  i32 top = 0;
+  while (frontier->pop(&top)) {
+    i32 x = r.x0 + top % w;
+    i32 y = r.y0 + top / w;
+    i32 c = y * graph->width + x;
+
+    for (u64 i = graph->neighbors_begin(c); i < graph->neighbors_end(c); i++) {
+      TileOffset offset = graph->offsets[graph->neighbors[i]];
+      i32 nx = x + offset.x;
+      i32 ny = y + offset.y;
+      if (nx < r.x0 || ny < r.y0 || nx >= r.x1 || ny >= r.y1) {
+        continue;
+      }
+
+      i32 n = c + offset.delta;
+      float step = (reverse ? graph->costs[c] : graph->costs[n]) *
+                   offset.distance;
+
+      float d = dist[top] + step;
+      i32 ln = (ny - r.y0) * w + (nx - r.x0);
+      if (d < dist[ln]) {
+        dist[ln] = d;
+        frontier->push(ln, d);
+      }
+    }
+  }
+}
+
+static void tile_cluster_entrances(TileGraph *graph, TileClusterRect r,
+                                   Array<i32> *entrances) {
+  auto add = [&](i32 cell) {
+    for (i32 e : *entrances) {
+      if (e == cell) {
+        return;
+      }
+    }
+    entrances->push(cell);
+  };
+
+  // walk len cells along one side. (ox, oy) points at the neighboring
+  // cluster. both clusters see the same openings, so they agree on where
+  // the entrances are
+  auto side = [&](i32 x, i32 y, i32 dx, i32 dy, i32 ox, i32 oy, i32 len) {
+    i32 run = 0;
+    for (i32 i = 0; i <= len; i++) {
+      bool open = false;
+      if (i < len) {
+        i32 cx = x + dx * i;
+        i32 cy = y + dy * i;
+        i32 px = cx + ox;
+        i32 py = cy + oy;
+        open = px >= 0 && py >= 0 && px < graph->width && py < graph->height &&
+               graph->costs[cy * graph->width + cx] > 0 &&
+               graph->costs[py * graph->width + px] > 0;
+      }
+
+      if (open) {
+        run++;
+        continue;
+      }
+
+      if (run > 0) {
+        i32 first = i - run;
+        i32 last = i - 1;
+        if (run >= TILE_ENTRANCE_SPLIT) {
+          add((y + dy * first) * graph->width + x + dx * first);
+          add((y + dy * last) * graph->width + x + dx * last);
+        } else {
+          i32 mid = first + run / 2;
+          add((y + dy * mid) * graph->width + x + dx * mid);
+        }
+      }
+      run = 0;
+    }
+  };
+
+  i32 w = r.x1 - r.x0;
+  i32 h = r.y1 - r.y0;
+  side(r.x0, r.y0, 1, 0, 0, -1, w);
+  side(r.x0, r.y1 - 1, 1, 0, 0, 1, w);
+  side(r.x0, r.y0, 0, 1, -1, 0, h);
+  side(r.x1 - 1, r.y0, 0, 1, 1, 0, h);
+}
+
+// entrances depend on the cells around the cluster too
+static bool tile_cluster_unchanged(TileGraph *graph, TileGraph *prev,
+                                   TileClusterRect r) {
+  i32 x0 = r.x0 > 0 ? r.x0 - 1 : 0;
+  i32 y0 = r.y0 > 0 ? r.y0 - 1 : 0;
+  i32 x1 = r.x1 < graph->width ? r.x1 + 1 : graph->width;
+  i32 y1 = r.y1 < graph->height ? r.y1 + 1 : graph->height;
+
+  for (i32 y = y0; y < y1; y++) {
+    i32 row = y * graph->width;
+    if (memcmp(&graph->costs[row + x0], &prev->costs[row + x0],
+               sizeof(float) * (x1 - x0)) != 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void make_cluster(TileGraph *graph, i32 index,
+                         IndexedPriorityQueue *frontier, Array<float> *dist) {
+  TileCluster *cluster = &graph->clusters[index];
+  TileClusterRect r = tile_cluster_rect(graph, index);
+
+  cluster->entrances.len = 0;
+  tile_cluster_entrances(graph, r, &cluster->entrances);
+
+  u64 n = cluster->entrances.len;
+  cluster->costs.resize(n * n);
+  for (u64 from = 0; from < n; from++) {
+    tile_cluster_dijkstra(graph, r, cluster->entrances[from], false,
+                          dist->data, frontier);
+    for (u64 to = 0; to < n; to++) {
+      i32 local = tile_cluster_local(graph, r, cluster->entrances[to]);
+      cluster->costs[from * n + to] = (*dist)[local];
+    }
+  }
+}
+
+static void make_clusters(TileGraph *graph, TileGraph *prev, i32 size) {
+  PROFILE_FUNC();
+
+  graph->cluster_size = size;
+  graph->clusters_x = (graph->width + size - 1) / size;
+  graph->clusters_y = (graph->height + size - 1) / size;
+
+  bool reuse = prev != nullptr && prev->cluster_size == size &&
+               prev->x == graph->x && prev->y == graph->y &&
+               prev->width == graph->width && prev->height == graph->height &&
+               prev->bloom == graph->bloom;
+
+  u64 count = (u64)graph->clusters_x * graph->clusters_y;
+  graph->clusters.resize(count);
+  memset(graph->clusters.data, 0, sizeof(TileCluster) * count);
+
+  IndexedPriorityQueue frontier = {};
+  defer(frontier.trash());
+
+  Array<float> dist = {};
+  defer(dist.trash());
+  dist.resize(size * size);
+
+  for (u64 i = 0; i < count; i++) {
+    TileCluster *cluster = &graph->clusters[i];
+    TileClusterRect r = tile_cluster_rect(graph, (i32)i);
+
+    if (reuse && tile_cluster_unchanged(graph, prev, r)) {
+      TileCluster *old = &prev->clusters[i];
+      cluster->entrances.resize(old->entrances.len);
+      memcpy(cluster->entrances.data, old->entrances.data,
+             sizeof(i32) * old->entrances.len);
+      cluster->costs.resize(old->costs.len);
+      memcpy(cluster->costs.data, old->costs.data,
+             sizeof(float) * old->costs.len);
+      continue;
+    }
+
+    make_cluster(graph, (i32)i, &frontier, &dist);
+  }
+
+  graph->entrance_index.resize(graph->costs.len);
+  for (i32 &e : graph->entrance_index) {
+    e = -1;
+  }
+
+  for (TileCluster &cluster : graph->clusters) {
+    for (u64 i = 0; i < cluster.entrances.len; i++) {
+      graph->entrance_index[cluster.entrances[i]] = (i32)i;
+    }
+  }
+}
+
+enum TileDir {
+  TileDir_East,
+  TileDir_West,
+  TileDir_South,
+  TileDir_North,
+};
+
+static const i32 TILE_DIRS[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+static bool tile_walkable(TileGraph *graph, i32 x, i32 y) {
+  return x >= 0 && y >= 0 && x < graph->width && y < graph->height &&
+         graph->costs[y * graph->width + x] > 0;
+}
+
+// moving straight onto (x, y) by (dx, dy), a cell to the side opens up
+// that was blocked one step back
+static bool tile_forced(TileGraph *graph, i32 x, i32 y, i32 dx, i32 dy) {
+  if (dx != 0) {
+    return (tile_walkable(graph, x, y - 1) &&
+            !tile_walkable(graph, x - dx, y - 1)) ||
+           (tile_walkable(graph, x, y + 1) &&
+            !tile_walkable(graph, x - dx, y + 1));
+  }
+
+  return (tile_walkable(graph, x - 1, y) &&
+          !tile_walkable(graph, x - 1, y - dy)) ||
+         (tile_walkable(graph, x + 1, y) &&
+          !tile_walkable(graph, x + 1, y - dy));
+}
+
+// one row (east, west) or column (south, north) of straight jump distances
+static void make_jump_line(TileGraph *graph, i32 d, i32 line) {
+  i32 width = graph->width;
+  i32 dx = TILE_DIRS[d][0];
+  i32 dy = TILE_DIRS[d][1];
+  i32 len = dx != 0 ? width : graph->height;
+
+  // visit cells against the direction, so the next cell is already done
+  for (i32 i = 0; i < len; i++) {
+    i32 k = dx > 0 || dy > 0 ? len - 1 - i : i;
+    i32 x = dx != 0 ? k : line;
+    i32 y = dx != 0 ? line : k;
+    i32 nx = x + dx;
+    i32 ny = y + dy;
+
+    i32 jump = 0;
+    if (!tile_walkable(graph, nx, ny)) {
+      jump = 0;
+    } else if (tile_forced(graph, nx, ny, dx, dy)) {
+      jump = 1;
+    } else {
+      i32 next = graph->jumps[(ny * width + nx) * 4 + d];
+      jump = next > 0 ? next + 1 : next - 1;
+    }
+
+    graph->jumps[(y * width + x) * 4 + d] = jump;
+  }
+}
+
+// straight jump distances for every cell and direction (JPS+). a positive
+// value is the number of steps to the next jump point. otherwise, the ray
+// hits a wall after that many steps, negated
+static void make_jumps(TileGraph *graph) {
+  PROFILE_FUNC();
+
+  graph->jumps.resize(graph->costs.len * 4);
+
+  for (i32 d = 0; d < 4; d++) {
+    i32 lines = TILE_DIRS[d][0] != 0 ? graph->height : graph->width;
+    for (i32 line = 0; line < lines; line++) {
+      make_jump_line(graph, d, line);
+    }
+  }
+}
+
+template <typename T> static void tile_copy_array(Array<T> *dst, Array<T> src) {
+  dst->resize(src.len);
+  memcpy(dst->data, src.data, sizeof(T) * src.len);
+}
+
+static TileGraph *tile_graph_copy(TileGraph *graph) {
+  PROFILE_FUNC();
+
+  TileGraph *g = tile_graph_make();
+  g->x = graph->x;
+  g->y = graph->y;
+  g->width = graph->width;
+  g->height = graph->height;
+  g->bloom = graph->bloom;
+  g->grid_size = graph->grid_size;
+  tile_copy_array(&g->costs, graph->costs);
+  tile_copy_array(&g->offsets, graph->offsets);
+  tile_copy_array(&g->first_neighbor, graph->first_neighbor);
+  tile_copy_array(&g->neighbors, graph->neighbors);
+
+  g->cluster_size = graph->cluster_size;
+  g->clusters_x = graph->clusters_x;
+  g->clusters_y = graph->clusters_y;
+  g->clusters.resize(graph->clusters.len);
+  memset(g->clusters.data, 0, sizeof(TileCluster) * graph->clusters.len);
+  for (u64 i = 0; i < graph->clusters.len; i++) {
+    tile_copy_array(&g->clusters[i].entrances, graph->clusters[i].entrances);
+    tile_copy_array(&g->clusters[i].costs, graph->clusters[i].costs);
+  }
+  tile_copy_array(&g->entrance_index, graph->entrance_index);
+
+  g->uniform_cost = graph->uniform_cost;
+  tile_copy_array(&g->jumps, graph->jumps);
+  return g;
+}
+
+// change the cost of one cell, and rebuild what depends on it: neighbor
+// lists within bloom, the clusters around it, and jump distances along
+// its row and column
+static void tile_graph_set_cost(TileGraph *graph, i32 cell, float cost) {
+  PROFILE_FUNC();
+
+  graph->costs[cell] = cost;
+
+  i32 width = graph->width;
+  i32 height = graph->height;
+  i32 cx = cell % width;
+  i32 cy = cell / width;
+  i32 bloom = graph->bloom;
+
+  i32 x0 = cx - bloom > 0 ? cx - bloom : 0;
+  i32 y0 = cy - bloom > 0 ? cy - bloom : 0;
+  i32 x1 = cx + bloom < width ? cx + bloom : width - 1;
+  i32 y1 = cy + bloom < height ? cy + bloom : height - 1;
+  rebuild_neighbor_lists(graph, x0, y0, x1, y1);
+
+  if (graph->cluster_size > 0) {
+    // entrances look one cell past the cluster border
+    i32 reach = bloom > 1 ? bloom : 1;
+    i32 size = graph->cluster_size;
+    i32 kx0 = (cx - reach > 0 ? cx - reach : 0) / size;
+    i32 ky0 = (cy - reach > 0 ? cy - reach : 0) / size;
+    i32 kx1 = (cx + reach < width ? cx + reach : width - 1) / size;
+    i32 ky1 = (cy + reach < height ? cy + reach : height - 1) / size;
+
+    IndexedPriorityQueue frontier = {};
+    defer(frontier.trash());
+
+    Array<float> dist = {};
+    defer(dist.trash());
+    dist.resize(size * size);
+
+    for (i32 ky = ky0; ky <= ky1; ky++) {
+      for (i32 kx = kx0; kx <= kx1; kx++) {
+        i32 index = ky * graph->clusters_x + kx;
+        TileCluster *cluster = &graph->clusters[index];
+
+        for (i32 e : cluster->entrances) {
+          graph->entrance_index[e] = -1;
+        }
+
+        make_cluster(graph, index, &frontier, &dist);
+
+        for (u64 i = 0; i < cluster->entrances.len; i++) {
+          graph->entrance_index[cluster->entrances[i]] = (i32)i;
+        }
+      }
+    }
+  }
+
+  // only kept up to date while every walkable cell costs the same.
+  // make_graph finds out if the costs have become uniform again
+  if (graph->uniform_cost > 0 && cost > 0 && cost != graph->uniform_cost) {
+    graph->uniform_cost = 0;
+    graph->jumps.trash();
+    graph->jumps = {};
+  }
+
+  if (graph->jumps.len > 0) {
+    for (i32 y = cy - 1; y <= cy + 1; y++) {
+      if (y >= 0 && y < height) {
+        make_jump_line(graph, TileDir_East, y);
+        make_jump_line(graph, TileDir_West, y);
+      }
+    }
+
+    for (i32 x = cx - 1; x <= cx + 1; x++) {
+      if (x >= 0 && x < width) {
+        make_jump_line(graph, TileDir_South, x);
+        make_jump_line(graph, TileDir_North, x);
+      }
+    }
+  }
+}
+
+void Tilemap::make_graph(i32 bloom, String layer_name, Slice<TileCost> costs,
+                         i32 cluster_size) {
+  PROFILE_FUNC();
+
+  // kept until the new graph is built, so unchanged clusters can be reused
+  TileGraph *prev = graph;
+  graph = nullptr;
+  defer({
+    if (prev != nullptr) {
+      tile_graph_release(prev);
+    }
+  });
+
+  bloom = bloom < 0 ? 0 : bloom;
+  bloom = bloom > TILE_GRAPH_MAX_BLOOM ? TILE_GRAPH_MAX_BLOOM : bloom;
+
+  // for set_int
+  graph_layer = fnv1a(layer_name);
+  graph_costs.resize(costs.len);
+  memcpy(graph_costs.data, costs.data, sizeof(TileCost) * costs.len);
+
+  // cover every matching layer, in tiles
+  float grid_size = 0;
+  i32 x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+  bool found = false;
+  for (TilemapLevel &level : levels) {
+    for (TilemapLayer &l : level.layers) {
+      if (l.identifier != layer_name) {
+        continue;
+      }
+
+      if (!found) {
+        grid_size = l.grid_size;
+      }
+
+      i32 lx = (i32)floorf(level.world_x / grid_size);
+      i32 ly = (i32)floorf(level.world_y / grid_size);
+      if (!found || lx < x0) {
+        x0 = lx;
+      }
+      if (!found || ly < y0) {
+        y0 = ly;
+      }
+      if (!found || lx + l.c_width > x1) {
+        x1 = lx + l.c_width;
+      }
+      if (!found || ly + l.c_height > y1) {
+        y1 = ly + l.c_height;
+      }
+      found = true;
+    }
+  }
+
+  if (!found || grid_size <= 0) {
+    return;
+  }
+
+  TileGraph *g = tile_graph_make();
+  g->grid_size = grid_size;
+  g->x = x0;
+  g->y = y0;
+  g->width = x1 - x0;
+  g->height = y1 - y0;
+
+  u64 cells = (u64)g->width * g->height;
+  g->costs.resize(cells);
+  memset(g->costs.data, 0, sizeof(float) * cells);
+
+  for (TilemapLevel &level : levels) {
+    for (TilemapLayer &l : level.layers) {
+      if (l.identifier == layer_name) {
+        i32 lx = (i32)floorf(level.world_x / grid_size);
+        i32 ly = (i32)floorf(level.world_y / grid_size);
+        make_graph_for_layer(g, &l, lx, ly, costs);
+      }
+    }
+  }
+
+  create_neighbor_lists(g, bloom);
+  if (cluster_size > 0 && bloom > 0) {
+    make_clusters(g, prev, cluster_size);
+  }
+
+  for (float cost : g->costs) {
+    if (cost > 0 && g->uniform_cost == 0) {
+      g->uniform_cost = cost;
+    } else if (cost > 0 && cost != g->uniform_cost) {
+      g->uniform_cost = 0;
+      break;
+    }
+  }
+
+  if (g->uniform_cost > 0 && bloom == 1) {
+    make_jumps(g);
+  }
+
+  graph = g;
+}
+
+bool Tilemap::set_int(String level_name, String layer_name, i32 x, i32 y,
+                      TilemapInt value) {
+  PROFILE_FUNC();
+
+  for (TilemapLevel &level : levels) {
+    if (level.identifier != level_name) {
+      continue;
+    }
+
+    for (TilemapLayer &l : level.layers) {
+      if (l.identifier != layer_name) {
+        continue;
+      }
+
+      if (x < 0 || y < 0 || x >= l.c_width || y >= l.c_height) {
+        return false;
+      }
+
+      l.int_grid[y * l.c_width + x] = value;
+
+      TileCollisionBody *body = bodies.get(fnv1a(layer_name));
+      if (body != nullptr) {
+        for (TileCollisionLayer &cl : body->layers) {
+          if (cl.layer == &l) {
+            update_collision(body, &cl, x, y);
+          }
+        }
+      }
+
+      if (graph != nullptr && graph_layer == fnv1a(layer_name)) {
+        float cost = get_tile_cost(value, Slice(graph_costs));
+        cost = cost > 0 ? cost : 0;
+
+        i32 gx = (i32)floorf(level.world_x / graph->grid_size) + x - graph->x;
+        i32 gy = (i32)floorf(level.world_y / graph->grid_size) + y - graph->y;
+        i32 cell = gy * graph->width + gx;
+
+        // streamed levels can load outside of the graph
+        bool inside =
+            gx >= 0 && gy >= 0 && gx < graph->width && gy < graph->height;
+
+        if (inside && graph->costs[cell] != cost) {
+          // path jobs keep searching the graph they started with
+          if (graph->readers.load(std::memory_order_acquire) > 0) {
+            TileGraph *copy = tile_graph_copy(graph);
+            tile_graph_release(graph);
+            graph = copy;
+          }
+
+          tile_graph_set_cost(graph, cell, cost);
+        }
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void tilemap_level_load_job(void *udata) {
+  PROFILE_FUNC();
+
+  TilemapLevelLoad *load = (TilemapLevelLoad *)udata;
+  load->ok = level_layers_from_file(&load->layers, load->level_path,
+                                    load->filepath, &load->arena,
+                                    &load->images, &load->pixels);
+
+  load->done.store(true, std::memory_order_release);
+  tilemap_level_load_release(load);
+}
+
+static void tilemap_stream_start(Tilemap *tm, i32 index) {
+  TilemapStream *stream = tm->stream;
+
+  TilemapLevelLoad *load =
+      (TilemapLevelLoad *)mem_alloc(sizeof(TilemapLevelLoad));
+  memset(load, 0, sizeof(TilemapLevelLoad));
+  new (&load->refs) std::atomic<i32>(2); // the stream and the job
+  new (&load->done) std::atomic<bool>();
+  load->filepath = to_cstr(stream->filepath);
+  load->level_path = to_cstr(tm->levels[index].external);
+
+  // tilesets already loaded aren't decoded again. they stay loaded until
+  // no jobs are running, see Tilemap::update_stream
+  for (auto [k, v] : tm->images) {
+    load->images[k] = *v;
+  }
+  for (auto [k, v] : stream->images) {
+    load->images[k] = *v;
+  }
+
+  TilemapStreamLevel *sl = &stream->levels[index];
+  sl->state = TilemapLevelState_Loading;
+  sl->load = load;
+  stream->loading++;
+
+  jobs_push(tilemap_level_load_job, load);
+}
+
+// collision on bodies that were made before the level was loaded
+static void tilemap_stream_add_collision(Tilemap *tm, TilemapLevel *level) {
+  for (auto [k, body] : tm->bodies) {
+    for (TilemapLayer &l : level->layers) {
+      if (fnv1a(l.identifier) != k) {
+        continue;
+      }
+
+      TileCollisionLayer cl = {};
+      cl.level = level;
+      cl.layer = &l;
+      body->layers.push(cl);
+
+      TileCollider c = {};
+      c.body = body;
+      c.layer = &body->layers[body->layers.len - 1];
+      defer(c.edges.trash());
+
+      make_collision_for_layer(&c);
+    }
+  }
+}
+
+static void tilemap_stream_remove_collision(Tilemap *tm,
+                                            TilemapLevel *level) {
+  for (auto [k, body] : tm->bodies) {
+    u64 i = 0;
+    while (i < body->layers.len) {
+      TileCollisionLayer *cl = &body->layers[i];
+      if (cl->level != level) {
+        i++;
+        continue;
+      }
+
+      for (TileCollisionFixture &f : cl->fixtures) {
+        if (f.fixture != nullptr) {
+          body->body->DestroyFixture(f.fixture);
+        }
+      }
+      tile_collision_layer_trash(cl);
+
+      body->layers[i] = body->layers[body->layers.len - 1];
+      body->layers.len--;
+    }
+  }
+}
+
+static void tilemap_stream_install(Tilemap *tm, i32 index) {
+  PROFILE_FUNC();
+
+  TilemapStream *stream = tm->stream;
+  TilemapLevel *level = &tm->levels[index];
+  TilemapLevelLoad *load = stream->levels[index].load;
+
+  level->layers = load->layers;
+  for (TilemapLayer &layer : level->layers) {
+    if (layer.tileset_path.len != 0) {
+      Image *img = tm->images.get(layer.image_key);
+      if (img == nullptr) {
+        img = stream->images.get(layer.image_key);
+        if (img == nullptr) {
+          Image uploaded = {};
+          uploaded.upload(&load->pixels[layer.image_key]);
+          stream->images[layer.image_key] = uploaded;
+          img = stream->images.get(layer.image_key);
+        }
+        stream->image_users[layer.image_key]++;
+      }
+      layer.image = *img;
+    }
+
+    layer_make_vertex_buffer(&layer);
+  }
+
+  for (auto [k, v] : load->pixels) {
+    v->trash();
+  }
+  load->pixels.trash();
+  load->pixels = {};
+  load->images.trash();
+  load->images = {};
+
+  tilemap_stream_add_collision(tm, level);
+}
+
+static void tilemap_stream_unload(Tilemap *tm, i32 index) {
+  PROFILE_FUNC();
+
+  TilemapStream *stream = tm->stream;
+  TilemapLevel *level = &tm->levels[index];
+  TilemapStreamLevel *sl = &stream->levels[index];
+
+  tilemap_stream_remove_collision(tm, level);
+
+  for (TilemapLayer &layer : level->layers) {
+    if (layer.vertex_buffer != 0) {
+      LockGuard lock{&g_app->gpu_mtx};
+      sg_destroy_buffer({layer.vertex_buffer});
+    }
+
+    i32 *users = stream->image_users.get(layer.image_key);
+    if (layer.tileset_path.len != 0 && users != nullptr) {
+      (*users)--;
     }
   }
-  return -1;
+  level->layers = {};
+
+  tilemap_level_load_release(sl->load);
+  sl->load = nullptr;
+  sl->state = TilemapLevelState_Unloaded;
 }
 
-static void make_graph_for_layer(HashMap<TileNode> *graph, TilemapLayer *layer,
-                                 float world_x, float world_y,
-                                 Slice<TileCost> costs) {
+void Tilemap::update_stream(float x, float y, float radius,
+                            Array<TilemapStreamEvent> *events) {
   PROFILE_FUNC();
 
-  for (i32 y = 0; y < layer->c_height; y++) {
-    for (i32 x = 0; x < layer->c_width; x++) {
-      float cost =
-          get_tile_cost(layer->int_grid[y * layer->c_width + x], costs);
-      if (cost > 0) {
-        TileNode node = {};
-        node.x = (i32)(x + world_x);
-        node.y = (i32)(y + world_x);
-        node.cost = cost;
+  if (stream == nullptr) {
+    return;
+  }
+
+  for (i32 i = 0; i < (i32)levels.len; i++) {
+    TilemapLevel *level = &levels[i];
+    TilemapStreamLevel *sl = &stream->levels[i];
+
+    // distance from the focus point to the level's rectangle
+    float x0 = level->world_x;
+    float y0 = level->world_y;
+    float x1 = x0 + level->px_width;
+    float y1 = y0 + level->px_height;
+    float dx = x < x0 ? x0 - x : (x > x1 ? x - x1 : 0);
+    float dy = y < y0 ? y0 - y : (y > y1 ? y - y1 : 0);
+    float dist = sqrtf(dx * dx + dy * dy);
+
+    // levels are kept until they're a bit further out than where they're
+    // loaded, so walking along the edge doesn't load them over and over
+    bool want = dist <= radius;
+    bool keep = dist <= radius * 1.5f;
+
+    if (!keep) {
+      sl->failed = false;
+    }
+
+    if (sl->state == TilemapLevelState_Unloaded && want && !sl->failed) {
+      tilemap_stream_start(this, i);
+    }
 
-        (*graph)[tile_key(node.x, node.y)] = node;
+    if (sl->state == TilemapLevelState_Loading &&
+        sl->load->done.load(std::memory_order_acquire)) {
+      stream->loading--;
+
+      if (sl->load->ok && keep) {
+        tilemap_stream_install(this, i);
+        sl->state = TilemapLevelState_Loaded;
+      } else {
+        if (!sl->load->ok) {
+          fprintf(stderr, "failed to load level: %s\n",
+                  level->external.data);
+          sl->failed = true;
+        }
+
+        tilemap_level_load_release(sl->load);
+        sl->load = nullptr;
+        sl->state = TilemapLevelState_Unloaded;
+      }
+    }
+
+    if (sl->active && !keep) {
+      sl->active = false;
+      events->push({i, false});
+    }
+
+    if (!sl->active && want && sl->state == TilemapLevelState_Loaded) {
+      sl->active = true;
+      events->push({i, true});
+    }
+
+    if (sl->state == TilemapLevelState_Loaded && !keep &&
+        level->external.len != 0) {
+      tilemap_stream_unload(this, i);
+    }
+  }
+
+  // jobs that are still running may be counting on these
+  if (stream->loading == 0) {
+    for (auto [k, users] : stream->image_users) {
+      if (*users == 0) {
+        stream->images[k].trash();
+        stream->images.unset(k);
+        stream->image_users.unset(k);
       }
     }
   }
 }
 
-static bool tilemap_rect_overlaps_graph(HashMap<TileNode> *graph, i32 x0,
-                                        i32 y0, i32 x1, i32 y1) {
-  i32 lhs = x0 <= x1 ? x0 : x1;
-  i32 rhs = x0 <= x1 ? x1 : x0;
-  i32 top = y0 <= y1 ? y0 : y1;
-  i32 bot = y0 <= y1 ? y1 : y0;
+// after a hot reload, so levels that were reported as loaded aren't
+// reported again
+void Tilemap::keep_stream_state(Tilemap *prev) {
+  if (stream == nullptr || prev->stream == nullptr) {
+    return;
+  }
 
-  for (i32 y = top; y <= bot; y++) {
-    for (i32 x = lhs; x <= rhs; x++) {
-      if ((x == x0 && y == y0) || (x == x1 && y == y1)) {
+  HashMap<bool> active = {};
+  defer(active.trash());
+
+  for (u64 i = 0; i < prev->levels.len; i++) {
+    if (prev->stream->levels[i].active) {
+      active[fnv1a(prev->levels[i].iid)] = true;
+    }
+  }
+
+  for (u64 i = 0; i < levels.len; i++) {
+    if (active.get(fnv1a(levels[i].iid)) != nullptr) {
+      stream->levels[i].active = true;
+    }
+  }
+}
+
+TileGraph *tile_graph_make() {
+  TileGraph *graph = (TileGraph *)mem_alloc(sizeof(TileGraph));
+  memset(graph, 0, sizeof(TileGraph));
+  new (&graph->refs) std::atomic<i32>(1);
+  new (&graph->readers) std::atomic<i32>();
+  return graph;
+}
+
+void tile_graph_release(TileGraph *graph) {
+  if (graph->refs.fetch_sub(1) == 1) {
+    graph->costs.trash();
+    graph->first_neighbor.trash();
+    graph->neighbors.trash();
+    for (TileCluster &cluster : graph->clusters) {
+      cluster.entrances.trash();
+      cluster.costs.trash();
+    }
+    graph->clusters.trash();
+    graph->entrance_index.trash();
+    graph->jumps.trash();
+    graph->offsets.trash();
+    mem_free(graph);
+  }
+}
+
+i32 TileGraph::index(TilePoint p) {
+  i32 cx = (i32)floorf(p.x / grid_size) - x;
+  i32 cy = (i32)floorf(p.y / grid_size) - y;
+  if (cx < 0 || cy < 0 || cx >= width || cy >= height) {
+    return -1;
+  }
+
+  return cy * width + cx;
+}
+
+i32 TileGraph::cell(TilePoint p) {
+  i32 cell = index(p);
+  if (cell == -1 || costs[cell] == 0) {
+    return -1;
+  }
+
+  return cell;
+}
+
+TilePoint TileGraph::point(i32 cell) {
+  TilePoint p = {};
+  p.x = (x + cell % width) * grid_size;
+  p.y = (y + cell / width) * grid_size;
+  return p;
+}
+
+static thread_local TileSearch t_tile_search;
+
+TileSearch *tile_search() { return &t_tile_search; }
+
+void tile_search_trash() {
+  t_tile_search.nodes.trash();
+  t_tile_search.frontier.trash();
+  t_tile_search.path.trash();
+  t_tile_search.waypoints.trash();
+  t_tile_search.cluster_frontier.trash();
+  t_tile_search.cluster_from.trash();
+  t_tile_search.cluster_to.trash();
+  t_tile_search = {};
+}
+
+static void tile_search_begin(TileSearch *s, u64 cells) {
+  if (s->nodes.len < cells) {
+    u64 len = s->nodes.len;
+    s->nodes.resize(cells);
+    memset(s->nodes.data + len, 0, sizeof(TileSearchNode) * (cells - len));
+    s->frontier.reserve(cells);
+  }
+
+  s->frontier.clear();
+
+  s->search++;
+  if (s->search == 0) {
+    memset(s->nodes.data, 0, sizeof(TileSearchNode) * s->nodes.len);
+    s->search = 1;
+  }
+}
+
+// octile distance overestimates the longer moves a bloom above 1 allows
+static float tile_heuristic(i32 x0, i32 y0, i32 x1, i32 y1, i32 bloom) {
+  float D = 1;
+  float D2 = 1.4142135f;
+
+  float dx = (float)abs(x0 - x1);
+  float dy = (float)abs(y0 - y1);
+  if (bloom > 1) {
+    return sqrtf(dx * dx + dy * dy);
+  }
+  return D * (dx + dy) + (D2 - 2 * D) * fminf(dx, dy);
+}
+
+i32 TileGraph::astar(i32 begin, i32 end, TileSearch *s) {
+  PROFILE_FUNC();
+
+  tile_search_begin(s, costs.len);
+
+  i32 ex = end % width;
+  i32 ey = end / width;
+
+  TileSearchNode *nodes = s->nodes.data;
+
+  nodes[begin] = {s->search, -1, 0, false};
+  float h = tile_heuristic(begin % width, begin / width, ex, ey, bloom);
+  s->frontier.push(begin, h);
+
+  i32 top = 0;
+  while (s->frontier.pop(&top)) {
+    TileSearchNode *node = &nodes[top];
+    node->closed = true;
+
+    if (top == end) {
+      return top;
+    }
+
+    i32 tx = top % width;
+    i32 ty = top / width;
+
+    for (u64 i = neighbors_begin(top); i < neighbors_end(top); i++) {
+      TileOffset offset = offsets[neighbors[i]];
+      i32 next = top + offset.delta;
+
+      TileSearchNode *n = &nodes[next];
+      if (n->search != s->search) {
+        *n = {s->search, -1, INFINITY, false};
+      } else if (n->closed) {
         continue;
       }
 
-      TileNode *node = graph->get(tile_key(x, y));
-      if (node == nullptr) {
-        return false;
+      float g = node->g + costs[next] * offset.distance;
+      if (g < n->g) {
+        n->g = g;
+        n->prev = top;
+
+        float h = tile_heuristic(tx + offset.x, ty + offset.y, ex, ey, bloom);
+        s->frontier.push(next, g + h);
       }
     }
   }
 
-  return true;
+  return -1;
 }
 
-static void create_neighbor_nodes(HashMap<TileNode> *graph, Arena *arena,
-                                  i32 bloom) {
+// a* over cluster entrances. src and dst are joined to the entrances of
+// their own clusters with searches that stay inside those clusters
+static bool tile_hierarchy_search(TileGraph *graph, i32 src, i32 dst,
+                                  TileSearch *s) {
   PROFILE_FUNC();
 
-  for (auto [k, v] : *graph) {
-    i32 len = 0;
-    Slice<TileNode *> neighbors = {};
+  i32 src_cluster = tile_cluster_of(graph, src);
+  i32 dst_cluster = tile_cluster_of(graph, dst);
+  TileClusterRect src_rect = tile_cluster_rect(graph, src_cluster);
+  TileClusterRect dst_rect = tile_cluster_rect(graph, dst_cluster);
+
+  i32 area = graph->cluster_size * graph->cluster_size;
+  s->cluster_from.resize(area);
+  s->cluster_to.resize(area);
+  tile_cluster_dijkstra(graph, src_rect, src, false, s->cluster_from.data,
+                        &s->cluster_frontier);
+  tile_cluster_dijkstra(graph, dst_rect, dst, true, s->cluster_to.data,
+                        &s->cluster_frontier);
+
+  tile_search_begin(s, graph->costs.len);
+
+  i32 width = graph->width;
+  i32 ex = dst % width;
+  i32 ey = dst / width;
+  TileSearchNode *nodes = s->nodes.data;
+
+  auto relax = [&](i32 from, i32 to, float cost) {
+    TileSearchNode *n = &nodes[to];
+    if (n->search != s->search) {
+      *n = {s->search, -1, INFINITY, false};
+    } else if (n->closed) {
+      return;
+    }
 
-    for (i32 y = -bloom; y <= bloom; y++) {
-      for (i32 x = -bloom; x <= bloom; x++) {
-        if (x == 0 && y == 0) {
-          continue;
-        }
+    float g = nodes[from].g + cost;
+    if (g < n->g) {
+      n->g = g;
+      n->prev = from;
 
-        i32 dx = v->x + x;
-        i32 dy = v->y + y;
-        TileNode *node = graph->get(tile_key(dx, dy));
-        if (node != nullptr) {
-          bool ok = tilemap_rect_overlaps_graph(graph, v->x, v->y, dx, dy);
-          if (!ok) {
-            continue;
-          }
+      float h = tile_heuristic(to % width, to / width, ex, ey, graph->bloom);
+      s->frontier.push(to, g + h);
+    }
+  };
 
-          if (len == neighbors.len) {
-            i32 grow = len > 0 ? len * 2 : 8;
-            neighbors.resize(arena, grow);
-          }
+  nodes[src] = {s->search, -1, 0, false};
+  float h = tile_heuristic(src % width, src / width, ex, ey, graph->bloom);
+  s->frontier.push(src, h);
+
+  i32 top = 0;
+  while (s->frontier.pop(&top)) {
+    nodes[top].closed = true;
+
+    if (top == dst) {
+      s->waypoints.len = 0;
+      for (i32 n = dst; n != -1; n = nodes[n].prev) {
+        s->waypoints.push(n);
+      }
+      return true;
+    }
 
-          neighbors[len] = node;
-          len++;
+    if (top == src) {
+      for (i32 e : graph->clusters[src_cluster].entrances) {
+        float d = s->cluster_from[tile_cluster_local(graph, src_rect, e)];
+        if (d != INFINITY) {
+          relax(top, e, d);
         }
       }
     }
 
-    neighbors.resize(arena, len);
-    v->neighbors = neighbors;
+    i32 index = graph->entrance_index[top];
+    if (index == -1) {
+      continue;
+    }
+
+    i32 c = tile_cluster_of(graph, top);
+    TileCluster *cluster = &graph->clusters[c];
+
+    u64 n = cluster->entrances.len;
+    for (u64 i = 0; i < n; i++) {
+      float d = cluster->costs[index * n + i];
+      if (d != INFINITY && (i32)i != index) {
+        relax(top, cluster->entrances[i], d);
+      }
+    }
+
+    // step across the border
+    i32 tx = top % width;
+    i32 ty = top / width;
+    i32 dirs[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    for (i32 i = 0; i < 4; i++) {
+      i32 nx = tx + dirs[i][0];
+      i32 ny = ty + dirs[i][1];
+      if (nx < 0 || ny < 0 || nx >= width || ny >= graph->height) {
+        continue;
+      }
+
+      i32 next = ny * width + nx;
+      if (graph->entrance_index[next] != -1 &&
+          tile_cluster_of(graph, next) != c && graph->costs[next] > 0) {
+        relax(top, next, graph->costs[next]);
+      }
+    }
+
+    if (c == dst_cluster) {
+      float d = s->cluster_to[tile_cluster_local(graph, dst_rect, top)];
+      if (d != INFINITY) {
+        relax(top, dst, d);
+      }
+    }
   }
+
+  return false;
 }
 
-void Tilemap::make_graph(i32 bloom, String layer_name, Slice<TileCost> costs) {
-  for (TilemapLevel &level : levels) {
-    for (TilemapLayer &l : level.layers) {
-      if (l.identifier == layer_name) {
-        if (graph_grid_size == 0) {
-          graph_grid_size = l.grid_size;
+// cell reached by a straight jump from (x, y), or -1
+static i32 tile_jump_straight(TileGraph *graph, i32 x, i32 y, i32 d,
+                              i32 goal) {
+  i32 width = graph->width;
+  i32 dx = TILE_DIRS[d][0];
+  i32 dy = TILE_DIRS[d][1];
+
+  i32 jump = graph->jumps[(y * width + x) * 4 + d];
+  i32 reach = jump > 0 ? jump : -jump;
+
+  // the goal is on this line, before the next jump point or wall
+  i32 gx = goal % width;
+  i32 gy = goal / width;
+  i32 t = 0;
+  if (dx != 0 && gy == y) {
+    t = (gx - x) * dx;
+  } else if (dy != 0 && gx == x) {
+    t = (gy - y) * dy;
+  }
+
+  if (t > 0 && t <= reach) {
+    return goal;
+  }
+
+  if (jump > 0) {
+    return (y + dy * jump) * width + x + dx * jump;
+  }
+  return -1;
+}
+
+// cell reached by a diagonal jump from (x, y), or -1. diagonal steps can't
+// cut corners, same as the neighbor lists
+static i32 tile_jump_diagonal(TileGraph *graph, i32 x, i32 y, i32 dx, i32 dy,
+                              i32 goal) {
+  i32 h = dx > 0 ? TileDir_East : TileDir_West;
+  i32 v = dy > 0 ? TileDir_South : TileDir_North;
+
+  while (tile_walkable(graph, x + dx, y) && tile_walkable(graph, x, y + dy) &&
+         tile_walkable(graph, x + dx, y + dy)) {
+    x += dx;
+    y += dy;
+
+    i32 cell = y * graph->width + x;
+    if (cell == goal || tile_jump_straight(graph, x, y, h, goal) != -1 ||
+        tile_jump_straight(graph, x, y, v, goal) != -1) {
+      return cell;
+    }
+  }
+
+  return -1;
+}
+
+static i32 tile_sign(i32 n) { return n > 0 ? 1 : (n < 0 ? -1 : 0); }
+
+static bool tile_jps(TileGraph *graph, i32 src, i32 dst, TileSearch *s) {
+  PROFILE_FUNC();
+
+  tile_search_begin(s, graph->costs.len);
+
+  i32 width = graph->width;
+  i32 ex = dst % width;
+  i32 ey = dst / width;
+  float cost = graph->uniform_cost;
+  TileSearchNode *nodes = s->nodes.data;
+
+  nodes[src] = {s->search, -1, 0, false};
+  float h = tile_heuristic(src % width, src / width, ex, ey, 1) * cost;
+  s->frontier.push(src, h);
+
+  i32 top = 0;
+  while (s->frontier.pop(&top)) {
+    TileSearchNode *node = &nodes[top];
+    node->closed = true;
+
+    if (top == dst) {
+      // jump points are joined by straight or diagonal lines
+      for (i32 n = dst; n != src;) {
+        i32 prev = nodes[n].prev;
+        i32 step = tile_sign(prev / width - n / width) * width +
+                   tile_sign(prev % width - n % width);
+        for (; n != prev; n += step) {
+          s->path.push(n);
+        }
+      }
+      s->path.push(src);
+      return true;
+    }
+
+    i32 x = top % width;
+    i32 y = top / width;
+
+    // only look in directions the parent can't reach as cheaply
+    i32 dirs[8][2] = {};
+    i32 count = 0;
+    auto add = [&](i32 dx, i32 dy) {
+      dirs[count][0] = dx;
+      dirs[count][1] = dy;
+      count++;
+    };
+
+    if (node->prev == -1) {
+      for (i32 dy = -1; dy <= 1; dy++) {
+        for (i32 dx = -1; dx <= 1; dx++) {
+          if (dx != 0 || dy != 0) {
+            add(dx, dy);
+          }
+        }
+      }
+    } else {
+      i32 dx = tile_sign(x - node->prev % width);
+      i32 dy = tile_sign(y - node->prev / width);
+
+      if (dx != 0 && dy != 0) {
+        bool horizontal = tile_walkable(graph, x + dx, y);
+        bool vertical = tile_walkable(graph, x, y + dy);
+        if (vertical) {
+          add(0, dy);
+        }
+        if (horizontal) {
+          add(dx, 0);
+        }
+        if (horizontal && vertical) {
+          add(dx, dy);
+        }
+      } else if (dx != 0) {
+        bool next = tile_walkable(graph, x + dx, y);
+        bool down = tile_walkable(graph, x, y + 1);
+        bool up = tile_walkable(graph, x, y - 1);
+        if (next) {
+          add(dx, 0);
+          if (down) {
+            add(dx, 1);
+          }
+          if (up) {
+            add(dx, -1);
+          }
+        }
+        if (down) {
+          add(0, 1);
+        }
+        if (up) {
+          add(0, -1);
+        }
+      } else {
+        bool next = tile_walkable(graph, x, y + dy);
+        bool right = tile_walkable(graph, x + 1, y);
+        bool left = tile_walkable(graph, x - 1, y);
+        if (next) {
+          add(0, dy);
+          if (right) {
+            add(1, dy);
+          }
+          if (left) {
+            add(-1, dy);
+          }
+        }
+        if (right) {
+          add(1, 0);
         }
-        make_graph_for_layer(&graph, &l, level.world_x, level.world_y, costs);
+        if (left) {
+          add(-1, 0);
+        }
+      }
+    }
+
+    for (i32 i = 0; i < count; i++) {
+      i32 dx = dirs[i][0];
+      i32 dy = dirs[i][1];
+
+      i32 jump = -1;
+      if (dx != 0 && dy != 0) {
+        jump = tile_jump_diagonal(graph, x, y, dx, dy, dst);
+      } else {
+        i32 d = dx > 0   ? TileDir_East
+                : dx < 0 ? TileDir_West
+                : dy > 0 ? TileDir_South
+                         : TileDir_North;
+        jump = tile_jump_straight(graph, x, y, d, dst);
+      }
+
+      if (jump == -1) {
+        continue;
+      }
+
+      TileSearchNode *n = &nodes[jump];
+      if (n->search != s->search) {
+        *n = {s->search, -1, INFINITY, false};
+      } else if (n->closed) {
+        continue;
+      }
+
+      i32 jx = jump % width;
+      i32 jy = jump / width;
+      i32 steps = abs(jx - x) > abs(jy - y) ? abs(jx - x) : abs(jy - y);
+      float distance = dx != 0 && dy != 0 ? steps * 1.4142135f : (float)steps;
+
+      float g = node->g + cost * distance;
+      if (g < n->g) {
+        n->g = g;
+        n->prev = top;
+
+        float h = tile_heuristic(jx, jy, ex, ey, 1) * cost;
+        s->frontier.push(jump, g + h);
       }
     }
   }
 
-  create_neighbor_nodes(&graph, &arena, bloom);
+  return false;
 }
 
-static float tile_distance(TileNode *lhs, TileNode *rhs) {
-  float dx = lhs->x - rhs->x;
-  float dy = lhs->y - rhs->y;
-  return sqrtf(dx * dx + dy * dy);
+bool TileGraph::path(TilePoint start, TilePoint goal, TileSearch *s) {
+  PROFILE_FUNC();
+
+  s->path.len = 0;
+
+  // search backwards so following prev walks from start to goal
+  i32 src = cell(goal);
+  i32 dst = cell(start);
+  if (src == -1 || dst == -1) {
+    return false;
+  }
+
+  if (cluster_size > 0 &&
+      tile_cluster_of(this, src) != tile_cluster_of(this, dst) &&
+      tile_hierarchy_search(this, src, dst, s)) {
+    // waypoints go from dst to src. fill in each step with a short search
+    bool ok = true;
+    for (u64 i = 0; ok && i + 1 < s->waypoints.len; i++) {
+      i32 to = s->waypoints[i];
+      i32 from = s->waypoints[i + 1];
+      ok = astar(from, to, s) != -1;
+
+      for (i32 n = to; ok && n != from; n = s->nodes[n].prev) {
+        s->path.push(n);
+      }
+    }
+
+    if (ok) {
+      s->path.push(src);
+      return true;
+    }
+    s->path.len = 0;
+  }
+
+  // graphs with jump tables use jump point search for the full search
+  if (jumps.len != 0) {
+    return tile_jps(this, src, dst, s);
+  }
+
+  // the hierarchy misses openings that are only crossed diagonally, so a
+  // failed hierarchical search still falls back to a full one
+  i32 end = astar(src, dst, s);
+  for (i32 n = end; n != -1; n = s->nodes[n].prev) {
+    s->path.push(n);
+  }
+  return end != -1;
 }
 
-static float tile_heuristic(TileNode *lhs, TileNode *rhs) {
-  float D = 1;
-  float D2 = 1.4142135f;
+static IndexedPriorityQueue *tile_flow_frontier(u64 cells) {
+  IndexedPriorityQueue *frontier = &tile_search()->frontier;
+  frontier->reserve(cells);
+  frontier->clear();
+  return frontier;
+}
 
-  float dx = (float)abs(lhs->x - rhs->x);
-  float dy = (float)abs(lhs->y - rhs->y);
-  return D * (dx + dy) + (D2 - 2 * D) * fminf(dx, dy);
+// dijkstra outwards from whatever is queued
+static void tile_flow_propagate(TileFlowField *ff,
+                                IndexedPriorityQueue *frontier) {
+  TileGraph *graph = ff->graph;
+
+  i32 top = 0;
+  while (frontier->pop(&top)) {
+    float base = ff->costs[top];
+
+    for (u64 i = graph->neighbors_begin(top); i < graph->neighbors_end(top);
+         i++) {
+      TileOffset offset = graph->offsets[graph->neighbors[i]];
+      i32 n = top + offset.delta;
+
+      float cost = base + graph->costs[n] * offset.distance;
+      if (cost < ff->costs[n] && cost <= ff->max_cost) {
+        ff->costs[n] = cost;
+        ff->next[n] = top;
+        frontier->push(n, cost);
+      }
+    }
+  }
 }
 
-static void astar_reset(Tilemap *tm) {
+void TileFlowField::make(TileGraph *graph, TilePoint goal, float max_cost) {
+  graph->refs++;
+  this->graph = graph;
+  this->goal = goal;
+  this->max_cost = max_cost;
+  compute();
+}
+
+void TileFlowField::compute() {
   PROFILE_FUNC();
 
-  tm->frontier.len = 0;
+  u64 cells = graph->costs.len;
+  costs.resize(cells);
+  next.resize(cells);
+  for (u64 i = 0; i < cells; i++) {
+    costs[i] = INFINITY;
+    next[i] = -1;
+  }
 
-  for (auto [k, v] : tm->graph) {
-    v->prev = nullptr;
-    v->g = 0;
-    v->flags = 0;
+  i32 cell = graph->cell(goal);
+  if (cell == -1) {
+    return;
   }
+
+  IndexedPriorityQueue *frontier = tile_flow_frontier(cells);
+  costs[cell] = 0;
+  frontier->push(cell, 0);
+  tile_flow_propagate(this, frontier);
 }
 
-TileNode *Tilemap::astar(TilePoint start, TilePoint goal) {
+void TileFlowField::update(TileGraph *g, Slice<TilePoint> changed) {
   PROFILE_FUNC();
 
-  astar_reset(this);
+  bool same_shape = g->x == graph->x && g->y == graph->y &&
+                    g->width == graph->width && g->height == graph->height &&
+                    g->bloom == graph->bloom;
 
-  i32 sx = (i32)(start.x / graph_grid_size);
-  i32 sy = (i32)(start.y / graph_grid_size);
-  i32 ex = (i32)(goal.x / graph_grid_size);
-  i32 ey = (i32)(goal.y / graph_grid_size);
-
-  TileNode *end = graph.get(tile_key(ex, ey));
-  if (end == nullptr) {
-    return nullptr;
+  if (g != graph) {
+    g->refs++;
+    tile_graph_release(graph);
+    graph = g;
   }
 
-  TileNode *begin = graph.get(tile_key(sx, sy));
-  if (begin == nullptr) {
-    return nullptr;
+  if (!same_shape || changed.len == 0) {
+    compute();
+    return;
   }
 
-  float g = 0;
-  float h = tile_heuristic(begin, end);
-  float f = g + h;
-  begin->g = 0;
-  begin->flags |= TileNodeFlags_Open;
-  frontier.push(begin, f);
+  i32 width = graph->width;
+  i32 height = graph->height;
+  i32 bloom = graph->bloom;
 
-  while (frontier.len != 0) {
-    TileNode *top = nullptr;
-    frontier.pop(&top);
-    top->flags |= TileNodeFlags_Closed;
+  // cells near a change can gain or lose edges, and anything that was
+  // routed through them has to be found again. next is -2 while marked
+  Array<i32> affected = {};
+  defer(affected.trash());
 
-    if (top == end) {
-      return top;
+  auto mark = [&](i32 cell) {
+    if (next[cell] != -2) {
+      next[cell] = -2;
+      affected.push(cell);
+    }
+  };
+
+  for (TilePoint p : changed) {
+    i32 cell = graph->index(p);
+    if (cell == -1) {
+      continue;
     }
 
-    for (TileNode *next : top->neighbors) {
-      if (next->flags & TileNodeFlags_Closed) {
-        continue;
+    i32 cx = cell % width;
+    i32 cy = cell / width;
+    for (i32 y = cy - bloom; y <= cy + bloom; y++) {
+      for (i32 x = cx - bloom; x <= cx + bloom; x++) {
+        if (x >= 0 && y >= 0 && x < width && y < height) {
+          mark(y * width + x);
+        }
       }
+    }
+  }
+
+  for (u64 i = 0; i < affected.len; i++) {
+    i32 cell = affected[i];
+    i32 cx = cell % width;
+    i32 cy = cell / width;
+
+    for (TileOffset offset : graph->offsets) {
+      i32 x = cx + offset.x;
+      i32 y = cy + offset.y;
+      if (x >= 0 && y >= 0 && x < width && y < height &&
+          next[cell + offset.delta] == cell) {
+        mark(cell + offset.delta);
+      }
+    }
+  }
+
+  for (i32 cell : affected) {
+    costs[cell] = INFINITY;
+    next[cell] = -1;
+  }
 
-      float g = top->g + next->cost * tile_distance(top, next);
+  // reconnect the marked cells to the rest of the field, then let the
+  // search carry any improvements outwards
+  IndexedPriorityQueue *frontier = tile_flow_frontier(costs.len);
+  i32 goal_cell = graph->cell(goal);
 
-      bool open = next->flags & TileNodeFlags_Open;
-      if (!open || g < next->g) {
-        float h = tile_heuristic(next, end);
-        float f = g + h;
+  for (i32 cell : affected) {
+    if (cell == goal_cell) {
+      costs[cell] = 0;
+      frontier->push(cell, 0);
+      continue;
+    }
 
-        next->g = g;
-        next->prev = top;
-        next->flags |= TileNodeFlags_Open;
+    for (u64 i = graph->neighbors_begin(cell); i < graph->neighbors_end(cell);
+         i++) {
+      TileOffset offset = graph->offsets[graph->neighbors[i]];
+      i32 n = cell + offset.delta;
 
-        frontier.push(next, f);
+      float cost = costs[n] + graph->costs[cell] * offset.distance;
+      if (cost < costs[cell] && cost <= max_cost) {
+        costs[cell] = cost;
+        next[cell] = n;
       }
     }
+
+    if (costs[cell] != INFINITY) {
+      frontier->push(cell, costs[cell]);
+    }
+  }
+
+  tile_flow_propagate(this, frontier);
+}
+
+void TileFlowField::trash() {
+  costs.trash();
+  next.trash();
+  if (graph != nullptr) {
+    tile_graph_release(graph);
+  }
+}
+
+static void tile_path_chunk_job(void *udata) {
+  PROFILE_FUNC();
+
+  TilePathChunk *chunk = (TilePathChunk *)udata;
+  TilePathBatch *batch = chunk->batch;
+  TileGraph *graph = batch->graph;
+  TileSearch *search = tile_search();
+
+  for (u32 i = chunk->first; i < chunk->first + chunk->count; i++) {
+    TilePathQuery *q = &batch->queries[i];
+    q->first = (u32)chunk->points.len;
+
+    graph->path(q->start, q->goal, search);
+    for (i32 n : search->path) {
+      chunk->points.push(graph->point(n));
+    }
+
+    q->len = (u32)chunk->points.len - q->first;
+  }
+
+  graph->readers.fetch_sub(1, std::memory_order_release);
+  batch->pending.fetch_sub(1, std::memory_order_release);
+  tile_path_batch_release(batch);
+}
+
+TilePathBatch *tile_path_batch_make(TileGraph *graph,
+                                    Array<TilePathQuery> queries) {
+  PROFILE_FUNC();
+
+  TilePathBatch *batch = (TilePathBatch *)mem_alloc(sizeof(TilePathBatch));
+  memset(batch, 0, sizeof(TilePathBatch));
+  new (&batch->refs) std::atomic<i32>();
+  new (&batch->pending) std::atomic<i32>();
+
+  batch->queries = queries;
+
+  if (graph == nullptr || queries.len == 0) {
+    batch->refs.store(1);
+    return batch;
+  }
+
+  graph->refs++;
+  batch->graph = graph;
+
+  // a few chunks per worker, so uneven searches even out
+  i32 workers = jobs_worker_count();
+  u64 per_chunk = queries.len / (u64)(workers > 0 ? workers * 4 : 1);
+  per_chunk = per_chunk < 8 ? 8 : per_chunk;
+
+  u64 count = (queries.len + per_chunk - 1) / per_chunk;
+  batch->chunks.resize(count);
+  memset(batch->chunks.data, 0, sizeof(TilePathChunk) * count);
+
+  for (u64 i = 0; i < count; i++) {
+    TilePathChunk *chunk = &batch->chunks[i];
+    chunk->batch = batch;
+    chunk->first = (u32)(i * per_chunk);
+    chunk->count = (u32)(queries.len - chunk->first < per_chunk
+                             ? queries.len - chunk->first
+                             : per_chunk);
+
+    for (u32 j = chunk->first; j < chunk->first + chunk->count; j++) {
+      batch->queries[j].chunk = (u32)i;
+    }
+  }
+
+  // one reference for the caller, one for each chunk
+  batch->refs.store(1 + (i32)count);
+  batch->pending.store((i32)count);
+  graph->readers.fetch_add((i32)count);
+
+  for (TilePathChunk &chunk : batch->chunks) {
+    jobs_push(tile_path_chunk_job, &chunk);
   }
 
-  return nullptr;
+  return batch;
+}
+
+void tile_path_batch_release(TilePathBatch *batch) {
+  if (batch->refs.fetch_sub(1) == 1) {
+    for (TilePathChunk &chunk : batch->chunks) {
+      chunk.points.trash();
+    }
+    batch->chunks.trash();
+    batch->queries.trash();
+
+    if (batch->graph != nullptr) {
+      tile_graph_release(batch->graph);
+    }
+    mem_free(batch);
+  }
 }
@@ -4,6 +4,7 @@
 #include "image.h"
 #include "priority_queue.h"
 #include "slice.h"
+#include <atomic>
 
 struct Tile {
   float x, y, u, v;
@@ -18,68 +19,298 @@ struct TilemapEntity {
 
 using TilemapInt = unsigned char;
 
+struct TilemapChunk {
+  float x0, y0, x1, y1; // bounds in level space
+  u32 first;            // index into layer tiles
+  u32 count;
+};
+
 struct TilemapLayer {
   String identifier;
+  String tileset_path; // empty if the layer has no tileset
   Image image;
-  Slice<Tile> tiles;
+  Slice<Tile> tiles; // grouped by chunk
+  Slice<TilemapChunk> chunks;
   Slice<TilemapEntity> entities;
   i32 c_width;
   i32 c_height;
   Slice<TilemapInt> int_grid;
   float grid_size;
+  u64 image_key;     // key into Tilemap::images
+  u32 vertex_buffer; // baked tile quads
 };
 
 struct TilemapLevel {
   String identifier;
   String iid;
+  String external; // level file, if the map saves levels separately
   float world_x, world_y;
   float px_width, px_height;
   Slice<TilemapLayer> layers;
 };
 
-enum TileNodeFlags {
-  TileNodeFlags_Open = 1 << 0,
-  TileNodeFlags_Closed = 1 << 1,
+struct TileCost {
+  TilemapInt cell;
+  float value;
 };
 
-struct TileNode {
-  TileNode *prev;
-  float g; // cost so far
-  u32 flags;
+struct TilePoint {
+  float x, y;
+};
 
+#define TILE_GRAPH_MAX_BLOOM 127 // neighbor offsets are stored as u16
+
+struct TileOffset {
   i32 x, y;
-  float cost;
-  Slice<TileNode *> neighbors;
+  i32 delta; // y * width + x
+  float distance;
 };
 
-struct TileCost {
-  TilemapInt cell;
-  float value;
+// a square of cells in the graph, with precomputed costs between the
+// places where paths can cross into a neighboring cluster
+struct TileCluster {
+  Array<i32> entrances; // cells on the cluster border
+  Array<float> costs;   // entrances.len squared, from row to column
 };
 
-struct TilePoint {
-  float x, y;
+struct TileSearch;
+
+// dense pathfinding grid covering every level that has the graph layer.
+// cells are indexed by y * width + x, relative to tile (x, y). reference
+// counted so path jobs can outlive make_graph. Tilemap::set_int patches
+// the graph in place, or a copy of it while path jobs are reading it
+struct TileGraph {
+  std::atomic<i32> refs;
+  std::atomic<i32> readers; // path jobs still searching
+  i32 x, y;
+  i32 width, height;
+  i32 bloom;
+  float grid_size;
+  Array<float> costs; // 0 if the cell can't be walked on
+  Array<TileOffset> offsets;
+
+  // packed, so memory follows the walkable neighbors rather than the
+  // bounding box. changing a cell splices in the rows within bloom of it
+  // and shifts the rest, which costs a copy of the whole list
+  Array<u32> first_neighbor; // width * height + 1 entries
+  Array<u16> neighbors;      // index into offsets
+
+  // optional hierarchy (HPA*). long paths are found between cluster
+  // entrances first, then refined one cluster at a time
+  i32 cluster_size; // 0 if there's no hierarchy
+  i32 clusters_x, clusters_y;
+  Array<TileCluster> clusters;
+  Array<i32> entrance_index; // per cell, into its cluster's entrances or -1
+
+  // jump point search, when bloom is 1 and every walkable cell costs the
+  // same. jumps has 4 entries per cell, see make_jumps
+  float uniform_cost; // 0 if costs differ
+  Array<i32> jumps;
+
+  u64 neighbors_begin(i32 cell) { return first_neighbor[cell]; }
+  u64 neighbors_end(i32 cell) { return first_neighbor[cell + 1]; }
+
+  i32 index(TilePoint p); // -1 if outside the graph
+  i32 cell(TilePoint p);  // -1 if outside or not walkable
+  TilePoint point(i32 cell);
+  i32 astar(i32 begin, i32 end, TileSearch *search);
+  bool path(TilePoint start, TilePoint goal, TileSearch *search);
+};
+
+TileGraph *tile_graph_make();
+void tile_graph_release(TileGraph *graph);
+
+struct TileSearchNode {
+  u32 search; // stale unless it matches TileSearch::search
+  i32 prev;
+  float g; // cost so far
+  bool closed;
+};
+
+// search state is kept per thread and reused between queries. nodes are
+// stamped with the search that touched them, so nothing is reset up front
+struct TileSearch {
+  Array<TileSearchNode> nodes;
+  IndexedPriorityQueue frontier;
+  u32 search;
+
+  Array<i32> path;      // cells from start to goal, filled by TileGraph::path
+  Array<i32> waypoints; // abstract path for hierarchical searches
+
+  // costs inside the clusters of the start and goal
+  IndexedPriorityQueue cluster_frontier;
+  Array<float> cluster_from;
+  Array<float> cluster_to;
+};
+
+TileSearch *tile_search();
+void tile_search_trash();
+
+struct TilePathQuery {
+  TilePoint start, goal;
+
+  // result, in the points of chunks[chunk]
+  u32 chunk;
+  u32 first;
+  u32 len;
 };
 
-inline u64 tile_key(i32 x, i32 y) { return ((u64)x << 32) | (u64)y; }
+struct TilePathBatch;
+
+struct TilePathChunk {
+  TilePathBatch *batch;
+  u32 first; // range of queries
+  u32 count;
+  Array<TilePoint> points;
+};
+
+// path queries split into chunks and run on the job system. paths go from
+// start to goal, and are empty if there's no path
+struct TilePathBatch {
+  std::atomic<i32> refs;
+  std::atomic<i32> pending; // chunks still running
+  TileGraph *graph;
+  Array<TilePathQuery> queries;
+  Array<TilePathChunk> chunks;
+
+  bool done() { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// shortest paths from every cell to one goal, so agents with the same goal
+// look up their next step instead of searching. holds a graph reference
+struct TileFlowField {
+  TileGraph *graph;
+  TilePoint goal;
+  float max_cost;
+  Array<float> costs; // cost to reach the goal, INFINITY if out of reach
+  Array<i32> next;    // neighbor one step closer to the goal, or -1
+
+  void make(TileGraph *graph, TilePoint goal, float max_cost);
+  void update(TileGraph *graph, Slice<TilePoint> changed);
+  void compute();
+  void trash();
+};
+
+// takes ownership of queries
+TilePathBatch *tile_path_batch_make(TileGraph *graph,
+                                    Array<TilePathQuery> queries);
+void tile_path_batch_release(TilePathBatch *batch);
+
+enum TileCollision : i32 {
+  TileCollision_Boxes,  // rectangles, grown greedily row by row
+  TileCollision_Rects,  // fewest rectangles
+  TileCollision_Chains, // wall outlines as chain loops
+};
+
+struct TileCollisionCount {
+  String level;
+  i32 fixtures;
+  i32 proxies; // broad-phase entries. chains have one per edge
+};
 
 class b2Body;
+class b2Fixture;
 class b2World;
 
+struct TileCollisionFixture {
+  b2Fixture *fixture; // nullptr if the slot is free
+  i32 x0, y0, x1, y1; // cells covered, inclusive. boxes and rects
+  Array<i32> edges;   // outline edges, see TileCollisionLayer. chains
+};
+
+// fixtures made for one level's layer, and which cells or edges each one
+// covers, so they can be rebuilt when the grid changes
+struct TileCollisionLayer {
+  TilemapLevel *level;
+  TilemapLayer *layer;
+  Array<TileCollisionFixture> fixtures;
+  Array<i32> free_fixtures;
+  Array<bool> solid; // per cell
+
+  // index into fixtures or -1. boxes and rects have one per cell. chains
+  // have four per lattice point (y * (c_width + 1) + x), one for each
+  // direction an outline edge can leave it in
+  Array<i32> owners;
+  Array<u8> outline; // per lattice point while tracing chains, else zero
+};
+
+struct TileCollisionBody {
+  b2Body *body;
+  float meter;
+  TileCollision mode;
+  Array<TilemapInt> walls;
+  Array<TileCollisionLayer> layers;
+};
+
+// a level read from its own file on a worker. shared by the job and the
+// stream, and owns the level's layers once they're in use
+struct TilemapLevelLoad {
+  std::atomic<i32> refs;
+  std::atomic<bool> done;
+  bool ok;
+  String filepath;             // map file, tileset paths are relative to it
+  String level_path;           // level file
+  HashMap<Image> images;       // tilesets loaded when the job started
+  HashMap<ImagePixels> pixels; // tilesets decoded by the job
+  Arena arena;
+  Slice<TilemapLayer> layers;
+};
+
+void tilemap_level_load_release(TilemapLevelLoad *load);
+
+enum TilemapLevelState : i32 {
+  TilemapLevelState_Unloaded,
+  TilemapLevelState_Loading,
+  TilemapLevelState_Loaded,
+};
+
+struct TilemapStreamLevel {
+  TilemapLevelState state;
+  bool active; // in range and reported as loaded
+  bool failed; // not retried until it goes out of range
+  TilemapLevelLoad *load;
+};
+
+struct TilemapStreamEvent {
+  i32 level; // index into Tilemap::levels
+  bool loaded;
+};
+
+// levels saved to separate files are loaded in the background when they
+// come near a focus point, and unloaded when they're far away again. levels
+// inside the map file are always loaded
+struct TilemapStream {
+  String filepath;
+  Array<TilemapStreamLevel> levels; // parallel to Tilemap::levels
+  HashMap<Image> images;  // tilesets only used by streamed levels
+  HashMap<i32> image_users;
+  i32 loading;
+};
+
 struct Tilemap {
   Arena arena;
   Slice<TilemapLevel> levels;
   HashMap<Image> images;    // key: filepath
-  HashMap<b2Body *> bodies; // key: layer name
-  HashMap<TileNode> graph;  // key: x, y
-  PriorityQueue<TileNode *> frontier;
-  float graph_grid_size;
+  HashMap<TileCollisionBody> bodies; // key: layer name
+  TileGraph *graph;
+  u64 graph_layer; // layer name hash
+  Array<TileCost> graph_costs;
+  TilemapStream *stream; // nullptr if every level is loaded up front
 
-  bool load(String filepath);
+  bool load(String filepath, bool stream_levels);
+  bool decode(String filepath, bool stream_levels,
+              HashMap<ImagePixels> *pixels);
+  void upload(HashMap<ImagePixels> *pixels);
   void trash();
   void destroy_bodies(b2World *world);
   void make_collision(b2World *world, float meter, String layer_name,
-                      Slice<TilemapInt> walls);
-  void make_graph(i32 bloom, String layer_name, Slice<TileCost> costs);
-  TileNode *astar(TilePoint start, TilePoint goal);
+                      Slice<TilemapInt> walls, TileCollision mode,
+                      Array<TileCollisionCount> *counts);
+  void make_graph(i32 bloom, String layer_name, Slice<TileCost> costs,
+                  i32 cluster_size);
+  bool set_int(String level_name, String layer_name, i32 x, i32 y,
+               TilemapInt value);
+  void update_stream(float x, float y, float radius,
+                     Array<TilemapStreamEvent> *events);
+  void keep_stream_state(Tilemap *prev);
 };
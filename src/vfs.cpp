@@ -1,5 +1,6 @@
 #include "vfs.h"
 #include "app.h"
+#include "arena.h"
 #include "deps/miniz.h"
 #include "deps/tinydir.h"
 #include "os.h"
@@ -23,8 +24,12 @@ static u32 read4(char *bytes) {
 static bool read_entire_file_raw(String *out, String filepath) {
   PROFILE_FUNC();
 
-  String path = to_cstr(filepath);
-  defer(mem_free(path.data));
+  if (filepath.len == 0) {
+    return false;
+  }
+
+  ScratchArena scratch;
+  String path = scratch.bump_string(filepath);
 
   FILE *file = fopen(path.data, "rb");
   if (file == nullptr) {
@@ -86,6 +91,9 @@ struct FileSystem {
   virtual bool mount(String filepath) = 0;
   virtual bool file_exists(String filepath) = 0;
   virtual bool read_entire_file(String *out, String filepath) = 0;
+  virtual bool write_entire_file(String filepath, String contents) = 0;
+  virtual FILE *open_write(String filepath) = 0;
+  virtual bool close_write(FILE *file, String filepath, bool keep) = 0;
   virtual bool list_all_files(Array<String> *files) = 0;
 };
 
@@ -120,6 +128,44 @@ struct DirectoryFileSystem : FileSystem {
     return read_entire_file_raw(out, filepath);
   }
 
+  bool write_entire_file(String filepath, String contents) {
+    PROFILE_FUNC();
+
+    String path = to_cstr(filepath);
+    defer(mem_free(path.data));
+
+    FILE *file = fopen(path.data, "wb");
+    if (file == nullptr) {
+      return false;
+    }
+
+    size_t written = fwrite(contents.data, sizeof(char), contents.len, file);
+    bool closed = fclose(file) == 0;
+    return written == contents.len && closed;
+  }
+
+  FILE *open_write(String filepath) {
+    String tmp = str_fmt("%.*s.tmp", (i32)filepath.len, filepath.data);
+    defer(mem_free(tmp.data));
+
+    return fopen(tmp.data, "wb");
+  }
+
+  bool close_write(FILE *file, String filepath, bool keep) {
+    String path = to_cstr(filepath);
+    defer(mem_free(path.data));
+    String tmp = str_fmt("%s.tmp", path.data);
+    defer(mem_free(tmp.data));
+
+    bool closed = fclose(file) == 0;
+    if (keep && closed && os_replace_file(tmp.data, path.data)) {
+      return true;
+    }
+
+    remove(tmp.data);
+    return false;
+  }
+
   bool list_all_files(Array<String> *files) {
     return list_all_files_help(files, "");
   }
@@ -254,6 +300,13 @@ struct ZipFileSystem : FileSystem {
     return true;
   }
 
+  // zip archives are read only
+  bool write_entire_file(String filepath, String contents) { return false; }
+
+  FILE *open_write(String filepath) { return nullptr; }
+
+  bool close_write(FILE *file, String filepath, bool keep) { return false; }
+
   bool list_all_files(Array<String> *files) {
     PROFILE_FUNC();
 
@@ -389,6 +442,7 @@ MountResult vfs_mount(const char *filepath) {
 #endif
 
   if (filepath != nullptr && !res.ok) {
+    ScratchArena scratch;
     fatal_error(tmp_fmt("failed to load: %s", filepath));
   }
 
@@ -410,6 +464,18 @@ bool vfs_read_entire_file(String *out, String filepath) {
   return g_filesystem->read_entire_file(out, filepath);
 }
 
+bool vfs_write_entire_file(String filepath, String contents) {
+  return g_filesystem->write_entire_file(filepath, contents);
+}
+
+FILE *vfs_open_write(String filepath) {
+  return g_filesystem->open_write(filepath);
+}
+
+bool vfs_close_write(FILE *file, String filepath, bool keep) {
+  return g_filesystem->close_write(file, filepath, keep);
+}
+
 bool vfs_list_all_files(Array<String> *files) {
   return g_filesystem->list_all_files(files);
 }
@@ -15,6 +15,11 @@ void vfs_trash();
 bool vfs_file_exists(String filepath);
 bool vfs_read_entire_file(String *out, String filepath);
 bool vfs_write_entire_file(String filepath, String contents);
+// for writing in pieces. nullptr if the file system is read only. the
+// file is written beside filepath, and only replaces it in vfs_close_write
+// if keep is true, so a failed write leaves the old file alone
+FILE *vfs_open_write(String filepath);
+bool vfs_close_write(FILE *file, String filepath, bool keep);
 bool vfs_list_all_files(Array<String> *files);
 
 void *vfs_for_miniaudio();
\ No newline at end of file
@@ -253,6 +253,54 @@ $api_reference = [
       "args" => [],
       "return" => "number",
     ],
+    "spry.frame_allocations" => [
+      "desc" => "
+        Returns the number of heap allocations made during the previous
+        frame, across all threads.
+      ",
+      "example" => "print(spry.frame_allocations())",
+      "args" => [],
+      "return" => "number",
+    ],
+    "spry.profile_start" => [
+      "desc" => "
+        Start capturing a profile. If `frames` is given, capture stops on its
+        own after that many frames. Otherwise, it runs until
+        `spry.profile_stop` is called or the program exits.
+
+        The capture is written to `profile.trace` next to the executable,
+        and converted to `profile.json` when it stops. Open `profile.json`
+        in `chrome://tracing` or [Perfetto](https://ui.perfetto.dev/).
+
+        Capture can also be started with the `--profile` or
+        `--profile-frames <n>` command line options.
+      ",
+      "example" => "
+        if spry.key_press 'f5' then
+          spry.profile_start(120)
+        end
+      ",
+      "args" => [
+        "frames" => ["number", "Number of frames to capture.", "nil"],
+      ],
+      "return" => false,
+    ],
+    "spry.profile_stop" => [
+      "desc" => "Stop capturing a profile.",
+      "example" => "spry.profile_stop()",
+      "args" => [],
+      "return" => false,
+    ],
+    "spry.profile_active" => [
+      "desc" => "Returns true if a profile is being captured.",
+      "example" => "
+        if spry.profile_active() then
+          font:draw('recording', 0, 0)
+        end
+      ",
+      "args" => [],
+      "return" => "boolean",
+    ],
     "spry.fullscreen" => [
       "desc" => "Returns true if program is fullscreen.",
       "example" => "local fs = spry.fullscreen()",
@@ -341,12 +389,145 @@ $api_reference = [
       ",
       "args" => [
         "value" => ["mixed", "The value to convert."],
+        "width" => ["number", "Spaces per indent level. Use `0` for compact output.", 0],
       ],
       "return" => [
         "on success" => "string",
         "on failure" => "nil, string",
       ],
     ],
+    "spry.json_write_file" => [
+      "desc" => "
+        Serialize a Lua value as JSON straight to a file, without building
+        the whole string in memory first. The path is relative to the
+        project directory. Files can't be written when running from a zip.
+        The value is written to a temporary file that only replaces the
+        old one once everything was written, so a failed write keeps the
+        old file.
+      ",
+      "example" => "
+        local ok, err = spry.json_write_file('save.json', state)
+        if not ok then
+          print(err)
+        end
+      ",
+      "args" => [
+        "path" => ["string", "The file to write to."],
+        "value" => ["mixed", "The value to convert."],
+        "width" => ["number", "Spaces per indent level. Use `0` for compact output.", 0],
+      ],
+      "return" => [
+        "on success" => "true",
+        "on failure" => "nil, string",
+      ],
+    ],
+    "spry.json_reader" => [
+      "desc" => "
+        Create a reader that parses JSON one piece at a time, without
+        building the whole value first. Useful for large files, or for JSON
+        that arrives in chunks, like an HTTP response body.
+
+        If `str` is given, it's the whole document. Otherwise, pass chunks
+        to `JSONReader:feed` as they arrive, then call `JSONReader:finish`.
+      ",
+      "example" => "
+        local reader = spry.json_reader(spry.file_read 'save.json')
+        assert(reader:next() == 'object_begin')
+        while true do
+          local event, key = reader:next()
+          if event ~= 'key' then break end
+          if key == 'player' then
+            player = reader:value()
+          else
+            reader:skip()
+          end
+        end
+      ",
+      "args" => [
+        "str" => ["string", "The whole JSON document.", "nil"],
+      ],
+      "return" => "JSONReader",
+    ],
+    "JSONReader:feed" => [
+      "desc" => "
+        Add the next chunk of input. Can't be called after
+        `JSONReader:finish`.
+      ",
+      "example" => "reader:feed(chunk)",
+      "args" => [
+        "chunk" => ["string", "The next part of the JSON document."],
+      ],
+      "return" => false,
+    ],
+    "JSONReader:finish" => [
+      "desc" => "Mark the end of the input, after the last chunk is fed.",
+      "example" => "reader:finish()",
+      "args" => [],
+      "return" => false,
+    ],
+    "JSONReader:next" => [
+      "desc" => "
+        Read the next event. Returns one of:
+        - `object_begin`, `object_end`, `array_begin`, `array_end`
+        - `key`, followed by the key
+        - `string`, `number`, `boolean`, followed by the value
+        - `null`
+        - `end`, at the end of the document
+        - `more`, if the reader needs more input before it can continue
+        - `error`, followed by an error message
+      ",
+      "example" => "
+        local event, value = reader:next()
+        if event == 'more' then
+          reader:feed(socket_read())
+        end
+      ",
+      "args" => [],
+      "return" => "string, mixed",
+    ],
+    "JSONReader:skip" => [
+      "desc" => "
+        Skip the rest of the object or array that the last event started,
+        or the value of the last key. Returns the event that ended it, like
+        `JSONReader:next`. If it returns `more`, feed the reader and call
+        `skip` again to continue.
+      ",
+      "example" => "
+        local event, key = reader:next()
+        if key == 'unused' then
+          reader:skip()
+        end
+      ",
+      "args" => [],
+      "return" => "string, mixed",
+    ],
+    "JSONReader:value" => [
+      "desc" => "
+        Read the next value into a Lua value. If the next event doesn't
+        start a value, returns `nil` followed by the event, like
+        `JSONReader:next`. If the reader needs more input, nothing is read,
+        and the value can be read again after the next feed.
+      ",
+      "example" => "
+        assert(reader:next() == 'array_begin')
+        while true do
+          local enemy, event = reader:value()
+          if event == 'array_end' then break end
+          spawn_enemy(enemy)
+        end
+      ",
+      "args" => [],
+      "return" => [
+        "on success" => "mixed",
+        "otherwise" => "nil, string, mixed",
+      ],
+    ],
+    "JSONReader:depth" => [
+      "desc" => "Get the number of objects and arrays the reader is inside.",
+      "example" => "local depth = reader:depth()",
+      "args" => [],
+      "return" => "number",
+    ],
   ],
   "Filesystem" => [
     "spry.program_path" => [
@@ -691,6 +872,21 @@ $api_reference = [
       ],
       "return" => false,
     ],
+    "spry.draw_stats" => [
+      "desc" => "
+        Get renderer statistics for the previous frame. `batches` is the
+        number of sprite batches submitted to the GPU, and `vertices` is the
+        number of batched vertices. Consecutive image, sprite, font, and
+        tilemap draws that share the same texture and sampler are merged into
+        a single batch.
+      ",
+      "example" => "
+        local stats = spry.draw_stats()
+        font:draw(stats.batches .. ' batches', 0, 0, 16)
+      ",
+      "args" => [],
+      "return" => "table",
+    ],
   ],
   "Sampler" => [
     "spry.make_sampler" => [
@@ -1156,10 +1352,22 @@ $api_reference = [
       "desc" => "
         Create a tilemap object from a LDtk file. [LDtk](https://ldtk.io/) is
         a 2D level editor.
+
+        After the first load, a binary copy of the parsed map is written next
+        to the source file as `<file>.cooked`. Later loads read the cooked
+        file instead of parsing the JSON, as long as the source file hasn't
+        changed. Cooked files can be deleted at any time, and are never
+        written into zip archives.
+
+        Maps saved with separate level files are supported. By default, every
+        level is loaded right away. If `stream` is true, only the position
+        and size of those levels is loaded, and their contents are loaded
+        later by `Tilemap:stream`.
       ",
       "example" => "local tilemap = spry.tilemap_load 'world.ldtk'",
       "args" => [
         "file" => ["string", "The tilemap file to open."],
+        "stream" => ["boolean", "Load separate level files on demand.", "false"],
       ],
       "return" => [
         "on success" => "Tilemap",
@@ -1167,13 +1375,23 @@ $api_reference = [
       ],
     ],
     "Tilemap:draw" => [
-      "desc" => "Draw an entire tilemap, including all of the map's levels and layers.",
+      "desc" => "
+        Draw a tilemap, including all of the map's levels and layers. Only
+        levels and chunks of tiles that overlap the view rectangle are drawn.
+        If no rectangle is given, the view is derived from the current matrix
+        stack and the window size.
+      ",
       "example" => "
         camera:begin_draw()
         tilemap:draw()
         camera:end_draw()
       ",
-      "args" => [],
+      "args" => [
+        "x" => ["number", "The left edge of the view rectangle, in world space.", "nil"],
+        "y" => ["number", "The top edge of the view rectangle, in world space.", "nil"],
+        "w" => ["number", "The width of the view rectangle.", "nil"],
+        "h" => ["number", "The height of the view rectangle.", "nil"],
+      ],
       "return" => false,
     ],
     "Tilemap:entities" => [
@@ -1194,25 +1412,84 @@ $api_reference = [
       "args" => [],
       "return" => "table",
     ],
+    "Tilemap:stream" => [
+      "desc" => "
+        Load and unload levels around a point, for tilemaps loaded with
+        `stream` set to true. Call it every frame. Levels within `radius` of
+        the point are read from their level files in the background, and
+        levels more than one and a half times `radius` away are unloaded,
+        along with their fixtures from `Tilemap:make_collision`, and any
+        tileset images no other level uses.
+
+        `on_load` is called with the level's identifier and a list of its
+        entities, in the same form as `Tilemap:entities`, once a level is
+        loaded and in range. `on_unload` is called with the identifier when
+        it goes out of range. Levels inside the map file are never unloaded,
+        but the callbacks are still called for them.
+
+        Returns the number of levels that are still loading. The graph from
+        `Tilemap:make_graph` only covers levels that were loaded when it was
+        made.
+      ",
+      "example" => "
+        local spawned = {}
+        tilemap:stream(player.x, player.y, 512, function(level, entities)
+          spawned[level] = {}
+          for _, v in ipairs(entities) do
+            table.insert(spawned[level], world:add(make_entity(v)))
+          end
+        end, function(level)
+          for _, obj in ipairs(spawned[level]) do
+            world:kill(obj)
+          end
+          spawned[level] = nil
+        end)
+      ",
+      "args" => [
+        "x" => ["number", "The x position of the focus point."],
+        "y" => ["number", "The y position of the focus point."],
+        "radius" => ["number", "How far away levels are loaded."],
+        "on_load" => ["function", "Called when a level is loaded.", "nil"],
+        "on_unload" => ["function", "Called when a level is unloaded.", "nil"],
+      ],
+      "return" => "number",
+    ],
     "Tilemap:make_collision" => [
       "desc" => "
         Create Box2D fixtures for a tilemap. Mark certain tiles for collision
         by providing an array of IntGrid values.
+
+        The `mode` argument decides the shape of the fixtures:
+
+        - `boxes` grows rectangles greedily, row by row.
+        - `rects` splits the walls into the fewest rectangles that don't
+          overlap.
+        - `chains` traces the outline of each wall region into a chain loop,
+          with straight runs merged into one edge. Chains are one sided, so
+          bodies that start inside a wall are not pushed out.
+
+        Returns the number of fixtures and broad-phase proxies created for
+        each level, keyed by level identifier. A chain adds one proxy per
+        edge.
       ",
       "example" => "
         b2 = spry.b2_world { gx = 0, gy = 0, meter = 16 }
         tilemap = spry.tilemap_load 'map.ldtk'
-        tilemap:make_collision(b2, 16, 'Collision', { 1, 2 })
+        local counts = tilemap:make_collision(b2, 'Collision', { 1, 2 }, 'chains')
+        for level, count in pairs(counts) do
+          print(level, count.fixtures, count.proxies)
+        end
       ",
       "args" => [
         "world" => ["b2World", "The Box2D physics world."],
         "layer" => ["string", "The name of the IntGrid collision layer."],
         "walls" => ["table", "An array of numbers used for collision."],
+        "mode" => ["string", "One of `boxes`, `rects`, or `chains`.", "'boxes'"],
       ],
-      "return" => false,
+      "return" => "table",
     ],
     "Tilemap:draw_fixtures" => [
-      "desc" => "Draw all box fixtures for a given tilemap layer.",
+      "desc" => "Draw all fixtures for a given tilemap layer.",
       "example" => "
         tilemap:draw_fixtures(b2, 'Collision')
       ",
@@ -1222,6 +1499,27 @@ $api_reference = [
       ],
       "return" => false,
     ],
+    "Tilemap:set_int" => [
+      "desc" => "
+        Change one IntGrid value at runtime. Collision fixtures made with
+        `make_collision` for this layer are rebuilt only around the tile, and
+        so is the pathfinding graph if it was made from this layer. Flow
+        fields need `FlowField:update` with the changed position.
+      ",
+      "example" => "
+        if tilemap:set_int('Level_0', 'Collision', tx, ty, 0) then
+          field:update(tilemap, { tx * 16, ty * 16 })
+        end
+      ",
+      "args" => [
+        "level" => ["string", "The level identifier."],
+        "layer" => ["string", "The name of the IntGrid layer."],
+        "x" => ["number", "The tile column in the level, starting at 0."],
+        "y" => ["number", "The tile row in the level, starting at 0."],
+        "value" => ["number", "The new IntGrid value."],
+      ],
+      "return" => "boolean",
+    ],
     "Tilemap:make_graph" => [
       "desc" => "
         Prepare a tilemap for pathfinding by internally constructing a graph.
@@ -1234,6 +1532,16 @@ $api_reference = [
         neighbor nodes. For example, a bloom of 1 looks at adjacent tiles. A
         bloom of 2 looks for nodes in a 5x5 region, 2 nodes outwards. Bloom
         of 3 looks for nodes in a 7x7 region, 3 nodes outwards, etc.
+
+        If bloom is 1 and every tile in `costs` has the same cost, paths are
+        found with jump point search. This finds the same shortest paths, but
+        is much faster on open maps.
+
+        For large maps, set `cluster_size` to split the graph into square
+        clusters of that many tiles. Long paths are then planned between
+        clusters first, which is much faster but may be slightly longer
+        than the shortest path. Calling `make_graph` again only rebuilds
+        the clusters whose tiles changed.
       ",
       "example" => "
         tilemap = spry.tilemap_load 'map.ldtk'
@@ -1243,11 +1551,16 @@ $api_reference = [
         "layer" => ["string", "The name of the IntGrid collision layer."],
         "costs" => ["table", "The costs to traverse to each tile."],
         "bloom" => ["number", "The number of nodes outwards to consider as neighbors.", 1],
+        "cluster_size" => ["number", "The width and height of each cluster in tiles, or 0 to not use clusters.", 0],
       ],
       "return" => false,
     ],
     "Tilemap:astar" => [
-      "desc" => "Find the shortest path between two tiles.",
+      "desc" => "
+        Find the shortest path between two tiles. The path is a list of points
+        from the starting tile to the target tile, or an empty table if there
+        is no path. `Tilemap:make_graph` must be called first.
+      ",
       "example" => "
         local path = tilemap:astar(start.x, start.y, goal.x, goal.y)
         for k, v in ipairs(path) do
@@ -1262,6 +1575,276 @@ $api_reference = [
       ],
       "return" => "table",
     ],
+    "Tilemap:astar_batch" => [
+      "desc" => "
+        Find many paths at once on worker threads. Each query is a table of
+        `{sx, sy, ex, ey}`, using the same positions as `Tilemap:astar`.
+
+        Returns a handle that works with `await`. Its `result` is a list with
+        one path per query, in order. Each path is a flat list of numbers
+        `{x0, y0, x1, y1, ...}` from the starting tile to the target tile,
+        and is empty if there is no path.
+      ",
+      "example" => "
+        local batch = tilemap:astar_batch(queries)
+
+        -- later, usually on the next frame
+        if batch:done() then
+          for i, path in ipairs(batch:result()) do
+            units[i]:follow(path)
+          end
+        end
+      ",
+      "args" => [
+        "queries" => ["table", "A list of `{sx, sy, ex, ey}` tables."],
+      ],
+      "return" => "PathBatch",
+    ],
+    "Tilemap:flow_field" => [
+      "desc" => "
+        Find the cheapest way to reach one goal from every tile in the graph
+        made by `Tilemap:make_graph`. Use this instead of `Tilemap:astar` when
+        many agents share the same goal. Each agent looks up its next step
+        in the returned field.
+
+        Tiles that cost more than `max_cost` to reach are left out of the
+        field. Returns nil if the tilemap has no graph.
+      ",
+      "example" => "
+        field = tilemap:flow_field(player.x, player.y)
+
+        -- in spry.frame
+        for _, enemy in ipairs(enemies) do
+          local dx, dy = field:direction(enemy.x, enemy.y)
+          if dx then
+            enemy.x = enemy.x + dx * enemy.speed * dt
+            enemy.y = enemy.y + dy * enemy.speed * dt
+          end
+        end
+      ",
+      "args" => [
+        "x" => ["number", "The goal's x position."],
+        "y" => ["number", "The goal's y position."],
+        "max_cost" => ["number", "Only include tiles that can reach the goal within this cost.", "math.huge"],
+      ],
+      "return" => "FlowField",
+    ],
+    "PathBatch:done" => [
+      "desc" => "Returns true if every path in the batch has been found.",
+      "example" => "local ready = batch:done()",
+      "args" => [],
+      "return" => "boolean",
+    ],
+    "PathBatch:result" => [
+      "desc" => "Get the paths found by `Tilemap:astar_batch`.",
+      "example" => "local paths = batch:result()",
+      "args" => [],
+      "return" => [
+        "if the batch is done" => "table",
+        "if paths are still being found" => "nil",
+      ],
+    ],
+    "FlowField:cost" => [
+      "desc" => "Get the cost of reaching the goal from a position.",
+      "example" => "local cost = field:cost(x, y)",
+      "args" => [
+        "x" => ["number", "The x position."],
+        "y" => ["number", "The y position."],
+      ],
+      "return" => [
+        "if the goal can be reached" => "number",
+        "otherwise" => "nil",
+      ],
+    ],
+    "FlowField:next" => [
+      "desc" => "Get the position of the next tile on the way to the goal.",
+      "example" => "local nx, ny = field:next(x, y)",
+      "args" => [
+        "x" => ["number", "The x position."],
+        "y" => ["number", "The y position."],
+      ],
+      "return" => [
+        "if there is a next tile" => "number, number",
+        "at the goal, or if the goal can't be reached" => "nil",
+      ],
+    ],
+    "FlowField:direction" => [
+      "desc" => "
+        Get the direction to move in to reach the goal, as a unit vector.
+        Returns `0, 0` at the goal.
+      ",
+      "example" => "local dx, dy = field:direction(x, y)",
+      "args" => [
+        "x" => ["number", "The x position."],
+        "y" => ["number", "The y position."],
+      ],
+      "return" => [
+        "if the goal can be reached" => "number, number",
+        "otherwise" => "nil",
+      ],
+    ],
+    "FlowField:update" => [
+      "desc" => "
+        Recompute the field after calling `Tilemap:make_graph` or
+        `Tilemap:set_int`. If `changed` lists the positions of the tiles that
+        changed, only the part of the field that depends on them is
+        recomputed. Otherwise the whole field is recomputed.
+      ",
+      "example" => "
+        tilemap:make_graph('Floor', costs)
+        field:update(tilemap, { door.x, door.y })
+      ",
+      "args" => [
+        "tilemap" => ["Tilemap", "The tilemap the field was made from."],
+        "changed" => ["table", "Changed positions as a flat list: `{x0, y0, x1, y1, ...}`.", "nil"],
+      ],
+      "return" => false,
+    ],
+  ],
+  "Asynchronous Loading" => [
+    "spry.image_load_async" => [
+      "desc" => "
+        Start loading an image in the background. The file is read and decoded
+        on a worker thread, and the texture is created on the main thread at
+        the end of a frame. Loading the same file more than once shares the
+        same request.
+      ",
+      "example" => "
+        function Level:load_thread()
+          local img = await(spry.image_load_async 'background.png')
+          self.background = img
+        end
+      ",
+      "args" => [
+        "file" => ["string", "The image file to open."],
+        "mipmaps" => ["boolean", "If true, generate mipmaps for this image.", "false"],
+      ],
+      "return" => "AssetLoad",
+    ],
+    "spry.sprite_load_async" => [
+      "desc" => "Start loading an Aseprite file in the background.",
+      "example" => "local req = spry.sprite_load_async 'player.ase'",
+      "args" => [
+        "file" => ["string", "The sprite file to open."],
+      ],
+      "return" => "AssetLoad",
+    ],
+    "spry.tilemap_load_async" => [
+      "desc" => "
+        Start loading a LDtk file in the background. The map and all of its
+        tileset images are decoded on a worker thread.
+      ",
+      "example" => "local req = spry.tilemap_load_async 'world.ldtk'",
+      "args" => [
+        "file" => ["string", "The tilemap file to open."],
+        "stream" => ["boolean", "Load separate level files on demand. See `spry.tilemap_load`.", "false"],
+      ],
+      "return" => "AssetLoad",
+    ],
+    "spry.asset_load_stats" => [
+      "desc" => "
+        Get the state of the background loader. `decoding` is the number of
+        files waiting for or being decoded, `uploading` is the number of files
+        waiting for the main thread, `loaded` is the total number of
+        successful loads, and `failed` is the total number of files that
+        couldn't be decoded. `decode_time` is the total decode time of
+        finished loads in seconds, and `last_decode_time` is the decode time
+        of the most recent one.
+      ",
+      "example" => "
+        local stats = spry.asset_load_stats()
+        if stats.decoding + stats.uploading > 0 then
+          draw_loading_screen()
+        end
+      ",
+      "args" => [],
+      "return" => "table",
+    ],
+    "AssetLoad:done" => [
+      "desc" => "Returns true if the load has finished, whether or not it succeeded.",
+      "example" => "
+        while not req:done() do
+          coroutine.yield()
+        end
+      ",
+      "args" => [],
+      "return" => "boolean",
+    ],
+    "AssetLoad:result" => [
+      "desc" => "Get the loaded asset.",
+      "example" => "local img = req:result()",
+      "args" => [],
+      "return" => [
+        "on success" => "Image | Sprite | Tilemap",
+        "if the asset isn't loaded, or failed to load" => "nil",
+      ],
+    ],
+    "AssetLoad:decode_time" => [
+      "desc" => "Get the number of seconds spent reading and decoding this file.",
+      "example" => "print(req:decode_time())",
+      "args" => [],
+      "return" => [
+        "if decoding has finished" => "number",
+        "if the file is still decoding" => "nil",
+      ],
+    ],
+    "spry.json_read_async" => [
+      "desc" => "
+        Parse JSON on a worker thread. The argument is read as JSON text if it
+        starts with `{` or `[`, otherwise it's a file to read. Only turning the
+        parsed document into tables happens on the main thread, when the
+        result is asked for.
+      ",
+      "example" => "
+        function Game:load_thread()
+          local save, err = await(spry.json_read_async 'save.json')
+        end
+      ",
+      "args" => [
+        "source" => ["string", "JSON text, or the file to read."],
+      ],
+      "return" => "JSONJob",
+    ],
+    "spry.json_write_async" => [
+      "desc" => "
+        Serialize a Lua value into a JSON string on a worker thread. The value
+        is copied when this is called, so it can be changed right away. The
+        copy fails if a table has cycles.
+      ",
+      "example" => "
+        function Game:save_thread()
+          local str, err = await(spry.json_write_async(self.state))
+        end
+      ",
+      "args" => [
+        "value" => ["mixed", "The value to convert."],
+        "width" => ["number", "Spaces per indent level. Use `0` for compact output.", 0],
+      ],
+      "return" => "JSONJob",
+    ],
+    "JSONJob:done" => [
+      "desc" => "Returns true if the job has finished, whether or not it succeeded.",
+      "example" => "
+        while not job:done() do
+          coroutine.yield()
+        end
+      ",
+      "args" => [],
+      "return" => "boolean",
+    ],
+    "JSONJob:result" => [
+      "desc" => "
+        Get the parsed value of a read, or the string of a write. Reads build
+        new tables each time this is called.
+      ",
+      "example" => "local data, err = job:result()",
+      "args" => [],
+      "return" => [
+        "on success" => "mixed",
+        "on failure" => "nil, string",
+        "if the job isn't done" => "nil",
+      ],
+    ],
   ],
   "Multithreading" => [
     "spry.make_thread" => [
@@ -1344,7 +1927,8 @@ $api_reference = [
     "spry.select" => [
       "desc" => "
         Wait on multiple channels. Returns a received value from a channel and
-        the channel's name where the value originated from.
+        the channel's name where the value originated from. If the last
+        argument is a number, gives up after that many seconds.
       ",
       "example" => "
         c1 = spry.make_channel 'c1'
@@ -1372,9 +1956,31 @@ $api_reference = [
         -- two  c2
       ",
       "args" => [
-        "..." => [false, "The channels to wait on."],
+        "..." => [false, "The channels to wait on, optionally followed by a timeout in seconds."],
+      ],
+      "return" => [
+        "on success" => "mixed, string",
+        "if the timeout ran out" => "nil",
+      ],
+    ],
+    "spry.try_select" => [
+      "desc" => "
+        Like `spry.select`, but returns right away if none of the channels
+        have anything in them. It doesn't take a timeout.
+      ",
+      "example" => "
+        local msg, ch = spry.try_select(c1, c2)
+        if msg ~= nil then
+          print(msg, ch)
+        end
+      ",
+      "args" => [
+        "..." => [false, "The channels to check."],
+      ],
+      "return" => [
+        "on success" => "mixed, string",
+        "if the channels are empty" => "nil",
       ],
-      "return" => "mixed, string",
     ],
     "Channel:send" => [
       "desc" => "Send data into a channel. Blocks if buffer is full.",
@@ -1428,6 +2034,35 @@ $api_reference = [
         "if channel is empty" => "nil, false",
       ],
     ],
+    "Channel:send_many" => [
+      "desc" => "
+        Send every item of a list into a channel, in order. Cheaper than
+        calling `send` for each one, since waiting threads are only woken
+        once. Blocks while the buffer is full.
+      ",
+      "example" => "
+        ch:send_many { 'a', 'b', { x = 1 } }
+      ",
+      "args" => [
+        "items" => ["table", "The list of data to send."],
+      ],
+      "return" => false,
+    ],
+    "Channel:recv_many" => [
+      "desc" => "
+        Receive up to `n` items out of a channel. Blocks until there's at least
+        one item, then takes whatever else is already there.
+      ",
+      "example" => "
+        for _, msg in ipairs(ch:recv_many(64)) do
+          handle(msg)
+        end
+      ",
+      "args" => [
+        "n" => ["number", "The most items to receive."],
+      ],
+      "return" => "table",
+    ],
   ],
   "Box2D World" => [
     "spry.b2_world" => [
@@ -3182,6 +3817,21 @@ $api_reference = [
       ],
       "return" => "number",
     ],
+    "await" => [
+      "desc" => "
+        Yields a coroutine until an asynchronous request is done, then returns
+        its result.
+      ",
+      "example" => "
+        function Level:load_thread()
+          self.tilemap = await(spry.tilemap_load_async 'world.ldtk')
+        end
+      ",
+      "args" => [
+        "handle" => ["AssetLoad | JSONJob", "The request to wait for."],
+      ],
+      "return" => "any",
+    ],
   ],
 ];
 